@@ -53,10 +53,11 @@ def _plot(infile):
     #  run(["pdfcrop", outfile, outfile], stdout=DEVNULL, check=True)
     logger.info(f"Plot saved to {outfile}")
 
-    # Plot Boxplot
+    # Plot Boxplot of the delays only (results.csv also records the display mode)
+    delays = data[[column for column in data.columns if column.endswith("(us)")]]
     fig, ax = plt.subplots(figsize=FIGSIZE)
     plot = sns.boxplot(
-        data = data,
+        data = delays,
         orient = "h",
         ax=ax
     )
@@ -1,13 +1,156 @@
+#include <util/crc16.h>
+
 // These pin numbers depend on which pins you use for your circuit
 int sensorPin = A0;
 int ledPin = 10;
 
+// Binary frames shared with the host (see src/util/asg_protocol.hh):
+// sync, type, trial id, toggle time, edge time, ADC threshold, CRC-16.
+// All integers are little-endian.
+const uint8_t FRAME_SYNC = 0xA5;
+const uint8_t FRAME_SIZE = 18;
+const uint8_t TYPE_TOGGLE = 'G';
+const uint8_t TYPE_RESULT = 'R';
+const uint8_t TYPE_WAVEFORM = 'W';
+const uint8_t TYPE_PING = 'P';
+const uint8_t TYPE_PONG = 'O';
+
+const uint32_t FLAG_WAVEFORM = 1;
+
+// The ADC runs continuously (ADC clock 1 MHz, 13 cycles a conversion, so a
+// sample every 13 us instead of analogRead's ~112 us) into a ring of 8-bit
+// samples. After a toggle the interrupt watches for the threshold and, if
+// the host asked for the waveform, keeps going for WAVE_POST more samples
+// before freezing the ring, so the host gets the whole edge.
+const uint16_t WAVE_SAMPLES = 512; // a power of two
+const uint16_t WAVE_POST = 384;
+
+enum { ADC_IDLE, ADC_ARMED, ADC_POST, ADC_DONE };
+
+volatile uint8_t samples[WAVE_SAMPLES];
+volatile uint32_t sampleIndex = 0; // total samples taken
+volatile uint32_t edgeIndex = 0;   // the first sample over the threshold
+volatile uint16_t postLeft = 0;
+volatile uint8_t adcState = ADC_IDLE;
+volatile uint8_t threshold8 = 128;
+
+uint8_t rxFrame[FRAME_SIZE];
+uint8_t rxFill = 0;
+
 void setup()
 {
-    // Use a 115200 baud rate
-    Serial.begin(115200);
+    // 1 Mbaud divides the Uno's 16 MHz clock exactly (as does 2 Mbaud)
+    Serial.begin(1000000);
     pinMode(ledPin, OUTPUT);
     pinMode(sensorPin, INPUT);
+
+    // AVcc reference, left-adjusted result (8 bits in ADCH), channel A0;
+    // free running, interrupt per conversion, clock prescaler 16
+    ADMUX = _BV(REFS0) | _BV(ADLAR) | ((sensorPin - A0) & 0x07);
+    ADCSRB = 0;
+    DIDR0 = _BV(sensorPin - A0);
+    ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2);
+}
+
+ISR(ADC_vect)
+{
+    if (adcState == ADC_DONE) {
+        return; // frozen until the main loop has reported
+    }
+
+    uint8_t value = ADCH;
+    samples[sampleIndex & (WAVE_SAMPLES - 1)] = value;
+    sampleIndex++;
+
+    if (adcState == ADC_ARMED) {
+        // Rising edge trigger condition
+        if (value > threshold8) {
+            edgeIndex = sampleIndex - 1;
+            adcState = postLeft ? ADC_POST : ADC_DONE;
+        }
+    } else if (adcState == ADC_POST && --postLeft == 0) {
+        adcState = ADC_DONE;
+    }
+}
+
+uint16_t frameCrc(const uint8_t* frame)
+{
+    uint16_t crc = 0xFFFF;
+    for (uint8_t i = 1; i < FRAME_SIZE - 2; i++) {
+        crc = _crc_ccitt_update(crc, frame[i]);
+    }
+    return crc;
+}
+
+uint32_t getU32(const uint8_t* in)
+{
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+void putU32(uint8_t* out, uint32_t value)
+{
+    for (uint8_t i = 0; i < 4; i++) {
+        out[i] = value >> (8 * i);
+    }
+}
+
+// Feed one received byte; returns true when rxFrame holds a valid frame
+bool receiveByte(uint8_t byte)
+{
+    if (rxFill == 0 && byte != FRAME_SYNC) {
+        return false;
+    }
+
+    rxFrame[rxFill++] = byte;
+    if (rxFill < FRAME_SIZE) {
+        return false;
+    }
+
+    uint16_t crc = rxFrame[16] | (rxFrame[17] << 8);
+    if (frameCrc(rxFrame) == crc) {
+        rxFill = 0;
+        return true;
+    }
+
+    // Bad frame: resynchronize on the next sync byte we already have
+    uint8_t next = 1;
+    while (next < FRAME_SIZE && rxFrame[next] != FRAME_SYNC) {
+        next++;
+    }
+    rxFill = FRAME_SIZE - next;
+    memmove(rxFrame, rxFrame + next, rxFill);
+    return false;
+}
+
+void sendFrame(uint8_t type, uint32_t trial, uint32_t ts1, uint32_t ts2, uint16_t threshold)
+{
+    uint8_t frame[FRAME_SIZE];
+    frame[0] = FRAME_SYNC;
+    frame[1] = type;
+    putU32(frame + 2, trial);
+    putU32(frame + 6, ts1);
+    putU32(frame + 10, ts2);
+    frame[14] = threshold;
+    frame[15] = threshold >> 8;
+    uint16_t crc = frameCrc(frame);
+    frame[16] = crc;
+    frame[17] = crc >> 8;
+    Serial.write(frame, FRAME_SIZE);
+}
+
+// The waveform header, the last WAVE_SAMPLES samples in order, and their CRC
+void sendWaveform(uint32_t trial, uint32_t firstUs, uint32_t lastUs, uint32_t end)
+{
+    sendFrame(TYPE_WAVEFORM, trial, firstUs, lastUs, WAVE_SAMPLES);
+
+    uint16_t crc = 0xFFFF;
+    for (uint32_t i = end - WAVE_SAMPLES; i != end; i++) {
+        uint8_t value = samples[i & (WAVE_SAMPLES - 1)];
+        crc = _crc_ccitt_update(crc, value);
+        Serial.write(value);
+    }
+    Serial.write((uint8_t)crc);
+    Serial.write((uint8_t)(crc >> 8));
 }
 
 void loop()
@@ -15,41 +158,71 @@ void loop()
     static uint32_t ts1 = 0;
     static uint32_t ts2 = 0;
     static int state = 0;
-    static int sensorValue = 0;
-    int cmd = 0;
+    static uint32_t trial = 0;
+    static uint16_t threshold = 512;
+    static uint32_t toggleIndex = 0;
+    static bool waveform = false;
 
     switch (state) {
         case 0:
             digitalWrite(ledPin, HIGH);
 
-            // poll for new command
-            if (Serial.available() > 0) {
-                cmd = Serial.read();
+            // poll for a command from the host PC
+            while (Serial.available() > 0) {
+                if (!receiveByte(Serial.read())) {
+                    continue;
+                }
+
+                // Clock sync: report when the ping arrived and when the pong left
+                if (rxFrame[1] == TYPE_PING) {
+                    uint32_t received = micros();
+                    sendFrame(TYPE_PONG, getU32(rxFrame + 2), received, micros(), 0);
+                    continue;
+                }
+
+                if (rxFrame[1] == TYPE_TOGGLE) {
+                    trial = getU32(rxFrame + 2);
+                    threshold = rxFrame[14] | (rxFrame[15] << 8);
+                    waveform = getU32(rxFrame + 10) & FLAG_WAVEFORM;
 
-                // command from the host PC is hard-coded as the character 'g'
-                if (cmd == 'g') {
-                    // Start timer
+                    // Start timer and arm the sampler, noting which sample goes with ts1
+                    noInterrupts();
+                    toggleIndex = sampleIndex;
                     ts1 = micros();
+                    threshold8 = threshold >> 2;
+                    postLeft = waveform ? WAVE_POST : 0;
+                    adcState = ADC_ARMED;
+                    interrupts();
 
                     // Move to next state
                     state = 1;
+                    break;
                 }
             }
             break;
 
         case 1:
             digitalWrite(ledPin, LOW);
-            sensorValue = analogRead(sensorPin);
 
-            // Rising edge trigger condition
-            if (sensorValue > 512) {
-                // Log time difference and send back to host PC
-                ts2 = micros();
-                Serial.println(ts2 - ts1);
+            if (adcState == ADC_DONE) {
+                // Sample times from the samples counted since the toggle
+                uint32_t ts3 = micros();
+                uint32_t end = sampleIndex;
+                float period = (float)(ts3 - ts1) / (end - toggleIndex);
+                ts2 = ts1 + (int32_t)((int32_t)(edgeIndex - toggleIndex) * period);
+
+                if (waveform) {
+                    uint32_t lastUs = ts1 + (int32_t)((int32_t)(end - 1 - toggleIndex) * period);
+                    uint32_t firstUs = lastUs - (uint32_t)((WAVE_SAMPLES - 1) * period);
+                    sendWaveform(trial, firstUs, lastUs, end);
+                }
+
+                // Send both timestamps back to host PC, tagged with the trial
+                sendFrame(TYPE_RESULT, trial, ts1, ts2, threshold);
 
-                // Reset state
+                // Reset state, letting the sampler run again
+                adcState = ADC_IDLE;
                 state = 0;
-                sensorValue = 0;
             }
             break;
     }
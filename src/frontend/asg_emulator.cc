@@ -0,0 +1,369 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "asg_protocol.hh"
+#include "edge_fit.hh"
+#include "threads.hh"
+
+#define ADC_PERIOD_US 13.0 /* the firmware's free-running ADC: 16 MHz / 16 / 13 cycles */
+#define WAVE_SAMPLES 512   /* samples in a waveform, as in the firmware */
+#define WAVE_POST 384      /* of which this many follow the threshold crossing */
+#define PWM_DEPTH 0.3      /* fraction of the step lost while the backlight PWM is off */
+
+using namespace std;
+using namespace std::chrono;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop( int )
+{
+  stop_requested = 1;
+}
+
+/* how long the emulated display takes to light the photodiode */
+class LatencyDistribution
+{
+  enum class Kind
+  {
+    Fixed,
+    Uniform,
+    Normal,
+  };
+
+  Kind kind_;
+  double a_ms_, b_ms_;
+
+public:
+  /* "fixed:MS", "uniform:LO,HI" or "normal:MEAN,SD" */
+  explicit LatencyDistribution( const string& spec )
+    : kind_( Kind::Fixed )
+    , a_ms_( 0 )
+    , b_ms_( 0 )
+  {
+    const size_t colon = spec.find( ':' );
+    const string name = spec.substr( 0, colon );
+    const string params = colon == string::npos ? "" : spec.substr( colon + 1 );
+    const size_t comma = params.find( ',' );
+
+    try {
+      a_ms_ = stod( params.substr( 0, comma ) );
+      b_ms_ = comma == string::npos ? 0 : stod( params.substr( comma + 1 ) );
+    } catch ( const exception& ) {
+      throw runtime_error( "bad latency distribution \"" + spec + "\"" );
+    }
+
+    if ( name == "fixed" ) {
+      kind_ = Kind::Fixed;
+    } else if ( name == "uniform" and comma != string::npos and b_ms_ >= a_ms_ ) {
+      kind_ = Kind::Uniform;
+    } else if ( name == "normal" and comma != string::npos ) {
+      kind_ = Kind::Normal;
+    } else {
+      throw runtime_error( "bad latency distribution \"" + spec + "\"" );
+    }
+  }
+
+  microseconds sample( mt19937_64& rng ) const
+  {
+    double ms = a_ms_;
+    switch ( kind_ ) {
+      case Kind::Fixed:
+        break;
+      case Kind::Uniform:
+        ms = uniform_real_distribution<double>( a_ms_, b_ms_ )( rng );
+        break;
+      case Kind::Normal:
+        ms = normal_distribution<double>( a_ms_, b_ms_ )( rng );
+        break;
+    }
+    return microseconds( lround( max( ms, 0.0 ) * 1000 ) );
+  }
+};
+
+struct EmulatorConfig
+{
+  string link {};
+  string latency = "normal:7,1";
+  double drop_probability = 0;
+  double skew_ppm = 0;
+  double rise_us = 1000;
+  double pwm_hz = 0;
+  uint64_t seed = 1;
+  int cpu = -1;
+};
+
+/* a result frame (and its encoded waveform, if one was asked for) waiting
+   for its emulated photodiode edge */
+struct PendingReply
+{
+  AsgFrame frame;
+  steady_clock::time_point due;
+  vector<uint8_t> waveform;
+};
+
+void usage( const char* argv0 )
+{
+  cerr << "Usage: " << argv0 << " [options]\n"
+       << "  -l, --link=PATH      also make the pseudo-terminal available as PATH (a symlink)\n"
+       << "  -d, --latency=DIST   fixed:MS, uniform:LO,HI or normal:MEAN,SD (default normal:7,1)\n"
+       << "  -D, --drop=P         probability that a request is never answered\n"
+       << "  -r, --rise=US        10-90% rise time of the emulated photodiode waveform (default 1000)\n"
+       << "  -w, --pwm=HZ         backlight PWM frequency to modulate the waveform with (default none)\n"
+       << "  -k, --skew=PPM       run the emulated micros() clock fast (or slow, if negative)\n"
+       << "  -s, --seed=N         random seed for latencies and drops\n"
+       << "  -c, --cpu=N          pin the emulator to CPU N\n";
+}
+
+int main( int argc, char* argv[] )
+{
+  EmulatorConfig config;
+
+  const option long_options[] = { { "link", required_argument, nullptr, 'l' },
+                                  { "latency", required_argument, nullptr, 'd' },
+                                  { "drop", required_argument, nullptr, 'D' },
+                                  { "skew", required_argument, nullptr, 'k' },
+                                  { "rise", required_argument, nullptr, 'r' },
+                                  { "pwm", required_argument, nullptr, 'w' },
+                                  { "seed", required_argument, nullptr, 's' },
+                                  { "cpu", required_argument, nullptr, 'c' },
+                                  { "help", no_argument, nullptr, 'h' },
+                                  { nullptr, 0, nullptr, 0 } };
+
+  while ( true ) {
+    const int opt = getopt_long( argc, argv, "l:d:D:k:r:w:s:c:h", long_options, nullptr );
+    if ( opt == -1 ) {
+      break;
+    }
+
+    switch ( opt ) {
+      case 'l':
+        config.link = optarg;
+        break;
+      case 'd':
+        config.latency = optarg;
+        break;
+      case 'D':
+        config.drop_probability = stod( optarg );
+        break;
+      case 'k':
+        config.skew_ppm = stod( optarg );
+        break;
+      case 'r':
+        config.rise_us = stod( optarg );
+        break;
+      case 'w':
+        config.pwm_hz = stod( optarg );
+        break;
+      case 's':
+        config.seed = stoull( optarg );
+        break;
+      case 'c':
+        config.cpu = stoi( optarg );
+        break;
+      default:
+        usage( argv[0] );
+        return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  const LatencyDistribution latency( config.latency );
+  mt19937_64 rng( config.seed );
+  bernoulli_distribution drop( config.drop_probability );
+  uniform_real_distribution<double> phase( 0, 1 );
+
+  PhotodiodeModel photodiode;
+  photodiode.rise = config.rise_us / ADC_PERIOD_US;
+  photodiode.pwm_period = config.pwm_hz > 0 ? 1e6 / config.pwm_hz / ADC_PERIOD_US : 0;
+  photodiode.pwm_depth = config.pwm_hz > 0 ? PWM_DEPTH : 0;
+
+  pin_this_thread( config.cpu );
+
+  const int master = posix_openpt( O_RDWR | O_NOCTTY | O_NONBLOCK );
+  if ( master < 0 or grantpt( master ) < 0 or unlockpt( master ) < 0 ) {
+    perror( "posix_openpt" );
+    return EXIT_FAILURE;
+  }
+  const string slave_path = ptsname( master );
+
+  /* Hold the slave open so the pty survives the host closing and reopening
+     it between runs, and start it in raw mode. */
+  const int slave = open( slave_path.c_str(), O_RDWR | O_NOCTTY );
+  termios tty;
+  if ( slave < 0 or tcgetattr( slave, &tty ) < 0 ) {
+    perror( slave_path.c_str() );
+    return EXIT_FAILURE;
+  }
+  cfmakeraw( &tty );
+  tcsetattr( slave, TCSANOW, &tty );
+
+  if ( not config.link.empty() ) {
+    struct stat existing;
+    if ( lstat( config.link.c_str(), &existing ) == 0 and S_ISLNK( existing.st_mode ) ) {
+      unlink( config.link.c_str() );
+    }
+    if ( symlink( slave_path.c_str(), config.link.c_str() ) < 0 ) {
+      perror( config.link.c_str() );
+      return EXIT_FAILURE;
+    }
+  }
+
+  signal( SIGINT, request_stop );
+  signal( SIGTERM, request_stop );
+
+  printf( "ASG emulator on %s%s%s, latency %s, drop probability %g, clock skew %g ppm\n",
+          slave_path.c_str(),
+          config.link.empty() ? "" : " -> ",
+          config.link.c_str(),
+          config.latency.c_str(),
+          config.drop_probability,
+          config.skew_ppm );
+  fflush( stdout );
+
+  /* the firmware's micros(), which wraps and drifts like a real oscillator */
+  const auto epoch = steady_clock::now();
+  const double rate = 1.0 + config.skew_ppm / 1e6;
+  const auto micros = [&]( const steady_clock::time_point t ) {
+    return static_cast<uint32_t>( llround( duration_cast<nanoseconds>( t - epoch ).count() * rate / 1000 ) );
+  };
+
+  AsgDecoder decoder;
+  deque<PendingReply> pending;
+  auto busy_until = epoch; /* like the firmware, one measurement at a time */
+  uint64_t requests = 0, replies = 0, dropped = 0, pings = 0;
+
+  while ( not stop_requested ) {
+    /* sleep until a request arrives or the next reply is due */
+    timespec timeout { 0, 100000000 };
+    if ( not pending.empty() ) {
+      const auto wait = max( nanoseconds( 0 ), pending.front().due - steady_clock::now() );
+      timeout.tv_sec = wait.count() / 1000000000;
+      timeout.tv_nsec = wait.count() % 1000000000;
+    }
+
+    pollfd pfd { master, POLLIN, 0 };
+    if ( ppoll( &pfd, 1, &timeout, nullptr ) < 0 and errno != EINTR ) {
+      perror( "ppoll" );
+      break;
+    }
+
+    const ssize_t length = read( master, decoder.write_ptr(), decoder.writable() );
+    decoder.commit( max<ssize_t>( length, 0 ) );
+    const auto now = steady_clock::now();
+    AsgFrame request;
+
+    while ( decoder.next( request ) ) {
+      if ( request.type == AsgFrameType::Ping ) {
+        /* the firmware only answers pings between measurements */
+        const auto received = max( now, busy_until );
+        AsgFrame pong = request;
+        pong.type = AsgFrameType::Pong;
+        pong.toggle_us = micros( received );
+        pong.edge_us = micros( received );
+        pending.push_back( { pong, received, {} } );
+        pings++;
+        continue;
+      }
+
+      if ( request.type != AsgFrameType::Toggle ) {
+        continue;
+      }
+
+      requests++;
+      if ( drop( rng ) ) {
+        dropped++;
+        continue;
+      }
+
+      const auto toggle = max( now, busy_until );
+      const auto edge = toggle + latency.sample( rng );
+
+      AsgFrame reply = request;
+      reply.type = AsgFrameType::Result;
+      reply.toggle_us = micros( toggle );
+      reply.edge_us = micros( edge );
+
+      if ( not( request.edge_us & ASG_FLAG_WAVEFORM ) ) {
+        busy_until = edge;
+        pending.push_back( { reply, edge, {} } );
+        continue;
+      }
+
+      /* Like the firmware: sample continuously, stop WAVE_POST samples after
+         the first one over the threshold, and send the last WAVE_SAMPLES. */
+      uint8_t trace[2 * WAVE_SAMPLES];
+      const double true_edge = WAVE_SAMPLES + phase( rng );
+      synthesize_edge( photodiode, true_edge, trace, sizeof( trace ), rng );
+      const auto sample_time = [&]( const size_t i ) {
+        return edge + nanoseconds( llround( ( i - true_edge ) * ADC_PERIOD_US * 1000 ) );
+      };
+
+      const uint8_t threshold = request.threshold >> 2; /* 10-bit threshold, 8-bit samples */
+      const uint8_t* crossing
+        = find_if( trace, trace + sizeof( trace ), [&]( const uint8_t v ) { return v > threshold; } );
+      if ( crossing == trace + sizeof( trace ) ) {
+        dropped++; /* the firmware would still be waiting for an edge */
+        continue;
+      }
+
+      const size_t last = min<size_t>( crossing - trace + WAVE_POST, sizeof( trace ) - 1 );
+      const size_t first = last + 1 - WAVE_SAMPLES;
+      reply.edge_us = micros( sample_time( crossing - trace ) );
+
+      AsgFrame header = reply;
+      header.toggle_us = micros( sample_time( first ) );
+      header.edge_us = micros( sample_time( last ) );
+      header.threshold = WAVE_SAMPLES;
+      vector<uint8_t> waveform( asg_waveform_size( WAVE_SAMPLES ) );
+      asg_encode_waveform( header, trace + first, waveform.data() );
+
+      busy_until = sample_time( last );
+      pending.push_back( { reply, busy_until, move( waveform ) } );
+    }
+
+    while ( not pending.empty() and pending.front().due <= steady_clock::now() ) {
+      /* the waveform goes first, so the host has it when the result arrives */
+      vector<uint8_t>& out = pending.front().waveform;
+      out.resize( out.size() + ASG_FRAME_SIZE );
+      asg_encode( pending.front().frame, out.data() + out.size() - ASG_FRAME_SIZE );
+      if ( write( master, out.data(), out.size() ) < 0 and errno != EAGAIN ) {
+        perror( "write" );
+        stop_requested = 1;
+      }
+      replies += pending.front().frame.type == AsgFrameType::Result;
+      pending.pop_front();
+    }
+  }
+
+  printf( "%llu requests, %llu pings, %llu replies, %llu dropped, %llu corrupt frames, %llu bytes skipped\n",
+          static_cast<unsigned long long>( requests ),
+          static_cast<unsigned long long>( pings ),
+          static_cast<unsigned long long>( replies ),
+          static_cast<unsigned long long>( dropped ),
+          static_cast<unsigned long long>( decoder.corrupt() ),
+          static_cast<unsigned long long>( decoder.skipped() ) );
+
+  if ( not config.link.empty() ) {
+    unlink( config.link.c_str() );
+  }
+  close( slave );
+  close( master );
+  return EXIT_SUCCESS;
+}
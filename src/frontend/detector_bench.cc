@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "gaze_source.hh"
+#include "hdr_histogram.hh"
+#include "saccade_detector.hh"
+
+#define DIFF_THRESH 25  /* Abs diff the original trigger needed on both axes */
+#define NUM_SACCADES 2000
+#define SACCADE_INTERVAL_MS 200
+#define MATCH_WINDOW_US 100000 /* detections later than this after an onset are false positives */
+#define REPETITIONS 5
+
+using namespace std;
+using namespace std::chrono;
+
+/* The trigger condition from the original trial loop, re-armed after each detection */
+class DiffThresholdDetector
+{
+  GazeSample reference_ {};
+  bool have_reference_ = false;
+
+public:
+  bool add( const GazeSample& sample )
+  {
+    if ( !sample.valid() ) {
+      return false;
+    }
+
+    if ( !have_reference_ ) {
+      reference_ = sample;
+      have_reference_ = true;
+      return false;
+    }
+
+    if ( abs( reference_.x - sample.x ) >= DIFF_THRESH && abs( reference_.y - sample.y ) >= DIFF_THRESH ) {
+      reference_ = sample;
+      return true;
+    }
+    return false;
+  }
+};
+
+struct Scenario
+{
+  string name;
+  unsigned int rate_hz;
+  float noise_px;
+  float dx, dy;
+  milliseconds duration;
+};
+
+void run_detector( const string& name,
+                   const vector<GazeSample>& samples,
+                   const SyntheticGazeSource& source,
+                   const function<bool( const GazeSample& )>& add )
+{
+  /* time the detector over the whole stream, keeping the best repetition */
+  vector<uint64_t> detections;
+  double best_ns = INFINITY;
+
+  for ( unsigned int rep = 0; rep < REPETITIONS; rep++ ) {
+    detections.clear();
+    const auto start = steady_clock::now();
+    for ( const auto& sample : samples ) {
+      if ( add( sample ) ) {
+        detections.push_back( sample.tracker_time_us );
+      }
+    }
+    const auto elapsed = duration_cast<nanoseconds>( steady_clock::now() - start ).count();
+    best_ns = min( best_ns, double( elapsed ) / samples.size() );
+  }
+
+  /* match detections to ground-truth onsets */
+  vector<bool> hit( NUM_SACCADES, false );
+  HdrHistogram lags; /* us */
+  unsigned int false_positives = 0;
+
+  const auto& onsets = source.config().saccade_onsets;
+
+  for ( const auto t : detections ) {
+    /* the latest onset at or before the detection */
+    const auto after = upper_bound( onsets.begin(), onsets.end(), microseconds( t ) );
+    if ( after == onsets.begin() ) {
+      false_positives++;
+      continue;
+    }
+
+    const size_t n = after - onsets.begin() - 1;
+    const uint64_t onset = source.onset_time_us( n );
+    if ( t - onset < MATCH_WINDOW_US && !hit[n] ) {
+      hit[n] = true;
+      lags.add( t - onset );
+    } else {
+      false_positives++;
+    }
+  }
+
+  const auto ms = [&]( const uint64_t us ) { return lags.count() ? us / 1e3 : NAN; };
+
+  printf( "  %-22s %8.1f ns/sample  lag p50 %6.2f ms  p95 %6.2f ms  max %6.2f ms  missed %4zu  false %4u\n",
+          name.c_str(),
+          best_ns,
+          ms( lags.percentile( 0.5 ) ),
+          ms( lags.percentile( 0.95 ) ),
+          ms( lags.max() ),
+          size_t( NUM_SACCADES - lags.count() ),
+          false_positives );
+}
+
+int main()
+{
+  const vector<Scenario> scenarios = {
+    { "step, diagonal", 1000, 0.5, 100, 100, milliseconds( 0 ) },
+    { "step, horizontal", 1000, 0.5, 100, 0, milliseconds( 0 ) },
+    { "ramp 30ms, diagonal", 500, 0.5, 200, 200, milliseconds( 30 ) },
+    { "ramp 30ms, diagonal", 1000, 0.5, 200, 200, milliseconds( 30 ) },
+    { "ramp 30ms, diagonal", 2000, 0.5, 200, 200, milliseconds( 30 ) },
+    { "ramp 30ms, horizontal", 2000, 0.5, 300, 0, milliseconds( 30 ) },
+    { "ramp 30ms, noisy", 500, 2.0, 200, 200, milliseconds( 30 ) },
+    { "ramp 30ms, noisy", 1000, 2.0, 200, 200, milliseconds( 30 ) },
+    { "ramp 30ms, noisy", 2000, 2.0, 200, 200, milliseconds( 30 ) },
+  };
+
+  for ( const auto& scenario : scenarios ) {
+    SyntheticGazeConfig config;
+    config.rate_hz = scenario.rate_hz;
+    config.noise_px = scenario.noise_px;
+    config.saccade_dx = scenario.dx;
+    config.saccade_dy = scenario.dy;
+    config.saccade_duration = scenario.duration;
+    config.saccade_onsets.clear();
+    for ( unsigned int n = 0; n < NUM_SACCADES; n++ ) {
+      /* stagger onsets so they don't always line up with a sample */
+      config.saccade_onsets.push_back( milliseconds( SACCADE_INTERVAL_MS * ( n + 1 ) ) + microseconds( 137 * n % 1000 ) );
+    }
+
+    SyntheticGazeSource source( config );
+    vector<GazeSample> samples;
+    const uint64_t count = uint64_t( SACCADE_INTERVAL_MS ) * ( NUM_SACCADES + 1 ) * scenario.rate_hz / 1000;
+    samples.reserve( count );
+    for ( uint64_t i = 0; i < count; i++ ) {
+      GazeSample sample;
+      if ( source.sample_at( i, sample ) ) {
+        samples.push_back( sample );
+      }
+    }
+
+    printf( "%s @ %u Hz, noise %.2f px (%zu samples, %d saccades)\n",
+            scenario.name.c_str(),
+            scenario.rate_hz,
+            scenario.noise_px,
+            samples.size(),
+            NUM_SACCADES );
+
+    DiffThresholdDetector diff;
+    run_detector( "diff threshold", samples, source, [&]( const GazeSample& s ) { return diff.add( s ); } );
+
+    SaccadeDetectorConfig velocity_config;
+    velocity_config.rate_hz = scenario.rate_hz;
+    SaccadeDetector velocity( velocity_config );
+    run_detector( "velocity", samples, source, [&]( const GazeSample& s ) { return velocity.add( s ); } );
+
+    velocity_config.extrapolate = true;
+    SaccadeDetector extrapolating( velocity_config );
+    run_detector(
+      "velocity + extrapolate", samples, source, [&]( const GazeSample& s ) { return extrapolating.add( s ); } );
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+#include "display.hh"
+#include "frame_cache.hh"
+#include "hdr_histogram.hh"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define BOX_DIM 100
+
+using namespace std;
+using namespace std::chrono;
+
+/* time each of `count` draws, as the renderer's drawing_delay does */
+void measure( const string& name, const unsigned int count, const function<void( unsigned int )>& draw )
+{
+  HdrHistogram delays; /* ns */
+
+  for ( unsigned int i = 0; i < count; i++ ) {
+    const auto t1 = steady_clock::now();
+    draw( i );
+    const auto t2 = steady_clock::now();
+    delays.add( duration_cast<nanoseconds>( t2 - t1 ).count() );
+  }
+
+  printf( "  %-20s mean %8.1f  sd %7.1f  p50 %8.1f  p99 %8.1f  max %8.1f us\n",
+          name.c_str(),
+          delays.mean() / 1e3,
+          delays.stddev() / 1e3,
+          delays.percentile( 0.5 ) / 1e3,
+          delays.percentile( 0.99 ) / 1e3,
+          delays.max() / 1e3 );
+}
+
+/* mean of each stage over the frames recorded since the last call */
+void report_stages( VideoDisplay& display )
+{
+  double submit = 0, swap = 0, finish = 0, complete = 0, gpu_draw = 0, gpu_to_swap = 0;
+  unsigned int frames = 0, completed_frames = 0, gpu_frames = 0;
+
+  FrameTiming timing;
+  while ( display.timer().timings().pop( timing ) ) {
+    frames++;
+    submit += timing.cpu_submit().count();
+    swap += timing.cpu_swap().count();
+    finish += timing.cpu_finish().count();
+    if ( timing.completion_valid() ) {
+      completed_frames++;
+      complete += timing.cpu_complete().count();
+    }
+    if ( timing.gpu_valid() ) {
+      gpu_frames++;
+      gpu_draw += timing.gpu_draw().count();
+      gpu_to_swap += timing.gpu_to_swap().count();
+    }
+  }
+
+  if ( frames == 0 ) {
+    return;
+  }
+
+  printf( "  %-20s submit %7.1f  swap %7.1f  finish %7.1f",
+          "",
+          submit / frames / 1000,
+          swap / frames / 1000,
+          finish / frames / 1000 );
+  if ( completed_frames ) {
+    printf( "  complete %7.1f", complete / completed_frames / 1000 );
+  }
+  if ( gpu_frames ) {
+    printf( "  | GPU draw %7.1f  draw->swap %7.1f", gpu_draw / gpu_frames / 1000, gpu_to_swap / gpu_frames / 1000 );
+  }
+  printf( " us\n" );
+}
+
+int main( int argc, char* argv[] )
+{
+  if ( argc > 3 ) {
+    fprintf( stderr, "Usage: %s [draws per path] [fullscreen (0/1)]\n", argv[0] );
+    return EXIT_FAILURE;
+  }
+
+  const unsigned int count = argc > 1 ? stoul( argv[1] ) : 2000;
+  const bool fullscreen = argc > 2 ? stoi( argv[2] ) : false;
+
+  VideoDisplay display { WIDTH, HEIGHT, fullscreen };
+  display.window().set_swap_interval( 0 );
+
+  const LumaRect box_on { 0, 0, BOX_DIM, BOX_DIM, 235 }, box_off { 0, 0, BOX_DIM, BOX_DIM, 16 };
+  const FramePattern white { WIDTH, HEIGHT, 16, { box_on } };
+  const FramePattern black { WIDTH, HEIGHT, 16, { box_off } };
+
+  FrameCache frames;
+  Texture420& white_texture = frames.texture( white );
+  Texture420& black_texture = frames.texture( black );
+
+  /* warm up both paths */
+  for ( unsigned int i = 0; i < 8; i++ ) {
+    display.draw( i % 2 ? white_texture : black_texture );
+    display.draw( i % 2 ? white : black );
+  }
+
+  printf( "Toggling a %dx%d square, %u draws per path (swap interval 0, glFinish after swap):\n",
+          BOX_DIM,
+          BOX_DIM,
+          count );
+
+  report_stages( display ); /* discard the warm-up frames */
+
+  measure( "draw( Texture420 )", count, [&]( const unsigned int i ) {
+    display.draw( i % 2 ? white_texture : black_texture );
+  } );
+  report_stages( display );
+
+  measure( "draw( FramePattern )", count, [&]( const unsigned int i ) { display.draw( i % 2 ? white : black ); } );
+  report_stages( display );
+
+  printf( "Throughput of draw( FramePattern ) by sync mode (times after swap are to GPU completion):\n" );
+  for ( const auto mode : { SyncMode::Finish, SyncMode::Fence, SyncMode::None } ) {
+    display.set_sync_mode( mode );
+    const auto start = steady_clock::now();
+    for ( unsigned int i = 0; i < count; i++ ) {
+      display.draw( i % 2 ? white : black );
+    }
+    display.wait_idle();
+    const double elapsed = duration<double>( steady_clock::now() - start ).count();
+    printf( "  %-20s %8.1f frames/s\n", sync_mode_name( mode ).c_str(), count / elapsed );
+    report_stages( display );
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "asg_protocol.hh"
+#include "edge_fit.hh"
+
+#define TRIALS 2000
+#define LEGACY_PERIOD_US 112 /* analogRead() at the default ADC prescaler */
+#define FAST_PERIOD_US 13    /* the firmware's free-running ADC */
+#define WAVE_SAMPLES 512
+#define WAVE_POST 384
+#define THRESHOLD 128       /* 8-bit equivalent of the default 10-bit threshold, 512 */
+#define TRACE_US 16384      /* each trial's photodiode trace, at 1 us resolution */
+#define EDGE_US 8192        /* where its 50% point lies (plus a random fraction) */
+#define DECODE_FRAMES 20000 /* waveform frames for the decoder benchmark */
+#define DECODE_CHUNK 4096
+
+using namespace std;
+using namespace std::chrono;
+
+struct Scenario
+{
+  string name;
+  double rise_us;
+  double pwm_hz;
+  double noise;
+};
+
+struct Errors
+{
+  vector<double> errors {};
+  unsigned int misses = 0;
+
+  void print( const char* method ) const
+  {
+    if ( errors.empty() ) {
+      printf( "  %-22s no edges found\n", method );
+      return;
+    }
+
+    double sum = 0, sum_squares = 0, worst = 0;
+    for ( const double e : errors ) {
+      sum += e;
+      sum_squares += e * e;
+      worst = max( worst, abs( e ) );
+    }
+    const double mean = sum / errors.size();
+    const double sd = sqrt( max( 0.0, sum_squares / errors.size() - mean * mean ) );
+    printf( "  %-22s bias %8.1f us  jitter (sd) %6.1f us  worst %8.1f us  misses %u\n",
+            method,
+            mean,
+            sd,
+            worst,
+            misses );
+  }
+};
+
+/* the first sample over the threshold, taking one sample every `period` us
+   starting at `phase` */
+static int first_crossing( const vector<uint8_t>& trace, const double phase, const double period )
+{
+  for ( double t = phase; t < trace.size(); t += period ) {
+    if ( trace[size_t( t )] > THRESHOLD ) {
+      return int( t );
+    }
+  }
+  return -1;
+}
+
+static void run_scenario( const Scenario& scenario, mt19937_64& rng )
+{
+  PhotodiodeModel model;
+  model.rise = scenario.rise_us;
+  model.pwm_period = scenario.pwm_hz > 0 ? 1e6 / scenario.pwm_hz : 0;
+  model.pwm_depth = scenario.pwm_hz > 0 ? 0.3 : 0;
+  model.noise = scenario.noise;
+
+  uniform_real_distribution<double> fraction( 0, 1 );
+  vector<uint8_t> trace( TRACE_US );
+  uint8_t window[WAVE_SAMPLES];
+  Errors legacy, fast, fitted;
+  vector<double> rises;
+
+  for ( unsigned int trial = 0; trial < TRIALS; trial++ ) {
+    const double edge = EDGE_US + fraction( rng );
+    synthesize_edge( model, edge, trace.data(), trace.size(), rng );
+
+    /* The old firmware: analogRead() in a loop, micros() once the
+       conversion that crossed the threshold had finished */
+    const int legacy_sample = first_crossing( trace, fraction( rng ) * LEGACY_PERIOD_US, LEGACY_PERIOD_US );
+    if ( legacy_sample < 0 ) {
+      legacy.misses++;
+    } else {
+      legacy.errors.push_back( legacy_sample + LEGACY_PERIOD_US - edge );
+    }
+
+    /* The free-running ADC: the time of the first sample over the threshold */
+    const double phase = fraction( rng ) * FAST_PERIOD_US;
+    const int fast_sample = first_crossing( trace, phase, FAST_PERIOD_US );
+    if ( fast_sample < 0 ) {
+      fast.misses++;
+      fitted.misses++;
+      continue;
+    }
+    fast.errors.push_back( fast_sample - edge );
+
+    /* ... and the 50% point fitted in the waveform around it */
+    const double crossing_index = ( fast_sample - phase ) / FAST_PERIOD_US;
+    const double first_index = crossing_index + WAVE_POST + 1 - WAVE_SAMPLES;
+    for ( size_t i = 0; i < WAVE_SAMPLES; i++ ) {
+      const double t = phase + ( first_index + i ) * FAST_PERIOD_US;
+      window[i] = t >= 0 and t < trace.size() ? trace[size_t( t )] : trace.back();
+    }
+    const EdgeFit fit = fit_edge( window, WAVE_SAMPLES );
+    if ( not fit.valid ) {
+      fitted.misses++;
+      continue;
+    }
+    fitted.errors.push_back( phase + ( first_index + fit.edge ) * FAST_PERIOD_US - edge );
+    rises.push_back( fit.rise() * FAST_PERIOD_US );
+  }
+
+  sort( rises.begin(), rises.end() );
+  printf( "%s: 10-90%% rise %.0f us, PWM %.0f Hz, noise %.1f levels\n",
+          scenario.name.c_str(),
+          scenario.rise_us,
+          scenario.pwm_hz,
+          scenario.noise );
+  legacy.print( "analogRead (112 us)" );
+  fast.print( "free-running (13 us)" );
+  fitted.print( "fitted 50% point" );
+  if ( not rises.empty() ) {
+    printf( "  %-22s median %.0f us\n", "fitted rise", rises[rises.size() / 2] );
+  }
+}
+
+/* how fast the host side parses waveform frames out of a byte stream */
+static void decoder_throughput( mt19937_64& rng )
+{
+  PhotodiodeModel model;
+  uint8_t samples[WAVE_SAMPLES];
+  synthesize_edge( model, WAVE_SAMPLES - WAVE_POST, samples, WAVE_SAMPLES, rng );
+
+  const size_t frame_size = asg_waveform_size( WAVE_SAMPLES ) + ASG_FRAME_SIZE;
+  vector<uint8_t> stream( DECODE_FRAMES * frame_size );
+  for ( unsigned int i = 0; i < DECODE_FRAMES; i++ ) {
+    AsgFrame header;
+    header.trial = i;
+    header.threshold = WAVE_SAMPLES;
+    uint8_t* out = stream.data() + i * frame_size;
+    asg_encode_waveform( header, samples, out );
+
+    AsgFrame result;
+    result.type = AsgFrameType::Result;
+    result.trial = i;
+    asg_encode( result, out + asg_waveform_size( WAVE_SAMPLES ) );
+  }
+
+  AsgDecoder decoder;
+  AsgFrame frame;
+  const uint8_t* payload = nullptr;
+  unsigned int waveforms = 0, results = 0;
+  uint64_t checksum = 0;
+
+  const auto start = steady_clock::now();
+  for ( size_t offset = 0; offset < stream.size(); offset += DECODE_CHUNK ) {
+    decoder.append( stream.data() + offset, min<size_t>( DECODE_CHUNK, stream.size() - offset ) );
+    while ( decoder.next( frame, &payload ) ) {
+      if ( frame.type == AsgFrameType::Waveform ) {
+        waveforms++;
+        checksum += payload[WAVE_SAMPLES - 1];
+      } else {
+        results++;
+      }
+    }
+  }
+  const double elapsed = duration<double>( steady_clock::now() - start ).count();
+
+  printf( "Decoder: %u waveforms and %u results in %.1f ms, %.0f MB/s (%.0f waveforms/s; %llu)\n",
+          waveforms,
+          results,
+          1e3 * elapsed,
+          stream.size() / elapsed / 1e6,
+          waveforms / elapsed,
+          static_cast<unsigned long long>( checksum ) );
+}
+
+int main()
+{
+  mt19937_64 rng( 1 );
+
+  /* Edge timing error against the true 50% point of the display's rise,
+     for the old polling firmware, the free-running ADC's threshold
+     crossing, and the fit to the waveform around it */
+  const vector<Scenario> scenarios = { { "Fast panel", 100, 0, 1 },
+                                       { "LCD, 1 ms rise", 1000, 0, 1 },
+                                       { "LCD, 1 ms rise, 2 kHz backlight PWM", 1000, 2000, 1 },
+                                       { "Slow LCD, 2 ms rise", 2000, 0, 1 },
+                                       { "Noisy photodiode, 1 ms rise", 1000, 0, 6 } };
+  for ( const auto& scenario : scenarios ) {
+    run_scenario( scenario, rng );
+  }
+
+  decoder_throughput( rng );
+  return 0;
+}
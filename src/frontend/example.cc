@@ -1,92 +1,126 @@
-#include <atomic>
+#include <algorithm>
+#include <cmath>
 #include <chrono>
 #include <cstring>
 #include <exception>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <memory>
 #include <thread>
+#include <utility>
+#include <vector>
 
-#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
 #include <stdio.h>
-#include <termios.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #include <core_expt.h>
 #include <eyelink.h>
 
-#include "display.hh"
+#include "edge_fit.hh"
+#include "eyelink_source.hh"
+#include "gaze_source.hh"
+#include "latency_stats.hh"
+#include "poller.hh"
+#include "record_log.hh"
+#include "saccade_detector.hh"
+#include "sample_acquisition.hh"
+#include "serial_channel.hh"
+#include "stimulus_renderer.hh"
+#include "threads.hh"
 
-#define BOX_DIM 100    /* Dimensions of the white square */
-#define DIFF_THRESH 25 /* Abs diff for x or y to change before trigger */
 #define SERIAL "/dev/ttyACM0"
-#define BAUD B115200
-#define NUM_TRIALS 1
+#define ARDUINO_TIMEOUT_MS 2000 /* give up on the Arduino's reply after this long */
+#define SAMPLE_BATCH 64 /* Max samples consumed from the acquisition ring at once */
+#define REALTIME_STACK ( 256 * 1024 ) /* stack faulted in by each real-time thread */
+#define MODE_SETTLE_MS 2000 /* let the monitors resynchronize after a mode switch */
 
 using namespace std;
 using namespace std::chrono;
 
-/**
- * Setup the serial port interface attributes to 8-bit, no parity, 1 stop bit.
- *
- * @param fd    File descriptor of the serial port.
- * @param speed The baud rate to use.
- */
-int set_interface_attribs( int fd, int speed )
+/* Settings chosen on the command line */
+struct ExperimentConfig
 {
-  struct termios tty;
-
-  if ( !isatty( fd ) ) {
-    printf( "fd is not a TTY\n" );
-    return -1;
-  }
-
-  if ( tcgetattr( fd, &tty ) < 0 ) {
-    printf( "Error from tcgetattr: %s\n", strerror( errno ) );
-    return -1;
+  bool synthetic = false;
+  SyntheticGazeConfig synthetic_config {};
+  SaccadeDetectorConfig detector_config {};
+
+  bool patches = false;
+  bool paced = false;
+  bool interrupt_clock = true; /* a trigger cuts short the render thread's wait on a clock frame */
+  SyncMode sync_mode = SyncMode::Finish;
+  string stimulus {};
+
+  vector<unsigned int> displays { 0 }; /* monitors to draw on (0 is the primary) */
+  DisplayMode mode {};                 /* their resolution, and refresh rate (0 for the highest) */
+  bool sweep = false;                  /* run the trials in each of the first display's modes instead */
+  unsigned int sweep_min_hz = 0;       /* ... at this refresh rate or above */
+  vector<string> serials { SERIAL };   /* their Arduinos, in order; the first one's LED drives the tracker */
+
+  unsigned int baud = 1000000;                    /* must match Serial.begin() in arduino.ino */
+  uint16_t asg_threshold = ASG_DEFAULT_THRESHOLD; /* photodiode ADC level that ends a measurement */
+  bool waveform = false;                          /* ask for the photodiode waveform and fit the edge */
+
+  unsigned int trials = 1;
+  string log_path = "trials.gdl";    /* record log of results, timelines and frame timings */
+  string stats_path = "latency.hdr"; /* the run's latency histograms, for stats_merge */
+  unsigned int report_every = 10;    /* print percentiles every this many trials (0 for never) */
+
+  PollMode poll_mode = PollMode::Spin;
+  ThreadProfile acquire_thread {}, detect_thread {}, render_thread {}, serial_thread {};
+  int realtime_priority = 0; /* SCHED_FIFO priority of the trigger path, or 0 for none */
+};
+
+/* The real-time profile: memory locked, the trigger path (acquisition and
+   detection) at the given SCHED_FIFO priority, rendering just below it and
+   the serial link below that, stacks faulted in, and threads that weren't
+   pinned by hand placed on the isolated CPUs, if there are any. Threads
+   that never sleep would starve each other and the rest of the system at
+   real-time priority, so polling falls back to block unless each spinning
+   thread has an isolated CPU to itself. */
+void make_realtime( ExperimentConfig& config )
+{
+  const int priority = config.realtime_priority;
+  config.detect_thread.priority = config.acquire_thread.priority = priority;
+  config.render_thread.priority = max( 1, priority - 10 );
+  config.serial_thread.priority = max( 1, priority - 20 );
+
+  const vector<int> isolated = isolated_cpus();
+  size_t next_cpu = 0;
+  for ( ThreadProfile* profile :
+        { &config.detect_thread, &config.acquire_thread, &config.render_thread, &config.serial_thread } ) {
+    profile->stack = REALTIME_STACK;
+    if ( profile->cpu < 0 and next_cpu < isolated.size() ) {
+      profile->cpu = isolated[next_cpu++];
+    }
   }
 
-  tty.c_cflag |= CLOCAL | CREAD;
-  tty.c_cflag &= ~CSIZE;
-  tty.c_cflag |= CS8;      // 8-bit characters
-  tty.c_cflag &= ~PARENB;  // no parity bit
-  tty.c_cflag &= ~CSTOPB;  // only need 1 stop bit
-  tty.c_cflag &= ~CRTSCTS; // no hardware flowcontrol
-
-  tty.c_lflag |= ICANON | ISIG; // canonical input
-  tty.c_lflag &= ~( ECHO | ECHOE | ECHONL | IEXTEN );
-
-  tty.c_iflag &= ~IGNCR; // preserve carriage return
-  tty.c_iflag &= ~INPCK;
-  tty.c_iflag &= ~( INLCR | ICRNL | IUCLC | IMAXBEL );
-  tty.c_iflag &= ~( IXON | IXOFF | IXANY ); // no SW flowcontrol
-
-  tty.c_oflag &= ~OPOST;
-
-  tty.c_cc[VEOL] = 0;
-  tty.c_cc[VEOL2] = 0;
-  tty.c_cc[VEOF] = 0x04;
-
-  if ( cfsetospeed( &tty, speed ) < 0 || cfsetispeed( &tty, speed ) < 0 ) {
-    printf( "unable to set correct baud rates.\n" );
-    return -1;
-  }
+  if ( config.poll_mode != PollMode::Block ) {
+    vector<int> spinning { config.detect_thread.cpu, config.acquire_thread.cpu };
+    for ( size_t i = 0; i < config.displays.size(); i++ ) {
+      spinning.push_back( config.render_thread.cpu < 0 ? -1 : config.render_thread.cpu + int( i ) );
+    }
 
-  if ( tcsetattr( fd, TCSANOW, &tty ) != 0 ) {
-    printf( "Error from tcsetattr: %s\n", strerror( errno ) );
-    return -1;
+    const bool own_cpus = all_of( spinning.begin(),
+                                  spinning.end(),
+                                  [&]( const int cpu ) {
+                                    return count( isolated.begin(), isolated.end(), cpu ) == 1
+                                           and count( spinning.begin(), spinning.end(), cpu ) == 1;
+                                  } );
+    if ( not own_cpus ) {
+      cerr << "[Warning] --poll=" << poll_mode_name( config.poll_mode ) << " needs an isolated CPU for each of the "
+           << spinning.size() << " polling threads under --rt; using --poll=block\n";
+      config.poll_mode = PollMode::Block;
+    }
   }
-  return 0;
-}
 
-/**
- * End recording: adds 100 msec of data to catch final events
- */
-static void end_trial( void )
-{
-  pump_delay( 100 ); // provide a small amount of delay for last data
-  stop_recording();
-  while ( getkey() ) {
-  };
+  cout << "Real-time profile: SCHED_FIFO " << priority << ", memory locked, " << isolated.size()
+       << " isolated CPUs (trigger loop " << config.detect_thread.cpu << ", acquisition "
+       << config.acquire_thread.cpu << ", render " << config.render_thread.cpu << ", serial "
+       << config.serial_thread.cpu << ")\n";
 }
 
 int get_tracker_sw_version( char* verstr )
@@ -104,7 +138,13 @@ int get_tracker_sw_version( char* verstr )
   return atoi( &verstr[st] );
 }
 
-int initialize_eyelink()
+/* tell the tracker the display's resolution, for its gaze coordinates */
+void set_tracker_screen( const DisplayMode& mode )
+{
+  eyecmd_printf( "screen_pixel_coords = %ld %ld %ld %ld", 0L, 0L, long( mode.width ), long( mode.height ) );
+}
+
+int initialize_eyelink( unsigned int sample_rate, const DisplayMode& mode )
 {
   char verstr[50];
   int eyelink_ver = 0;
@@ -124,7 +164,10 @@ int initialize_eyelink()
   flush_getkey_queue();
 
   // Now configure tracker for display resolution
-  eyecmd_printf( "screen_pixel_coords = %ld %ld %ld %ld", 0, 0, 1920, 1080 );
+  set_tracker_screen( mode );
+
+  // Sample at the rate the acquisition thread expects (500, 1000, or 2000 Hz)
+  eyecmd_printf( "sample_rate = %d", sample_rate );
 
   eyelink_ver = eyelink_get_tracker_version( verstr );
   if ( eyelink_ver == 3 )
@@ -155,271 +198,548 @@ int initialize_eyelink()
   return 0;
 }
 
-/**
- * Separate thread for running updating the display. Toggles between 2 of 4
- * textures: clock_white and clock_black before triggered, and trigger_white
- * and trigger_black after triggering, where the post-trigger versions contain
- * a white square at the bottom left in addition to alternating black and white
- * in the top left.
- *
- * @param triggered A shared atomic to indicate whether to switch textures.
- */
-void clock_loop( atomic<bool>& triggered, atomic<unsigned int>& drawing_delay )
+/* Fit the display edge in the reply's photodiode waveform. Returns the ASG
+   time of its 50% point, or the threshold crossing if there is no fit. */
+uint32_t fit_waveform( const SerialReply& reply )
 {
+  if ( not reply.has_waveform ) {
+    return reply.frame.edge_us;
+  }
 
-  // First, set up all the textures
-  VideoDisplay display { 1920, 1080, true }; // fullscreen window @ 1920x1080 luma resolution
-  display.window().hide_cursor( true );
-
-  // whether to wait for vertical retrace before swapping buffer
-  // *  0 for immediate updates
-  // *  1 for updates synchronized with the vertical retrace
-  // * -1 for adaptive vsync
-  display.window().set_swap_interval( 0 );
+  const AsgWaveform& waveform = reply.waveform;
+  const EdgeFit fit = fit_edge( waveform.samples.data(), waveform.count );
+  if ( not fit.valid ) {
+    cout << "Waveform: no edge found in " << waveform.count << " samples\n";
+    return reply.frame.edge_us;
+  }
 
-  /* top left box white (235 = max luma in typical Y'CbCr colorspace) */
-  Raster420 clock_white { 1920, 1080 };
+  const double period = waveform.period_us();
+  const uint32_t edge_us = waveform.first_us + lround( fit.edge * period );
+  cout << "Waveform: fitted " << edge_us - reply.frame.toggle_us << " us (threshold crossing "
+       << reply.frame.latency_us() << " us), rise " << lround( fit.rise() * period ) << " us, ripple "
+       << lround( 100 * fit.ripple ) << "%";
+  if ( fit.ripple_period > 0 ) {
+    cout << " at " << lround( 1e6 / ( fit.ripple_period * period ) ) << " Hz";
+  }
+  cout << "\n";
+  return edge_us;
+}
 
-  for ( unsigned int y = 0; y < clock_white.Y.height(); y++ ) {
-    for ( unsigned int x = 0; x < clock_white.Y.width(); x++ ) {
-      const uint8_t color = ( x < BOX_DIM && y < BOX_DIM ) ? 235 : 16;
-      clock_white.Y.at( x, y ) = color;
-    }
+/* The trial loop's tables in the record log, written from the trial thread */
+struct TrialLog
+{
+  RecordLog::Writer& writer;
+  uint32_t results, timeline, displays;
+};
+
+/* One stimulus monitor: its render thread and, if it has a photodiode, the
+   Arduino that reads it. The first display's Arduino also drives the LED
+   the tracker watches. */
+struct Station
+{
+  unsigned int monitor = 0;
+  unique_ptr<SerialChannel> arduino {};
+  unique_ptr<StimulusRenderer> renderer {};
+  DisplayMode mode {}; /* what its monitor is running at */
+  size_t e2e_metric = 0, skew_metric = 0, drawing_metric = 0; /* in TrialStats, for displays after the first */
+};
+
+/* Latency distributions reported while the experiment runs */
+struct TrialStats
+{
+  LatencyStats latency {};
+  size_t e2e = latency.add_metric( "e2e (us)" );
+  size_t sensing = latency.add_metric( "sensing (us)" );
+  size_t drawing = latency.add_metric( "drawing (us)" );
+  size_t trigger_observe = latency.add_metric( "trigger observe (us)" );
+  size_t frame_interval = latency.add_metric( "frame interval (us)" );
+  size_t sample_age = latency.add_metric( "sample age (us)" ); /* every sample's, on arrival */
+};
+
+/* Place the trial's host, tracker and ASG events on one timeline
+   (microseconds after the LED toggle) using the serial channel's clock
+   estimate. `sample_taken` is the triggering sample's tracker timestamp on
+   the host clock, or zero if the tracker clock wasn't synchronized. */
+void log_timeline( TrialLog& records,
+                   const SerialReply& reply,
+                   const uint32_t edge_us,
+                   const ClockEstimate& clock,
+                   const steady_clock::time_point sample_taken,
+                   const steady_clock::time_point sample_arrival,
+                   const steady_clock::time_point trigger_time,
+                   const FrameTiming& drawn )
+{
+  if ( not clock.valid ) {
+    cout << "Timeline: ASG clock not synchronized yet\n";
+    return;
   }
 
-  Texture420 clock_white_texture { clock_white };
+  const auto toggle = clock.host_at( reply.frame.toggle_us, reply.sent );
+  const auto edge = clock.host_at( edge_us, reply.last_byte );
+  const auto after_toggle = [&]( const steady_clock::time_point t ) {
+    return duration_cast<microseconds>( t - toggle ).count();
+  };
 
-  /* all black (16 = min luma in typical Y'CbCr colorspace) */
-  Raster420 clock_black { 1920, 1080 };
-  memset( clock_black.Y.mutable_pixels(), 16, clock_black.Y.width() * clock_black.Y.height() );
-  Texture420 clock_black_texture { clock_black };
+  const bool draw_valid = drawn.cpu_start != FrameTiming::time_point {};
+  const auto complete = drawn.completion_valid() ? drawn.cpu_completed : drawn.cpu_finished;
 
-  /* top left box white (235 = max luma in typical Y'CbCr colorspace) */
-  Raster420 triggered_white { 1920, 1080 };
+  const auto sample = after_toggle( sample_arrival ), trigger = after_toggle( trigger_time );
+  const auto draw = draw_valid ? after_toggle( drawn.cpu_start ) : trigger;
+  const auto swap = draw_valid ? after_toggle( drawn.cpu_swapped ) : trigger;
+  const auto done = draw_valid ? after_toggle( complete ) : trigger;
+  const auto photodiode = after_toggle( edge );
+  const bool taken_valid = sample_taken != steady_clock::time_point {};
+  const auto taken = taken_valid ? after_toggle( sample_taken ) : 0;
 
-  for ( unsigned int y = 0; y < triggered_white.Y.height(); y++ ) {
-    for ( unsigned int x = 0; x < triggered_white.Y.width(); x++ ) {
-      const uint8_t color =
-        ( ( x < BOX_DIM && y < BOX_DIM ) || ( x < BOX_DIM && y > ( triggered_white.Y.height() - BOX_DIM ) ) ) ? 235
-                                                                                                              : 16;
-      triggered_white.Y.at( x, y ) = color;
-    }
+  cout << "Timeline (us after LED toggle, +/- " << lround( clock.error_us ) << "): ";
+  if ( taken_valid ) {
+    cout << "sample taken " << taken << ", ";
   }
+  cout << "sample arrived " << sample << ", triggered " << trigger << ", draw started " << draw << ", swapped "
+       << swap << ", GPU done " << done << ", photodiode edge " << photodiode << "\n";
 
-  Texture420 triggered_white_texture { triggered_white };
-
-  /* all black (16 = min luma in typical Y'CbCr colorspace) */
-  Raster420 triggered_black { 1920, 1080 };
-
-  for ( unsigned int y = 0; y < triggered_black.Y.height(); y++ ) {
-    for ( unsigned int x = 0; x < triggered_black.Y.width(); x++ ) {
-      const uint8_t color = ( x < BOX_DIM && y > ( triggered_black.Y.height() - BOX_DIM ) ) ? 235 : 16;
-      triggered_black.Y.at( x, y ) = color;
-    }
+  cout << "Stages (us): ";
+  if ( taken_valid ) {
+    cout << "eye+camera " << taken << ", tracker+link " << sample - taken;
+  } else {
+    cout << "tracker+link " << sample;
   }
+  cout << ", detection " << trigger - sample << ", render wake " << draw - trigger << ", draw+swap " << swap - draw
+       << ", GPU " << done - swap << ", scanout+panel " << photodiode - done << "\n";
+
+  records.writer.write( records.timeline,
+                        { reply.frame.trial,
+                          taken_valid ? taken : RecordLog::NO_VALUE,
+                          sample,
+                          trigger,
+                          draw,
+                          swap,
+                          done,
+                          photodiode,
+                          lround( clock.error_us ) } );
+}
 
-  Texture420 triggered_black_texture { triggered_black };
-
-  // Draw textures once to warm up. This brings subsequent draw times to <1ms.
-  display.draw( triggered_white_texture );
-  display.draw( triggered_black_texture );
-  display.draw( clock_white_texture );
-  display.draw( clock_black_texture );
-
-  // Spin here altterating frames until we are done
-  static bool toggle = true;
-  unsigned int frame_count = 0;
-
-  const auto start_time = steady_clock::now();
-  auto ts_prev = steady_clock::now();
-
+/* Wait for the reply to `request`; false if the serial thread timed it out */
+bool await_reply( SerialChannel& arduino, const uint32_t request, const PollMode poll_mode, SerialReply& reply )
+{
+  Poller poller( poll_mode, &arduino.reply_ready() );
   while ( true ) {
-    if ( triggered ) {
-      // Draw a couple of the triggered frames and then end
-      const auto t1 = steady_clock::now();
-      display.draw( toggle ? triggered_white_texture : triggered_black_texture );
-      const auto t2 = steady_clock::now();
-      drawing_delay = duration_cast<microseconds>( t2 - t1 ).count();
-      display.draw( toggle ? triggered_black_texture : triggered_white_texture );
-      display.draw( toggle ? triggered_white_texture : triggered_black_texture );
-      cout << "Drawing delay " << drawing_delay << " us\n";
-      return;
+    const uint32_t seen = arduino.reply_ready().sequence();
+    if ( arduino.receive( reply ) ) {
+      if ( reply.sequence == request ) {
+        return not reply.timed_out;
+      }
+      continue; // left over from an earlier request
     }
+    poller.idle( seen );
+  }
+}
 
-    const auto ts = steady_clock::now();
-    const auto tdiff = duration_cast<milliseconds>( ts - ts_prev ).count();
-    if ( tdiff >= 4 ) {
-      display.draw( toggle ? clock_white_texture : clock_black_texture );
-      toggle = !toggle;
-      frame_count++;
-      ts_prev = ts;
-
-      if ( frame_count % 480 == 0 ) {
-        const auto now = steady_clock::now();
-        const auto ms_elapsed = duration_cast<milliseconds>( now - start_time ).count();
-        cout << "Drew " << frame_count << " frames in " << ms_elapsed
-             << " milliseconds = " << 1000.0 * double( frame_count ) / ms_elapsed << " frames per second.\n";
+/* Compare the displays after the first with it: each one's photodiode edge
+   against the first Arduino's LED toggle (e2e) and the first display's edge
+   (skew), placed on the host clock by each Arduino's clock estimate. */
+void log_displays( TrialLog& records,
+                   TrialStats& trial_stats,
+                   vector<Station>& stations,
+                   const vector<TrialDrawResult>& drawn,
+                   const vector<uint32_t>& requests,
+                   const SerialReply& first_reply,
+                   const uint32_t first_edge_us,
+                   const ExperimentConfig& config )
+{
+  const ClockEstimate first_clock = stations.front().arduino->clock();
+  const auto first_toggle = first_clock.host_at( first_reply.frame.toggle_us, first_reply.sent );
+  const auto first_edge = first_clock.host_at( first_edge_us, first_reply.last_byte );
+  const auto us = []( const steady_clock::duration d ) { return duration_cast<microseconds>( d ).count(); };
+
+  for ( size_t i = 1; i < stations.size(); i++ ) {
+    Station& station = stations[i];
+    const int64_t observe_us = us( drawn[i].trigger_observe );
+    cout << "Display " << i << " (monitor " << station.monitor << "): drawing " << drawn[i].drawing_delay_us
+         << " us, trigger observe " << observe_us << " us, trigger to present " << us( drawn[i].trigger_to_present )
+         << " us";
+    trial_stats.latency.record( station.drawing_metric, drawn[i].drawing_delay_us );
+
+    int64_t own = RecordLog::NO_VALUE, e2e = RecordLog::NO_VALUE, skew = RecordLog::NO_VALUE;
+    SerialReply reply;
+    if ( not station.arduino ) {
+      cout << "; no photodiode\n";
+    } else if ( not await_reply( *station.arduino, requests[i], config.poll_mode, reply ) ) {
+      cout << "; no reply from its Arduino\n";
+    } else {
+      const uint32_t edge_us = fit_waveform( reply );
+      own = reply.frame.latency_us();
+      cout << "; its Arduino read " << own << " us";
+
+      const ClockEstimate clock = station.arduino->clock();
+      if ( first_clock.valid and clock.valid ) {
+        const auto edge = clock.host_at( edge_us, reply.last_byte );
+        e2e = us( edge - first_toggle );
+        skew = us( edge - first_edge );
+        cout << ", e2e " << e2e << " us, skew vs display 0 " << skew << " us (+/- "
+             << lround( first_clock.error_us + clock.error_us ) << ")";
+        // The histograms take magnitudes: skew is either way round, and an e2e
+        // below zero can only be clock error
+        if ( e2e >= 0 ) {
+          trial_stats.latency.record( station.e2e_metric, e2e );
+        }
+        trial_stats.latency.record( station.skew_metric, llabs( skew ) );
       }
+      cout << "\n";
     }
+
+    records.writer.write( records.displays,
+                          { first_reply.frame.trial,
+                            int64_t( i ),
+                            e2e,
+                            own,
+                            skew,
+                            drawn[i].drawing_delay_us,
+                            observe_us,
+                            us( drawn[i].trigger_to_present ) } );
   }
 }
 
-int gc_window_trial( ofstream& log, int arduino )
+int gc_window_trial( TrialLog& records,
+                     TrialStats& trial_stats,
+                     vector<Station>& stations,
+                     GazeSource& source,
+                     SampleAcquisition& acquisition,
+                     SaccadeDetector& detector,
+                     const ExperimentConfig& config )
 {
-  // Start thread for updating the display
-  atomic<bool> triggered( false );
-  atomic<unsigned int> drawing_delay( 0 );
+  // Start alternating clock frames on the display threads
+  for ( auto& station : stations ) {
+    station.renderer->arm();
+  }
+  bool triggered = false;
   unsigned int sensing_delay = 0;
-  char buf[64]; // store serial data from Arduino
-  thread display_thread = thread( clock_loop, ref( triggered ), ref( drawing_delay ) );
+  steady_clock::time_point sample_arrival {}, trigger_time {};
+  uint64_t sample_time_us = 0; /* the triggering sample's tracker timestamp */
+
+  // Signal every display thread to switch to the triggered frames
+  const auto trigger = [&] {
+    triggered = true;
+    for ( auto& station : stations ) {
+      station.renderer->trigger();
+    }
+  };
 
-  // Used to track gaze samples
-  ALLF_DATA evt;
-  float x, y;
-  float x_new, y_new;
+  // Wait for the display threads to draw the triggered frames
+  const auto wait_all = [&] {
+    vector<TrialDrawResult> results;
+    for ( auto& station : stations ) {
+      results.push_back( station.renderer->wait() );
+    }
+    return results;
+  };
 
-  // Ensure Eyelink has enough time to switch modes
-  set_offline_mode();
-  pump_delay( 50 );
+  // Used to track gaze samples, consumed from the acquisition thread in batches
+  TimedSample batch[SAMPLE_BATCH];
+  bool tracking = false;
+  detector.reset();
 
-  // Start data streaming
-  // Note that we are ignoring the EDF file.
-  int error = start_recording( 0, 0, 1, 1 );
-  if ( error != 0 ) {
-    return error;
-  }
+  Poller poller( config.poll_mode, &acquisition.data_ready() );
+  const auto start_cpu = thread_cpu_time();
 
-  // wait for link sample data
-  if ( !eyelink_wait_for_block_start( 100, 1, 0 ) ) {
-    end_trial();
-    cerr << "ERROR: No link samples received!\n";
+  if ( !source.start() ) {
+    trigger();
+    wait_all();
     return TRIAL_ERROR;
   }
+  acquisition.start();
 
-  // determine which eye(s) are available
-  int eye_used = eyelink_eye_available();
+  // First, initialize with a single valid sample.
+  while ( !tracking ) {
+    const uint32_t seen = acquisition.data_ready().sequence();
+    const size_t count = acquisition.read( batch, SAMPLE_BATCH );
+    if ( count == 0 ) {
+      poller.idle( seen );
+      continue;
+    }
+    poller.reset();
 
-  // reset keys and buttons from tracker
-  eyelink_flush_keybuttons( 0 );
+    // make sure pupil is present
+    for ( size_t i = 0; i < count; i++ ) {
+      detector.add( batch[i].sample );
+      tracking = tracking || batch[i].sample.valid();
+    }
+  }
 
-  // First, initialize with a single valid sample.
-  while ( true ) {
-    if ( eyelink_newest_float_sample( NULL ) > 0 ) {
-      eyelink_newest_float_sample( &evt );
+  // Send the Arduinos the command to switch LEDs and watch their photodiodes
+  // (queued for their serial threads)
+  AsgFrame toggle;
+  toggle.threshold = config.asg_threshold;
+  toggle.edge_us = config.waveform ? ASG_FLAG_WAVEFORM : 0;
+  vector<uint32_t> requests;
+  for ( auto& station : stations ) {
+    requests.push_back( station.arduino ? station.arduino->send( toggle, milliseconds( ARDUINO_TIMEOUT_MS ) ) : 0 );
+  }
+  SerialChannel& arduino = *stations.front().arduino;
+
+  const auto start_time = steady_clock::now();
+
+  // Discard samples that arrived before the command was sent (they still
+  // fill the detector's velocity window, but can't trigger)
+  for ( size_t count; ( count = acquisition.read( batch, SAMPLE_BATCH ) ) > 0; ) {
+    for ( size_t i = 0; i < count; i++ ) {
+      detector.add( batch[i].sample );
+    }
+  }
+
+  // Check every new sample until the gaze velocity signifies the LEDs switched
+  while ( !triggered ) {
+    const uint32_t seen = acquisition.data_ready().sequence();
+    const size_t count = acquisition.read( batch, SAMPLE_BATCH );
+    if ( count == 0 ) {
+      poller.idle( seen );
+      continue;
+    }
+    poller.reset();
 
-      x = evt.fs.gx[eye_used];
-      y = evt.fs.gy[eye_used];
+    for ( size_t i = 0; i < count; i++ ) {
+      if ( detector.add( batch[i].sample ) ) {
+        trigger();
 
-      // make sure pupil is present
-      if ( x != MISSING_DATA && y != MISSING_DATA && evt.fs.pa[eye_used] > 0 ) {
+        const auto t1 = steady_clock::now();
+        sensing_delay = duration_cast<microseconds>( t1 - start_time ).count();
+        sample_arrival = batch[i].arrival;
+        sample_time_us = batch[i].sample.tracker_time_us;
+        trigger_time = t1;
         break;
       }
     }
   }
 
-  // Send Arduino the command to switch LEDs
-  int wlen = write( arduino, "g", 1 );
-  if ( wlen != 1 ) {
-    cerr << "[Error] Unable to send to arduino.\n";
-    end_trial();
+  const auto detect_cpu = thread_cpu_time() - start_cpu;
+
+  // Wait for the display threads to draw the triggered frames
+  const vector<TrialDrawResult> drawn_all = wait_all();
+  const TrialDrawResult& drawn = drawn_all.front();
+
+  // Collect the Arduino's end-to-end measurement. The serial thread times
+  // the request out, so a late or missing reply can't stall the experiment.
+  SerialReply reply;
+  if ( not await_reply( arduino, requests.front(), config.poll_mode, reply ) ) {
+    cerr << "[Error] No reply from Arduino within " << ARDUINO_TIMEOUT_MS << " ms.\n";
+    acquisition.stop();
+    source.stop();
     return TRIAL_ERROR;
   }
-  tcdrain( arduino );
+  cout << "Sensor delay " << sensing_delay << " us\n";
+  cout << "Read: " << reply.frame.latency_us() << " us (trial " << reply.frame.trial << ", reply "
+       << duration_cast<microseconds>( reply.last_byte - reply.sent ).count() << " us after the request)\n";
+  const uint32_t edge_us = fit_waveform( reply );
+
+  acquisition.stop();
+  const AcquisitionStats stats = acquisition.stats();
+  cout << "Samples received " << stats.received << ", dropped " << stats.dropped << " ("
+       << 100 * stats.dropped_fraction() << "%), ring overflows " << stats.overflowed << "\n"
+       << "CPU time (" << poll_mode_name( config.poll_mode ) << "): detection "
+       << duration_cast<microseconds>( detect_cpu ).count() << " us, acquisition "
+       << duration_cast<microseconds>( stats.cpu_time ).count() << " us, render "
+       << duration_cast<microseconds>( drawn.cpu_time ).count() << " us\n"
+       << "Trigger observed by the render thread after "
+       << duration_cast<microseconds>( drawn.trigger_observe ).count() << " us"
+       << ( drawn.clock_interrupted ? " (interrupted the clock frame's GPU wait)\n" : "\n" )
+       << "Drawing delay " << drawn.drawing_delay_us << " us\n"
+       << "Drew " << drawn.clock_frames << " clock frames in "
+       << duration_cast<milliseconds>( drawn.clock_duration ).count() << " ms = "
+       << drawn.clock_frames / max( duration<double>( drawn.clock_duration ).count(), 1e-9 ) << " frames per second\n";
+
+  // How old samples were when we pulled them off the link, by the tracker's clock
+  steady_clock::time_point sample_taken {};
+  const ClockEstimate& tracker_clock = stats.tracker_clock;
+  if ( tracker_clock.valid ) {
+    sample_taken = tracker_clock.host_at( uint32_t( sample_time_us ), sample_arrival );
+    cout << "Tracker clock: link round trip " << lround( tracker_clock.rtt_us ) << " us, timestamp resolution "
+         << lround( tracker_clock.resolution_us ) << " us, skew "
+         << lround( tracker_clock.skew * 1e6 ) << " ppm; " << stats.time_requests << " time requests, "
+         << stats.time_timeouts << " lost\n"
+         << "Sample age on arrival (+/- " << lround( tracker_clock.error_us ) << " us): median "
+         << stats.arrival_latency.percentile( 0.5 ) << " us, 99% " << stats.arrival_latency.percentile( 0.99 )
+         << " us, max " << stats.arrival_latency.max() << " us over " << stats.arrival_latency.count()
+         << " samples; triggering sample " << duration_cast<microseconds>( sample_arrival - sample_taken ).count()
+         << " us\n";
+    trial_stats.latency.record( trial_stats.sample_age, stats.arrival_latency );
+  } else {
+    cout << "Tracker clock: not synchronized (" << stats.time_requests << " time requests)\n";
+  }
 
-  const auto start_time = steady_clock::now();
+  const FrameTiming& timing = drawn.trigger_timing;
+  cout << "Triggered frame: submit " << duration_cast<microseconds>( timing.cpu_submit() ).count() << " us, swap "
+       << duration_cast<microseconds>( timing.cpu_swap() ).count() << " us, finish "
+       << duration_cast<microseconds>( timing.cpu_finish() ).count() << " us";
+  if ( timing.completion_valid() ) {
+    cout << ", GPU complete " << duration_cast<microseconds>( timing.cpu_complete() ).count() << " us after swap";
+  }
+  if ( timing.gpu_valid() ) {
+    cout << "; GPU draw " << duration_cast<microseconds>( timing.gpu_draw() ).count() << " us, draw to swap "
+         << duration_cast<microseconds>( timing.gpu_to_swap() ).count() << " us";
+  }
+  cout << "\nTrigger to present " << duration_cast<microseconds>( drawn.trigger_to_present ).count() << " us\n";
 
-  // Poll for new samples until the diff between samples is large enough to signify LEDs switched
-  while ( true ) {
-    // check for new sample update
-    if ( eyelink_newest_float_sample( NULL ) > 0 ) {
-      eyelink_newest_float_sample( &evt );
-
-      x_new = evt.fs.gx[eye_used];
-      y_new = evt.fs.gy[eye_used];
-
-      // make sure pupil is present
-      if ( x != MISSING_DATA && y != MISSING_DATA && evt.fs.pa[eye_used] > 0 ) {
-        // Only trigger change when there is a large enough diff
-        if ( abs( x - x_new ) >= DIFF_THRESH && abs( y - y_new ) >= DIFF_THRESH ) {
-          // Update shared atomic bool to signal display thread
-          triggered = true;
-
-          const auto t1 = steady_clock::now();
-          sensing_delay = duration_cast<microseconds>( t1 - start_time ).count();
-          cout << "Sensor delay " << sensing_delay << " us\n";
-
-          // Blocking read call while we wait for the arduino's
-          // end-to-end measurement.
-          int rdlen = read( arduino, buf, sizeof( buf ) - 1 );
-          if ( rdlen > 0 ) {
-            buf[rdlen] = 0;
-            cout << "Read: " << buf << endl;
-          } else if ( rdlen < 0 ) {
-            cerr << "[Error] Unable to read from Arduino.";
-            end_trial();
-            return TRIAL_ERROR;
-          } else {
-            cerr << "Nothing read. EOF?\n";
-          }
-          break;
-        }
-      }
+  if ( not config.stimulus.empty() ) {
+    cout << "Stimulus frames repeated " << drawn.stimulus_repeats << " of " << drawn.clock_frames << "\n";
+  }
+
+  log_timeline(
+    records, reply, edge_us, arduino.clock(), sample_taken, sample_arrival, trigger_time, drawn.trigger_timing );
+  log_displays( records, trial_stats, stations, drawn_all, requests, reply, edge_us, config );
+
+  // Queue the results for the log thread
+  const int64_t observe_us = duration_cast<microseconds>( drawn.trigger_observe ).count();
+  const DisplayMode& mode = stations.front().mode;
+  records.writer.write( records.results,
+                        { reply.frame.latency_us(),
+                          sensing_delay,
+                          drawn.drawing_delay_us,
+                          observe_us,
+                          mode.width,
+                          mode.height,
+                          mode.refresh_hz } );
+  trial_stats.latency.record( trial_stats.e2e, reply.frame.latency_us() );
+  trial_stats.latency.record( trial_stats.sensing, sensing_delay );
+  trial_stats.latency.record( trial_stats.drawing, drawn.drawing_delay_us );
+  trial_stats.latency.record( trial_stats.trigger_observe, observe_us );
+  trial_stats.latency.record( trial_stats.frame_interval, drawn.frame_intervals );
+
+  source.stop();
+  return config.synthetic ? TRIAL_OK : check_record_exit();
+}
+
+/* "a,b,c" as {"a", "b", "c"} */
+vector<string> split_list( const string& list )
+{
+  vector<string> items;
+  size_t start = 0;
+  while ( start <= list.size() ) {
+    const size_t comma = min( list.find( ',', start ), list.size() );
+    if ( comma > start ) {
+      items.push_back( list.substr( start, comma - start ) );
     }
+    start = comma + 1;
   }
+  return items;
+}
+
+/* pseudo-terminal slaves (such as the asg_emulator's) live under /dev/pts */
+bool is_pseudo_terminal( const string& path )
+{
+  char resolved[PATH_MAX];
+  return realpath( path.c_str(), resolved ) and strncmp( resolved, "/dev/pts/", 9 ) == 0;
+}
 
-  // Wait for display thread to finish
-  display_thread.join();
+/* the i-th of several threads sharing a profile gets the i-th CPU from its pinned one */
+ThreadProfile nth_thread( ThreadProfile profile, const size_t i )
+{
+  if ( profile.cpu >= 0 ) {
+    profile.cpu += i;
+  }
+  return profile;
+}
 
-  // Log results to file
-  log << atoi( as_const( buf ) ) << "," << sensing_delay << "," << drawing_delay << endl;
+/* One display mode's block of trials */
+struct ModeResult
+{
+  DisplayMode requested {}, actual {};
+  unsigned int completed = 0;
+  double minutes = 0;
+  TrialStats stats {};
+};
+
+/* the first display's modes at or above the --sweep rate */
+vector<DisplayMode> sweep_modes( const ExperimentConfig& config )
+{
+  GLFWContext glfw;
+  vector<DisplayMode> modes;
+  for ( const auto& mode : Window::video_modes( config.displays.front() ) ) {
+    if ( mode.refresh_hz >= config.sweep_min_hz ) {
+      modes.push_back( mode );
+    }
+  }
 
-  end_trial();
-  return check_record_exit();
+  if ( modes.empty() ) {
+    throw runtime_error( "no video modes at " + to_string( config.sweep_min_hz ) + " Hz or more to sweep" );
+  }
+  cout << "Sweeping " << modes.size() << " display modes, " << config.trials << " trials each\n";
+  return modes;
 }
 
-int run_trials()
+/* "latency.hdr" as "latency-1920x1080@240.hdr" */
+string mode_path( const string& path, const DisplayMode& mode )
 {
-  // To communicate with arduino over serial
-  int arduino;
+  const size_t dot = path.rfind( '.' );
+  const size_t stem = dot == string::npos or dot < path.rfind( '/' ) + 1 ? path.size() : dot;
+  return path.substr( 0, stem ) + "-" + mode.name() + path.substr( stem );
+}
 
-  // Open the serial port to the Arduino
-  arduino = open( (char*)SERIAL, O_RDWR | O_NOCTTY | O_SYNC );
-  if ( arduino < 0 ) {
-    printf( "Error opening %s: %s\n", SERIAL, strerror( errno ) );
-    return ABORT_EXPT;
+/* Open the displays in `result.requested` and run the configured number of
+   trials in it */
+int run_mode( ModeResult& result,
+              TrialLog& records,
+              vector<Station>& stations,
+              RendererConfig renderer_config,
+              GazeSource& source,
+              SampleAcquisition& acquisition,
+              SaccadeDetector& detector,
+              const ExperimentConfig& config )
+{
+  // Close the previous mode's displays first, so their monitors can switch
+  for ( auto& station : stations ) {
+    station.renderer.reset();
   }
 
-  // baudrate 115200, 8 bits, no parity, 1 stop bit
-  if ( set_interface_attribs( arduino, BAUD ) != 0 ) {
-    printf( "Error setting serial interface attribs.\n" );
-    close( arduino );
-    return ABORT_EXPT;
+  TrialStats& stats = result.stats;
+  renderer_config.mode = result.requested;
+  for ( size_t i = 0; i < stations.size(); i++ ) {
+    renderer_config.monitor = stations[i].monitor;
+    renderer_config.thread = nth_thread( config.render_thread, i );
+    renderer_config.log_table = i == 0 ? "frames" : "frames." + to_string( i );
+    if ( config.sweep ) {
+      renderer_config.log_table += "." + result.requested.name();
+    }
+    stations[i].renderer = make_unique<StimulusRenderer>( renderer_config );
+    stations[i].mode = stations[i].renderer->mode();
+
+    if ( i > 0 ) {
+      const string name = "display " + to_string( i ) + " ";
+      stations[i].e2e_metric = stats.latency.add_metric( name + "e2e (us)" );
+      stations[i].skew_metric = stats.latency.add_metric( name + "|skew| (us)" );
+      stations[i].drawing_metric = stats.latency.add_metric( name + "drawing (us)" );
+    }
   }
 
-  // Arduino Uno uses DTR line to trigger a reset, so wait for it to boot fully.
-  sleep( 5 );
+  result.actual = stations.front().mode;
+  cout << "Display mode " << result.actual.name();
+  if ( not( result.actual == result.requested ) ) {
+    cout << " (asked for " << result.requested.name() << ")";
+  }
+  cout << "\n";
 
-  ofstream log;
+  if ( not config.synthetic ) {
+    set_tracker_screen( result.actual );
+  }
+  if ( config.sweep ) {
+    this_thread::sleep_for( milliseconds( MODE_SETTLE_MS ) );
+  }
 
-  log.open( "results.csv" );
-  log << "e2e (us), eyelink (us)\n";
+  // Percentiles every few trials
+  unsigned int reported = 0;
+  const auto start_time = steady_clock::now();
 
-  for ( unsigned int trial = 0; trial < NUM_TRIALS; trial++ ) {
+  for ( unsigned int trial = 0; trial < config.trials; trial++ ) {
     // abort if link is closed
-    if ( eyelink_is_connected() == 0 || break_pressed() ) {
-      close( arduino );
-      log.close();
+    if ( !source.connected() ) {
       return ABORT_EXPT;
     }
 
-    int i = gc_window_trial( log, arduino );
+    int i = gc_window_trial( records, stats, stations, source, acquisition, detector, config );
 
     // Report errors
     switch ( i ) {
       case ABORT_EXPT: // handle experiment abort or disconnect
         cout << "EXPERIMENT ABORTED\n";
-        close( arduino );
-        log.close();
         return ABORT_EXPT;
       case REPEAT_TRIAL: // trial restart requested
         cout << "TRIAL REPEATED\n";
@@ -430,6 +750,12 @@ int run_trials()
         break;
       case TRIAL_OK: // successful trial
         cout << "TRIAL OK\n";
+        result.completed++;
+        if ( config.report_every and result.completed % config.report_every == 0 ) {
+          cout << "Latency over trials " << reported + 1 << "-" << result.completed << ":\n";
+          stats.latency.report( cout );
+          reported = result.completed;
+        }
         break;
       default: // other error code
         cout << "TRIAL ERROR\n";
@@ -437,26 +763,426 @@ int run_trials()
     }
   }
 
-  // clean up
-  close( arduino );
-  log.close();
+  result.minutes = duration_cast<milliseconds>( steady_clock::now() - start_time ).count() / 60000.0;
+  cout << result.completed << " of " << config.trials << " trials OK in " << result.actual.name() << ", "
+       << result.completed / result.minutes << " trials per minute\n";
+  return 0;
+}
+
+/* Latency against display mode, printed and written to mode_sweep.csv */
+void print_sweep( const vector<ModeResult>& results )
+{
+  ofstream csv( "mode_sweep.csv" );
+  csv << "mode,width,height,refresh (Hz),trials,e2e p50 (us),e2e p99 (us),e2e max (us),drawing p50 (us),"
+         "frame interval p50 (us),trigger observe p50 (us)\n";
+
+  const auto column = []( const int width ) { return setw( width ); };
+  cout << "\n" << left << column( 18 ) << "Mode" << right << column( 7 ) << "trials" << column( 10 ) << "e2e p50"
+       << column( 10 ) << "e2e p99" << column( 10 ) << "e2e max" << column( 13 ) << "drawing p50" << column( 16 )
+       << "frame int. p50" << column( 16 ) << "trig. obs. p50" << "  (us)\n";
+
+  const ModeResult* fastest = nullptr;
+  uint64_t fastest_median = 0;
+  for ( const auto& result : results ) {
+    const TrialStats& stats = result.stats;
+    const HdrHistogram& e2e = stats.latency.total( stats.e2e );
+    const uint64_t median = e2e.percentile( 0.5 );
+    const uint64_t drawing = stats.latency.total( stats.drawing ).percentile( 0.5 );
+    const uint64_t interval = stats.latency.total( stats.frame_interval ).percentile( 0.5 );
+    const uint64_t observe = stats.latency.total( stats.trigger_observe ).percentile( 0.5 );
+
+    cout << left << column( 18 ) << result.actual.name() << right << column( 7 ) << result.completed << column( 10 )
+         << median << column( 10 ) << e2e.percentile( 0.99 ) << column( 10 ) << e2e.max() << column( 13 ) << drawing
+         << column( 16 ) << interval << column( 16 ) << observe << "\n";
+    csv << result.actual.name() << "," << result.actual.width << "," << result.actual.height << ","
+        << result.actual.refresh_hz << "," << result.completed << "," << median << "," << e2e.percentile( 0.99 )
+        << "," << e2e.max() << "," << drawing << "," << interval << "," << observe << "\n";
+
+    if ( e2e.count() and ( not fastest or median < fastest_median ) ) {
+      fastest = &result;
+      fastest_median = median;
+    }
+  }
+
+  if ( fastest ) {
+    cout << "Lowest median e2e: " << fastest->actual.name() << "\n";
+  }
+  cout << "Table written to mode_sweep.csv\n";
+}
+
+int run_trials( GazeSource& source, const ExperimentConfig& config )
+{
+  // Requests and replies to each Arduino go through their own I/O thread
+  vector<Station> stations( config.displays.size() );
+  bool resets = false;
+  for ( size_t i = 0; i < stations.size(); i++ ) {
+    stations[i].monitor = config.displays[i];
+    if ( i < config.serials.size() ) {
+      stations[i].arduino = make_unique<SerialChannel>(
+        config.serials[i], baud_constant( config.baud ), nth_thread( config.serial_thread, i ) );
+      resets = resets or not is_pseudo_terminal( config.serials[i] );
+    }
+  }
+
+  // Arduino Uno uses DTR line to trigger a reset, so wait for it to boot fully.
+  // (The emulator's pseudo-terminal has nothing to reset.)
+  if ( resets ) {
+    sleep( 5 );
+  }
+
+  // Samples are drained from the link on their own thread
+  SampleAcquisition acquisition( source, 4096, config.poll_mode, config.acquire_thread );
+  SaccadeDetector detector( config.detector_config );
+
+  // Results and per-frame timings are queued to a log thread, which writes
+  // them to a binary record log; log_export turns it into CSV files
+  RecordLog record_log( config.log_path );
+  RecordLog::Writer trial_writer( record_log );
+  TrialLog records { trial_writer,
+                     record_log.add_table( "results",
+                                           { "e2e (us)",
+                                             "eyelink (us)",
+                                             "drawing (us)",
+                                             "trigger observe (us)",
+                                             "width",
+                                             "height",
+                                             "refresh (Hz)" } ),
+                     record_log.add_table( "timeline",
+                                           { "trial",
+                                             "sample taken (us)",
+                                             "sample (us)",
+                                             "trigger (us)",
+                                             "draw start (us)",
+                                             "swap (us)",
+                                             "gpu done (us)",
+                                             "photodiode (us)",
+                                             "sync error (us)" } ),
+                     record_log.add_table( "displays",
+                                           { "trial",
+                                             "display",
+                                             "e2e (us)",
+                                             "own e2e (us)",
+                                             "skew (us)",
+                                             "drawing (us)",
+                                             "trigger observe (us)",
+                                             "trigger to present (us)" } ) };
+
+  // Each display, its shaders and textures are set up once per mode
+  RendererConfig renderer_config;
+  renderer_config.patches = config.patches;
+  renderer_config.paced = config.paced;
+  renderer_config.interrupt_clock = config.interrupt_clock;
+  renderer_config.sync_mode = config.sync_mode;
+  renderer_config.stimulus = config.stimulus;
+  renderer_config.poll_mode = config.poll_mode;
+  renderer_config.log = &record_log;
+
+  // The trigger loop runs on this thread
+  apply_thread_profile( config.detect_thread );
+
+  // A block of trials in the configured mode, or with --sweep in each of the
+  // first display's modes in turn
+  vector<ModeResult> results;
+  int status = 0;
+  for ( const auto& mode : config.sweep ? sweep_modes( config ) : vector<DisplayMode> { config.mode } ) {
+    results.emplace_back();
+    results.back().requested = mode;
+    status
+      = run_mode( results.back(), records, stations, renderer_config, source, acquisition, detector, config );
+    if ( status == ABORT_EXPT ) {
+      break;
+    }
+  }
+
+  // The displays log into record_log, so close them before it goes
+  for ( auto& station : stations ) {
+    station.renderer.reset();
+  }
+  if ( status == ABORT_EXPT ) {
+    return ABORT_EXPT;
+  }
+
+  SerialStats serial_stats;
+  for ( const auto& station : stations ) {
+    if ( station.arduino ) {
+      const SerialStats channel_stats = station.arduino->stats();
+      serial_stats.timeouts += channel_stats.timeouts;
+      serial_stats.corrupt += channel_stats.corrupt;
+    }
+  }
+  cout << serial_stats.timeouts << " serial timeouts, " << serial_stats.corrupt << " corrupt frames\n";
+
+  for ( const auto& result : results ) {
+    const string path = results.size() > 1 ? mode_path( config.stats_path, result.actual ) : config.stats_path;
+    cout << "Latency over all trials in " << result.actual.name() << ":\n";
+    result.stats.latency.summary( cout );
+    ofstream saved_stats( path );
+    result.stats.latency.save( saved_stats );
+    cout << "Histograms saved to " << path << " (see stats_merge)\n";
+  }
+  if ( config.sweep ) {
+    print_sweep( results );
+  }
+
+  record_log.flush();
+  const RecordLogStats log_stats = record_log.stats();
+  cout << log_stats.records << " records (" << log_stats.bytes << " bytes) in " << config.log_path << ", "
+       << log_stats.dropped << " dropped\n";
 
   return 0;
 }
 
-void program_body()
+void usage( const char* argv0 )
+{
+  cerr << "Usage: " << argv0 << " [options]\n"
+       << "  -r, --rate=HZ         gaze sample rate: 500, 1000 (default) or 2000\n"
+       << "  -s, --synthetic       use a synthetic gaze source instead of the EyeLink\n"
+       << "  -n, --noise=PX        synthetic fixation noise (std. deviation in pixels)\n"
+       << "  -o, --onset=MS        synthetic saccade onset after the start of recording\n"
+       << "  -d, --dropout=P       probability that a synthetic sample is dropped\n"
+       << "  -m, --missing=P       probability that a synthetic sample has no pupil\n"
+       << "  -v, --velocity=PX/S   gaze speed over 4 ms that triggers the display (default 5000)\n"
+       << "  -x, --extrapolate     trigger early when the acceleration predicts the threshold\n"
+       << "  -P, --patches         draw the squares with scissored clears instead of full-screen textures\n"
+       << "      --paced           vsync, and submit clock frames just before the predicted vblank\n"
+       << "      --no-interrupt    let a clock frame's GPU wait finish before drawing the triggered frame\n"
+       << "      --sync=MODE       wait for the GPU after each swap: finish (default), fence or none\n"
+       << "      --stimulus=FILE   stream a 4:2:0 .y4m video behind the squares\n"
+       << "      --serial=PATH     the Arduino's tty, or the asg_emulator's pty (default " SERIAL "); with\n"
+       << "                        several displays, a comma-separated list of their Arduinos, in order\n"
+       << "      --display=LIST    comma-separated monitors to draw on, each on its own thread (default 0,\n"
+       << "                        the primary); all are triggered together\n"
+       << "      --list-displays   list the connected monitors and their video modes, and exit\n"
+       << "      --mode=WxH[@HZ]   switch the displays to this video mode (default 1920x1080 at the highest rate)\n"
+       << "      --sweep[=MIN_HZ]  run the trials in each of the first display's video modes (at MIN_HZ or\n"
+       << "                        more) in turn, and tabulate latency by mode in mode_sweep.csv\n"
+       << "  -t, --trials=N        number of trials to run (default 1)\n"
+       << "      --log=FILE        record log to write (default trials.gdl; see log_export)\n"
+       << "      --report=N        print latency percentiles every N trials (default 10, 0 for never)\n"
+       << "      --stats=FILE      save the latency histograms here (default latency.hdr; see stats_merge)\n"
+       << "      --baud=RATE       serial rate to the Arduino (default 1000000)\n"
+       << "      --threshold=N     photodiode ADC level (0-1023) the Arduino treats as the display change\n"
+       << "      --waveform        fetch the photodiode waveform and time the edge by its 50% point\n"
+       << "  -p, --poll=MODE       how idle threads wait: spin (default), pause, yield or block\n"
+       << "      --cpu-acquire=N   pin the sample acquisition thread to CPU N\n"
+       << "      --cpu-detect=N    pin the trigger loop to CPU N\n"
+       << "      --cpu-render=N    pin the display thread to CPU N (the i-th display's to N+i)\n"
+       << "      --cpu-serial=N    pin the serial I/O thread to CPU N (the i-th Arduino's to N+i)\n"
+       << "      --rt[=PRIO]       lock memory and run the pipeline SCHED_FIFO (default priority 80),\n"
+       << "                        on the isolated CPUs where not pinned by hand (needs CAP_SYS_NICE)\n";
+}
+
+void program_body( int argc, char* argv[] )
 {
-  if ( initialize_eyelink() < 0 ) {
-    cerr << "[Error] Unable to initialize EyeLink.\n";
+  ExperimentConfig config;
+
+  enum
+  {
+    OPT_CPU_ACQUIRE = 256,
+    OPT_CPU_DETECT,
+    OPT_CPU_RENDER,
+    OPT_CPU_SERIAL,
+    OPT_RT,
+    OPT_STIMULUS,
+    OPT_PACED,
+    OPT_NO_INTERRUPT,
+    OPT_SYNC,
+    OPT_SERIAL,
+    OPT_DISPLAY,
+    OPT_LIST_DISPLAYS,
+    OPT_MODE,
+    OPT_SWEEP,
+    OPT_BAUD,
+    OPT_THRESHOLD,
+    OPT_WAVEFORM,
+    OPT_LOG,
+    OPT_REPORT,
+    OPT_STATS,
+  };
+
+  const option long_options[] = { { "rate", required_argument, nullptr, 'r' },
+                                  { "synthetic", no_argument, nullptr, 's' },
+                                  { "noise", required_argument, nullptr, 'n' },
+                                  { "onset", required_argument, nullptr, 'o' },
+                                  { "dropout", required_argument, nullptr, 'd' },
+                                  { "missing", required_argument, nullptr, 'm' },
+                                  { "velocity", required_argument, nullptr, 'v' },
+                                  { "extrapolate", no_argument, nullptr, 'x' },
+                                  { "patches", no_argument, nullptr, 'P' },
+                                  { "paced", no_argument, nullptr, OPT_PACED },
+                                  { "no-interrupt", no_argument, nullptr, OPT_NO_INTERRUPT },
+                                  { "sync", required_argument, nullptr, OPT_SYNC },
+                                  { "stimulus", required_argument, nullptr, OPT_STIMULUS },
+                                  { "serial", required_argument, nullptr, OPT_SERIAL },
+                                  { "display", required_argument, nullptr, OPT_DISPLAY },
+                                  { "list-displays", no_argument, nullptr, OPT_LIST_DISPLAYS },
+                                  { "mode", required_argument, nullptr, OPT_MODE },
+                                  { "sweep", optional_argument, nullptr, OPT_SWEEP },
+                                  { "trials", required_argument, nullptr, 't' },
+                                  { "baud", required_argument, nullptr, OPT_BAUD },
+                                  { "threshold", required_argument, nullptr, OPT_THRESHOLD },
+                                  { "waveform", no_argument, nullptr, OPT_WAVEFORM },
+                                  { "log", required_argument, nullptr, OPT_LOG },
+                                  { "report", required_argument, nullptr, OPT_REPORT },
+                                  { "stats", required_argument, nullptr, OPT_STATS },
+                                  { "poll", required_argument, nullptr, 'p' },
+                                  { "cpu-acquire", required_argument, nullptr, OPT_CPU_ACQUIRE },
+                                  { "cpu-detect", required_argument, nullptr, OPT_CPU_DETECT },
+                                  { "cpu-render", required_argument, nullptr, OPT_CPU_RENDER },
+                                  { "cpu-serial", required_argument, nullptr, OPT_CPU_SERIAL },
+                                  { "rt", optional_argument, nullptr, OPT_RT },
+                                  { "help", no_argument, nullptr, 'h' },
+                                  { nullptr, 0, nullptr, 0 } };
+
+  while ( true ) {
+    const int opt = getopt_long( argc, argv, "r:sn:o:d:m:v:xPt:p:h", long_options, nullptr );
+    if ( opt == -1 ) {
+      break;
+    }
+
+    switch ( opt ) {
+      case 'r':
+        config.synthetic_config.rate_hz = stoul( optarg );
+        break;
+      case 's':
+        config.synthetic = true;
+        break;
+      case 'n':
+        config.synthetic_config.noise_px = stof( optarg );
+        break;
+      case 'o':
+        config.synthetic_config.saccade_onsets = { microseconds( lround( stod( optarg ) * 1000 ) ) };
+        break;
+      case 'd':
+        config.synthetic_config.drop_probability = stod( optarg );
+        break;
+      case 'm':
+        config.synthetic_config.missing_probability = stod( optarg );
+        break;
+      case 'v':
+        config.detector_config.velocity_threshold = stof( optarg );
+        break;
+      case 'x':
+        config.detector_config.extrapolate = true;
+        break;
+      case 'P':
+        config.patches = true;
+        break;
+      case OPT_PACED:
+        config.paced = true;
+        break;
+      case OPT_NO_INTERRUPT:
+        config.interrupt_clock = false;
+        break;
+      case OPT_SYNC:
+        config.sync_mode = parse_sync_mode( optarg );
+        break;
+      case OPT_STIMULUS:
+        config.stimulus = optarg;
+        break;
+      case OPT_SERIAL:
+        config.serials = split_list( optarg );
+        break;
+      case OPT_DISPLAY:
+        config.displays.clear();
+        for ( const auto& monitor : split_list( optarg ) ) {
+          config.displays.push_back( stoul( monitor ) );
+        }
+        break;
+      case OPT_LIST_DISPLAYS: {
+        GLFWContext glfw;
+        const vector<string> monitors = Window::monitor_names();
+        for ( size_t i = 0; i < monitors.size(); i++ ) {
+          cout << i << ": " << monitors[i] << ( i == 0 ? " (primary)" : "" ) << "\n  modes:";
+          for ( const auto& mode : Window::video_modes( i ) ) {
+            cout << " " << mode.name();
+          }
+          cout << "\n";
+        }
+        exit( EXIT_SUCCESS );
+      }
+      case OPT_MODE:
+        config.mode = parse_display_mode( optarg );
+        break;
+      case OPT_SWEEP:
+        config.sweep = true;
+        config.sweep_min_hz = optarg ? stoul( optarg ) : 0;
+        break;
+      case 't':
+        config.trials = stoul( optarg );
+        break;
+      case OPT_BAUD:
+        config.baud = stoul( optarg );
+        break;
+      case OPT_THRESHOLD:
+        config.asg_threshold = stoul( optarg );
+        break;
+      case OPT_WAVEFORM:
+        config.waveform = true;
+        break;
+      case OPT_LOG:
+        config.log_path = optarg;
+        break;
+      case OPT_REPORT:
+        config.report_every = stoul( optarg );
+        break;
+      case OPT_STATS:
+        config.stats_path = optarg;
+        break;
+      case 'p':
+        config.poll_mode = parse_poll_mode( optarg );
+        break;
+      case OPT_CPU_ACQUIRE:
+        config.acquire_thread.cpu = stoi( optarg );
+        break;
+      case OPT_CPU_DETECT:
+        config.detect_thread.cpu = stoi( optarg );
+        break;
+      case OPT_CPU_RENDER:
+        config.render_thread.cpu = stoi( optarg );
+        break;
+      case OPT_CPU_SERIAL:
+        config.serial_thread.cpu = stoi( optarg );
+        break;
+      case OPT_RT:
+        config.realtime_priority = optarg ? stoi( optarg ) : 80;
+        break;
+      default:
+        usage( argv[0] );
+        exit( opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE );
+    }
+  }
+
+  if ( config.displays.empty() or config.serials.empty() or config.serials.size() > config.displays.size() ) {
+    cerr << "[Error] Need one or more displays, and an Arduino for the first (and at most one for each).\n";
     exit( EXIT_FAILURE );
   }
-  run_trials();
+
+  config.detector_config.rate_hz = config.synthetic_config.rate_hz;
+
+  if ( config.realtime_priority > 0 ) {
+    make_realtime( config );
+    lock_memory();
+  }
+
+  unique_ptr<GazeSource> source;
+  if ( config.synthetic ) {
+    source = make_unique<SyntheticGazeSource>( config.synthetic_config );
+  } else {
+    if ( initialize_eyelink( config.synthetic_config.rate_hz, config.mode ) < 0 ) {
+      cerr << "[Error] Unable to initialize EyeLink.\n";
+      exit( EXIT_FAILURE );
+    }
+    source = make_unique<EyeLinkGazeSource>( config.synthetic_config.rate_hz );
+  }
+
+  run_trials( *source, config );
 }
 
-int main()
+int main( int argc, char* argv[] )
 {
   try {
-    program_body();
+    program_body( argc, argv );
   } catch ( const exception& e ) {
     cerr << "Exception: " << e.what() << "\n";
     return EXIT_FAILURE;
@@ -0,0 +1,106 @@
+#include <iostream>
+
+#include "eyelink_source.hh"
+
+using namespace std;
+
+bool EyeLinkGazeSource::start()
+{
+  // Ensure Eyelink has enough time to switch modes
+  set_offline_mode();
+  pump_delay( 50 );
+
+  // Start data streaming
+  // Note that we are ignoring the EDF file.
+  if ( start_recording( 0, 0, 1, 1 ) != 0 ) {
+    return false;
+  }
+
+  // wait for link sample data
+  if ( !eyelink_wait_for_block_start( 100, 1, 0 ) ) {
+    stop();
+    cerr << "ERROR: No link samples received!\n";
+    return false;
+  }
+
+  // determine which eye(s) are available; use the left eye when both are
+  eye_used_ = eyelink_eye_available();
+  if ( eye_used_ != 0 && eye_used_ != 1 ) {
+    eye_used_ = 0;
+  }
+
+  // reset keys and buttons from tracker
+  eyelink_flush_keybuttons( 0 );
+
+  return true;
+}
+
+/**
+ * End recording: adds 100 msec of data to catch final events
+ */
+void EyeLinkGazeSource::stop()
+{
+  pump_delay( 100 ); // provide a small amount of delay for last data
+  stop_recording();
+  while ( getkey() ) {
+  };
+}
+
+bool EyeLinkGazeSource::connected() const
+{
+  return eyelink_is_connected() != 0 && !break_pressed();
+}
+
+void EyeLinkGazeSource::convert( GazeSample& sample ) const
+{
+  sample.tracker_time_us = uint64_t( evt_.fs.time ) * 1000;
+  sample.x = evt_.fs.gx[eye_used_];
+  sample.y = evt_.fs.gy[eye_used_];
+
+  // make sure pupil is present
+  const bool present = sample.x != MISSING_DATA && sample.y != MISSING_DATA && evt_.fs.pa[eye_used_] > 0;
+  sample.pupil = present ? evt_.fs.pa[eye_used_] : 0;
+}
+
+bool EyeLinkGazeSource::newest_sample( GazeSample& sample )
+{
+  if ( eyelink_newest_float_sample( NULL ) > 0 ) {
+    eyelink_newest_float_sample( &evt_ );
+    convert( sample );
+    return true;
+  }
+  return false;
+}
+
+bool EyeLinkGazeSource::next_sample( GazeSample& sample )
+{
+  // drain the link queue in order, skipping over events
+  while ( true ) {
+    const int type = eyelink_get_next_data( NULL );
+    if ( type == 0 ) {
+      return false;
+    }
+
+    if ( type == SAMPLE_TYPE ) {
+      eyelink_get_float_data( &evt_ );
+      convert( sample );
+      return true;
+    }
+  }
+}
+
+bool EyeLinkGazeSource::request_time()
+{
+  return eyelink_request_time() == 0;
+}
+
+bool EyeLinkGazeSource::read_time( uint64_t& tracker_time_us )
+{
+  const UINT32 time = eyelink_read_time();
+  if ( time == 0 ) {
+    return false; /* not answered yet */
+  }
+
+  tracker_time_us = uint64_t( time ) * 1000;
+  return true;
+}
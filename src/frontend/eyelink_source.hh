@@ -0,0 +1,34 @@
+#pragma once
+
+#include <core_expt.h>
+#include <eyelink.h>
+
+#include "gaze_source.hh"
+
+/* Gaze samples streamed over the link from a live EyeLink tracker */
+class EyeLinkGazeSource : public GazeSource
+{
+  ALLF_DATA evt_ {};
+  int eye_used_ = 0;
+  unsigned int sample_rate_;
+
+  void convert( GazeSample& sample ) const;
+
+public:
+  /* sample_rate must match the tracker's "sample_rate" setting */
+  explicit EyeLinkGazeSource( const unsigned int sample_rate )
+    : sample_rate_( sample_rate )
+  {}
+
+  bool start() override;
+  void stop() override;
+  bool connected() const override;
+  bool newest_sample( GazeSample& sample ) override;
+  bool next_sample( GazeSample& sample ) override;
+  unsigned int sample_rate() const override { return sample_rate_; }
+
+  /* eyelink_request_time() and eyelink_read_time(), which have 1 ms resolution */
+  bool request_time() override;
+  bool read_time( uint64_t& tracker_time_us ) override;
+  unsigned int time_resolution_us() const override { return 1000; }
+};
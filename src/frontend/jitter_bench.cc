@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <time.h>
+#include <unistd.h>
+
+#include "hdr_histogram.hh"
+#include "threads.hh"
+
+#define INTERVAL_US 1000          /* timer period, as in cyclictest's default */
+#define BUFFER_BYTES ( 64 << 20 ) /* touched a page per timer wakeup */
+#define STACK_BYTES ( 256 * 1024 )
+
+using namespace std;
+using namespace std::chrono;
+
+static int64_t now_ns()
+{
+  timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return int64_t( ts.tv_sec ) * 1000000000 + ts.tv_nsec;
+}
+
+struct Jitter
+{
+  HdrHistogram wakeup {}; /* how late each timer wakeup was */
+  HdrHistogram touch {};  /* writing one byte to a page of a buffer not used before */
+  HdrHistogram spin {};   /* gap between successive clock reads in a busy loop */
+
+  static void print_row( const char* name, const HdrHistogram& histogram )
+  {
+    if ( histogram.count() == 0 ) {
+      printf( "  %-14s %8s\n", name, "skipped" );
+      return;
+    }
+    printf( "  %-14s %8.1f %8.1f %8.1f %8.1f %8.1f us\n",
+            name,
+            histogram.percentile( 0.5 ) / 1e3,
+            histogram.percentile( 0.99 ) / 1e3,
+            histogram.percentile( 0.999 ) / 1e3,
+            histogram.percentile( 0.9999 ) / 1e3,
+            histogram.max() / 1e3 );
+  }
+
+  void print() const
+  {
+    printf( "  %-14s %8s %8s %8s %8s %8s\n", "", "p50", "p99", "p99.9", "p99.99", "max" );
+    print_row( "timer wakeup", wakeup );
+    print_row( "page touch", touch );
+    print_row( "spin gap", spin );
+  }
+};
+
+/* Like cyclictest: sleep to absolute deadlines every INTERVAL_US and record
+   how late each wakeup is, touching a new page of the buffer each time;
+   then, if `spin`, spin for the same time recording every gap between clock
+   reads (the time the thread was preempted or interrupted). */
+static Jitter measure( const seconds duration, char* const buffer, const bool spin )
+{
+  Jitter ret;
+  const long page = sysconf( _SC_PAGESIZE );
+  size_t offset = 0;
+
+  timespec deadline;
+  clock_gettime( CLOCK_MONOTONIC, &deadline );
+  const int64_t timer_end = now_ns() + duration_cast<nanoseconds>( duration ).count() / 2;
+  while ( true ) {
+    deadline.tv_nsec += INTERVAL_US * 1000;
+    if ( deadline.tv_nsec >= 1000000000 ) {
+      deadline.tv_nsec -= 1000000000;
+      deadline.tv_sec++;
+    }
+    clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr );
+
+    const int64_t woke = now_ns();
+    ret.wakeup.add( max<int64_t>( 0, woke - ( int64_t( deadline.tv_sec ) * 1000000000 + deadline.tv_nsec ) ) );
+
+    static_cast<volatile char*>( buffer )[offset] = 1;
+    ret.touch.add( now_ns() - woke );
+    offset = ( offset + page ) % BUFFER_BYTES;
+
+    if ( woke >= timer_end ) {
+      break;
+    }
+  }
+
+  if ( not spin ) {
+    return ret;
+  }
+
+  const int64_t spin_end = now_ns() + duration_cast<nanoseconds>( duration ).count() / 2;
+  int64_t previous = now_ns();
+  while ( previous < spin_end ) {
+    const int64_t now = now_ns();
+    ret.spin.add( now - previous );
+    previous = now;
+  }
+
+  return ret;
+}
+
+int main( int argc, char* argv[] )
+{
+  if ( argc > 4 ) {
+    fprintf( stderr, "Usage: %s [seconds per run] [cpu] [SCHED_FIFO priority]\n", argv[0] );
+    return EXIT_FAILURE;
+  }
+
+  const seconds duration( argc > 1 ? stoul( argv[1] ) : 10 );
+  ThreadProfile profile;
+  const vector<int> isolated = isolated_cpus();
+  profile.cpu = argc > 2 ? stoi( argv[2] ) : ( isolated.empty() ? -1 : isolated.front() );
+  profile.priority = argc > 3 ? stoi( argv[3] ) : 80;
+  profile.stack = STACK_BYTES;
+
+  printf( "%ld s per run, %d us timer; %zu isolated CPUs\n", long( duration.count() ), INTERVAL_US, isolated.size() );
+
+  /* The default: an unpinned SCHED_OTHER thread, taking page faults on
+     first touch */
+  {
+    const unique_ptr<char[]> buffer( new char[BUFFER_BYTES] ); /* mapped, but not yet faulted in */
+    const Jitter jitter = measure( duration, buffer.get(), true );
+    printf( "Default scheduling:\n" );
+    jitter.print();
+  }
+
+  /* The real-time profile, as far as this process is allowed it */
+  const string where = profile.cpu < 0 ? "unpinned" : "on CPU " + to_string( profile.cpu );
+  string applied = "SCHED_FIFO " + to_string( profile.priority ) + " " + where;
+  bool realtime = true;
+  try {
+    apply_thread_profile( profile );
+  } catch ( const exception& e ) {
+    fprintf( stderr, "%s (needs CAP_SYS_NICE or an rtprio limit); measuring with pinning only\n", e.what() );
+    pin_this_thread( profile.cpu );
+    applied = "SCHED_OTHER " + where;
+    realtime = false;
+  }
+
+  /* A SCHED_FIFO busy loop starves everything else on its CPU, so, as in
+     example's --rt, only spin on a CPU the kernel keeps free */
+  const bool spin = not realtime or count( isolated.begin(), isolated.end(), profile.cpu ) == 1;
+  if ( not spin ) {
+    fprintf( stderr, "Not on an isolated CPU: skipping the SCHED_FIFO spin (see isolcpus)\n" );
+  }
+  try {
+    lock_memory();
+    applied += ", memory locked";
+  } catch ( const exception& e ) {
+    fprintf( stderr, "%s (needs CAP_IPC_LOCK or a memlock limit); prefaulting only\n", e.what() );
+    applied += ", buffer prefaulted";
+  }
+
+  {
+    const unique_ptr<char[]> buffer( new char[BUFFER_BYTES] );
+    prefault( buffer.get(), BUFFER_BYTES );
+    const Jitter jitter = measure( duration, buffer.get(), spin );
+    printf( "Real-time profile (%s):\n", applied.c_str() );
+    jitter.print();
+  }
+
+  unlock_memory();
+  return EXIT_SUCCESS;
+}
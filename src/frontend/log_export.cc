@@ -0,0 +1,73 @@
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "record_log.hh"
+
+using namespace std;
+
+/* Writes each table of a record log (as written by example) to TABLE.csv,
+   the form scripts/analysis/analysis.py reads */
+void export_tables( const string& path, const string& directory )
+{
+  RecordLogReader reader( path );
+  map<uint32_t, unique_ptr<ofstream>> outputs;
+  map<uint32_t, uint64_t> rows;
+
+  uint32_t id;
+  vector<vector<int64_t>> columns;
+  while ( reader.next( id, columns ) ) {
+    const RecordLogReader::Table& table = reader.tables().at( id );
+    auto& out = outputs[id];
+    if ( not out ) {
+      const string csv = directory + table.name + ".csv";
+      out = make_unique<ofstream>( csv );
+      if ( not *out ) {
+        throw runtime_error( "could not create " + csv );
+      }
+
+      for ( size_t i = 0; i < table.columns.size(); i++ ) {
+        *out << ( i ? "," : "" ) << table.columns[i];
+      }
+      *out << "\n";
+    }
+
+    for ( size_t row = 0; row < columns.front().size(); row++ ) {
+      for ( size_t i = 0; i < columns.size(); i++ ) {
+        *out << ( i ? "," : "" );
+        if ( columns[i][row] != RecordLog::NO_VALUE ) {
+          *out << columns[i][row];
+        }
+      }
+      *out << "\n";
+    }
+    rows[id] += columns.front().size();
+  }
+
+  for ( const auto& [table, count] : rows ) {
+    cout << directory << reader.tables().at( table ).name << ".csv: " << count << " rows\n";
+  }
+}
+
+int main( int argc, char* argv[] )
+{
+  if ( argc < 2 or argc > 3 ) {
+    cerr << "Usage: " << argv[0] << " LOG [DIRECTORY]\n";
+    return EXIT_FAILURE;
+  }
+
+  try {
+    export_tables( argv[1], argc == 3 ? string( argv[2] ) + "/" : "" );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "hdr_histogram.hh"
+#include "stimulus_renderer.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+/* trigger the renderer at random times and collect trigger-to-present latency
+   (and how long the render thread took to notice the trigger) */
+void run( const string& name,
+          const RendererConfig& config,
+          const unsigned int trials,
+          const microseconds min_delay = milliseconds( 20 ),
+          const microseconds max_delay = milliseconds( 60 ) )
+{
+  StimulusRenderer renderer( config );
+  mt19937 rng( 1 );
+  uniform_int_distribution<int64_t> delay_us( min_delay.count(), max_delay.count() );
+
+  HdrHistogram latencies, observe; /* ns */
+  unsigned int interrupted = 0, locked = 0;
+  uint64_t clock_frames = 0, vblanks = 0;
+  for ( unsigned int i = 0; i < trials; i++ ) {
+    renderer.arm();
+    this_thread::sleep_for( microseconds( delay_us( rng ) ) );
+    renderer.trigger();
+
+    const TrialDrawResult result = renderer.wait();
+    if ( result.trigger_to_present.count() > 0 ) {
+      latencies.add( result.trigger_to_present.count() );
+    }
+    observe.add( max<int64_t>( 0, result.trigger_observe.count() ) );
+    interrupted += result.clock_interrupted;
+    locked += result.pacer_locked;
+    clock_frames += result.clock_frames;
+    vblanks += result.pacer_vblanks;
+  }
+
+  if ( latencies.count() == 0 ) {
+    printf( "  %-22s no frame timings recorded\n", name.c_str() );
+    return;
+  }
+
+  printf( "  %-22s mean %8.1f  sd %7.1f  p50 %8.1f  p99 %8.1f  max %8.1f us  (%zu trials)\n",
+          name.c_str(),
+          latencies.mean() / 1e3,
+          latencies.stddev() / 1e3,
+          latencies.percentile( 0.5 ) / 1e3,
+          latencies.percentile( 0.99 ) / 1e3,
+          latencies.max() / 1e3,
+          size_t( latencies.count() ) );
+  printf( "  %-22s observe p50 %6.1f  p99 %8.1f  max %8.1f us  (%u clock frame waits interrupted)\n",
+          "",
+          observe.percentile( 0.5 ) / 1e3,
+          observe.percentile( 0.99 ) / 1e3,
+          observe.max() / 1e3,
+          interrupted );
+  if ( config.paced ) {
+    printf( "  %-22s pacer locked at %u of %u triggers, corrected by %llu of %llu clock frames\n",
+            "",
+            locked,
+            trials,
+            static_cast<unsigned long long>( vblanks ),
+            static_cast<unsigned long long>( clock_frames ) );
+  }
+}
+
+int main( int argc, char* argv[] )
+{
+  if ( argc > 3 ) {
+    fprintf( stderr, "Usage: %s [trials] [fullscreen (0/1)]\n", argv[0] );
+    return EXIT_FAILURE;
+  }
+
+  const unsigned int trials = argc > 1 ? stoul( argv[1] ) : 200;
+
+  RendererConfig config;
+  config.fullscreen = argc > 2 ? stoi( argv[2] ) : true;
+
+  printf( "Trigger to present (GPU completion, or present() returning for none), triggers at random times:\n" );
+
+  config.paced = false;
+  for ( const auto mode : { SyncMode::Finish, SyncMode::Fence, SyncMode::None } ) {
+    config.sync_mode = mode;
+    run( "timer/" + sync_mode_name( mode ), config, trials );
+  }
+
+  config.paced = true;
+  config.sync_mode = SyncMode::Finish;
+  run( "paced/finish", config, trials );
+
+  /* clock frames (each an interruptible wait) must keep the pacer locked through long trials */
+  run( "paced/finish, long", config, max( trials / 10, 1u ), milliseconds( 500 ), milliseconds( 1500 ) );
+
+  /* the same finish-mode loops, but the trigger waits out the clock frame's glFinish */
+  config.interrupt_clock = false;
+  config.paced = false;
+  run( "timer/finish, no abort", config, trials );
+  config.paced = true;
+  run( "paced/finish, no abort", config, trials );
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "display.hh"
+#include "frame_stream.hh"
+#include "hdr_histogram.hh"
+#include "y4m_reader.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+int main( int argc, char* argv[] )
+{
+  if ( argc < 2 or argc > 6 ) {
+    fprintf( stderr,
+             "Usage: %s FILE.y4m [seconds] [buffers (2 or 3)] [fullscreen (0/1)] [swap interval]\n",
+             argv[0] );
+    return EXIT_FAILURE;
+  }
+
+  const double run_seconds = argc > 2 ? stod( argv[2] ) : 10;
+  const unsigned int depth = argc > 3 ? stoul( argv[3] ) : 3;
+  const bool fullscreen = argc > 4 ? stoi( argv[4] ) : true;
+  const int swap_interval = argc > 5 ? stoi( argv[5] ) : 1;
+
+  Y4MReader reader( argv[1] );
+  printf( "%s: %ux%u, %zu frames at %.2f fps\n",
+          argv[1],
+          reader.width(),
+          reader.height(),
+          reader.frame_count(),
+          reader.frame_rate() );
+
+  VideoDisplay display { reader.width(), reader.height(), fullscreen };
+  display.window().hide_cursor( true );
+  display.window().set_swap_interval( swap_interval );
+  const int refresh_rate = display.window().refresh_rate();
+
+  FrameStream stream( reader, depth );
+  Texture420* frame = stream.next();
+
+  HdrHistogram next, interval; /* ns */
+  uint64_t presented = 0, repeated_before = 0, shown_before = 0;
+
+  const auto start = steady_clock::now();
+  auto report_time = start, last_present = start;
+
+  while ( true ) {
+    const auto t1 = steady_clock::now();
+    Texture420* const next_frame = stream.next();
+    next.add( duration_cast<nanoseconds>( steady_clock::now() - t1 ).count() );
+    if ( next_frame ) {
+      frame = next_frame;
+    }
+
+    display.draw( *frame );
+    presented++;
+
+    const auto now = steady_clock::now();
+    interval.add( duration_cast<nanoseconds>( now - last_present ).count() );
+    last_present = now;
+
+    if ( now - report_time >= seconds( 1 ) ) {
+      const double elapsed = duration<double>( now - report_time ).count();
+      const auto& stats = stream.stats();
+      printf( "%6.1f fps presented, %6.1f new frames/s (display %d Hz), %llu repeated\n",
+              presented / elapsed,
+              ( stats.shown - shown_before ) / elapsed,
+              refresh_rate,
+              static_cast<unsigned long long>( stats.repeated - repeated_before ) );
+      shown_before = stats.shown;
+      repeated_before = stats.repeated;
+      presented = 0;
+      report_time = now;
+    }
+
+    if ( now - start >= duration<double>( run_seconds ) ) {
+      break;
+    }
+  }
+
+  const double elapsed = duration<double>( steady_clock::now() - start ).count();
+  const auto& stats = stream.stats();
+
+  printf( "Sustained %.1f new frames/s over %.1f s against a %d Hz display (%llu shown, %llu repeated)\n",
+          stats.shown / elapsed,
+          elapsed,
+          refresh_rate,
+          static_cast<unsigned long long>( stats.shown ),
+          static_cast<unsigned long long>( stats.repeated ) );
+  printf( "Frame interval p50 %.1f us, p99 %.1f us, max %.1f us\n",
+          interval.percentile( 0.5 ) / 1e3,
+          interval.percentile( 0.99 ) / 1e3,
+          interval.max() / 1e3 );
+  printf( "Render-thread stream cost p50 %.1f us, p99 %.1f us, max %.1f us\n",
+          next.percentile( 0.5 ) / 1e3,
+          next.percentile( 0.99 ) / 1e3,
+          next.max() / 1e3 );
+
+  return EXIT_SUCCESS;
+}
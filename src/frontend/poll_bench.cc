@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <string>
+
+#include "gaze_source.hh"
+#include "hdr_histogram.hh"
+#include "poller.hh"
+#include "saccade_detector.hh"
+#include "sample_acquisition.hh"
+#include "threads.hh"
+
+#define SACCADE_INTERVAL_MS 100
+#define SAMPLE_BATCH 64
+
+using namespace std;
+using namespace std::chrono;
+
+void run_mode( const PollMode mode,
+               const unsigned int rate_hz,
+               const seconds duration,
+               const int acquire_cpu,
+               const int detect_cpu )
+{
+  SyntheticGazeConfig config;
+  config.rate_hz = rate_hz;
+  config.saccade_onsets.clear();
+  for ( unsigned int n = 1; n * SACCADE_INTERVAL_MS < duration_cast<milliseconds>( duration ).count(); n++ ) {
+    config.saccade_onsets.push_back( milliseconds( n * SACCADE_INTERVAL_MS ) );
+  }
+
+  SyntheticGazeSource source( config );
+  SampleAcquisition acquisition( source, 4096, mode, ThreadProfile { acquire_cpu } );
+  SaccadeDetectorConfig detector_config;
+  detector_config.rate_hz = rate_hz;
+  SaccadeDetector detector( detector_config );
+  Poller poller( mode, &acquisition.data_ready() );
+
+  HdrHistogram pickup, observe, detect; /* ns */
+  TimedSample batch[SAMPLE_BATCH];
+  size_t next_onset = 0;
+
+  pin_this_thread( detect_cpu );
+  source.start();
+  acquisition.start();
+
+  const auto start_cpu = thread_cpu_time();
+  const auto end_time = source.start_time() + duration;
+
+  while ( steady_clock::now() < end_time ) {
+    const uint32_t seen = acquisition.data_ready().sequence();
+    const size_t count = acquisition.read( batch, SAMPLE_BATCH );
+    if ( count == 0 ) {
+      poller.idle( seen );
+      continue;
+    }
+    poller.reset();
+
+    const auto now = steady_clock::now();
+    for ( size_t i = 0; i < count; i++ ) {
+      /* time from the sample being due to the acquisition thread taking it off the source */
+      const auto due = source.start_time() + microseconds( batch[i].sample.tracker_time_us );
+      pickup.add( max<int64_t>( 0, duration_cast<nanoseconds>( batch[i].arrival - due ).count() ) );
+
+      /* time from the sample leaving the source to the detector seeing it */
+      observe.add( duration_cast<nanoseconds>( now - batch[i].arrival ).count() );
+
+      if ( detector.add( batch[i].sample ) ) {
+        /* time from the true onset to the trigger, including sample quantisation */
+        const uint64_t t = batch[i].sample.tracker_time_us;
+        while ( next_onset + 1 < config.saccade_onsets.size()
+                && uint64_t( config.saccade_onsets[next_onset + 1].count() ) <= t ) {
+          next_onset++;
+        }
+        const auto onset = source.start_time() + config.saccade_onsets.at( next_onset );
+        detect.add( max<int64_t>( 0, duration_cast<nanoseconds>( now - onset ).count() ) );
+      }
+    }
+  }
+
+  const auto detect_cpu_time = thread_cpu_time() - start_cpu;
+  acquisition.stop();
+  source.stop();
+  const AcquisitionStats stats = acquisition.stats();
+
+  const double wall = duration_cast<nanoseconds>( duration ).count();
+  printf( "%-6s pickup p50 %7.1f p99 %7.1f us | observe p50 %7.1f p99 %7.1f p99.9 %7.1f max %8.1f us | "
+          "detect p50 %7.1f p99 %7.1f us (%zu) | CPU detect %5.1f%% acquire %5.1f%% | dropped %lu\n",
+          poll_mode_name( mode ).c_str(),
+          pickup.percentile( 0.5 ) / 1e3,
+          pickup.percentile( 0.99 ) / 1e3,
+          observe.percentile( 0.5 ) / 1e3,
+          observe.percentile( 0.99 ) / 1e3,
+          observe.percentile( 0.999 ) / 1e3,
+          observe.max() / 1e3,
+          detect.percentile( 0.5 ) / 1e3,
+          detect.percentile( 0.99 ) / 1e3,
+          size_t( detect.count() ),
+          100 * detect_cpu_time.count() / wall,
+          100 * stats.cpu_time.count() / wall,
+          stats.dropped );
+}
+
+int main( int argc, char* argv[] )
+{
+  if ( argc > 5 or ( argc > 1 and not isdigit( argv[1][0] ) ) ) {
+    fprintf( stderr, "Usage: %s [seconds per mode] [rate Hz] [acquire CPU] [detect CPU]\n", argv[0] );
+    return EXIT_FAILURE;
+  }
+
+  try {
+    const seconds duration( argc > 1 ? stoul( argv[1] ) : 5 );
+    const unsigned int rate_hz = argc > 2 ? stoul( argv[2] ) : 1000;
+    const int acquire_cpu = argc > 3 ? stoi( argv[3] ) : -1;
+    const int detect_cpu = argc > 4 ? stoi( argv[4] ) : -1;
+
+    printf( "Synthetic %u Hz source, %ld s per mode\n", rate_hz, long( duration.count() ) );
+
+    for ( const auto mode : { PollMode::Spin, PollMode::SpinPause, PollMode::SpinYield, PollMode::Block } ) {
+      run_mode( mode, rate_hz, duration, acquire_cpu, detect_cpu );
+    }
+  } catch ( const exception& e ) {
+    fprintf( stderr, "Exception: %s\n", e.what() );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,101 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+#include "frame_cache.hh"
+#include "gl_objects.hh"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define BOX_DIM 100
+#define REPETITIONS 20
+
+using namespace std;
+using namespace std::chrono;
+
+/* best-of-N wall time of one call, in microseconds */
+double time_us( const function<void()>& work )
+{
+  double best = 1e300;
+  for ( unsigned int i = 0; i < REPETITIONS; i++ ) {
+    const auto start = steady_clock::now();
+    work();
+    best = min( best, duration_cast<nanoseconds>( steady_clock::now() - start ).count() / 1000.0 );
+  }
+  return best;
+}
+
+/* the four clock/trigger frames, built pixel by pixel through Plane::at() */
+void build_per_pixel()
+{
+  for ( unsigned int frame = 0; frame < 4; frame++ ) {
+    Raster420 raster { WIDTH, HEIGHT };
+    const bool top = frame == 0 or frame == 2, bottom = frame >= 2;
+    for ( unsigned int y = 0; y < raster.Y.height(); y++ ) {
+      for ( unsigned int x = 0; x < raster.Y.width(); x++ ) {
+        const bool lit = x < BOX_DIM and ( ( top and y < BOX_DIM ) or ( bottom and y >= HEIGHT - BOX_DIM ) );
+        raster.Y.at( x, y ) = lit ? 235 : 16;
+      }
+    }
+  }
+}
+
+FramePattern pattern( const unsigned int frame )
+{
+  const LumaRect clock_box { 0, 0, BOX_DIM, BOX_DIM, 235 };
+  const LumaRect trigger_box { 0, HEIGHT - BOX_DIM, BOX_DIM, BOX_DIM, 235 };
+
+  switch ( frame ) {
+    case 0:
+      return { WIDTH, HEIGHT, 16, { clock_box } };
+    case 1:
+      return { WIDTH, HEIGHT, 16, {} };
+    case 2:
+      return { WIDTH, HEIGHT, 16, { clock_box, trigger_box } };
+    default:
+      return { WIDTH, HEIGHT, 16, { trigger_box } };
+  }
+}
+
+void report( const string& name, const double us )
+{
+  printf( "  %-36s %10.1f us\n", name.c_str(), us );
+}
+
+int main()
+{
+  printf( "Building the four %dx%d clock/trigger frames:\n", WIDTH, HEIGHT );
+
+  report( "per-pixel Plane::at()", time_us( build_per_pixel ) );
+
+  report( "fill + fill_rect", time_us( [] {
+            for ( unsigned int frame = 0; frame < 4; frame++ ) {
+              pattern( frame ).build();
+            }
+          } ) );
+
+  for ( unsigned int frame = 0; frame < 4; frame++ ) {
+    FrameCache::raster( pattern( frame ) );
+  }
+  report( "FrameCache hit", time_us( [] {
+            for ( unsigned int frame = 0; frame < 4; frame++ ) {
+              FrameCache::raster( pattern( frame ) );
+            }
+          } ) );
+
+  printf( "Pattern kernels (one %dx%d luma plane):\n", WIDTH, HEIGHT );
+
+  Plane plane { WIDTH, HEIGHT };
+  report( "checkerboard, per-pixel Plane::at()", time_us( [&] {
+            for ( unsigned int y = 0; y < HEIGHT; y++ ) {
+              for ( unsigned int x = 0; x < WIDTH; x++ ) {
+                plane.at( x, y ) = ( ( x / 8 + y / 8 ) % 2 ) ? 16 : 235;
+              }
+            }
+          } ) );
+  report( "checkerboard, fill_checkerboard", time_us( [&] { plane.fill_checkerboard( 8, 235, 16 ); } ) );
+  report( "vertical stripes, fill_stripes", time_us( [&] { plane.fill_stripes( 8, 235, 16, true ); } ) );
+
+  return EXIT_SUCCESS;
+}
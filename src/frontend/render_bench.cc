@@ -0,0 +1,125 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+
+#include "display.hh"
+#include "frame_cache.hh"
+#include "hdr_histogram.hh"
+#include "threads.hh"
+
+#define BOX_DIM 100
+
+using namespace std;
+using namespace std::chrono;
+
+/* Run `work` count times; report rate, wall time per call and CPU time per call */
+void measure( const string& name, const unsigned int count, const function<void( unsigned int )>& work )
+{
+  HdrHistogram wall; /* ns */
+
+  const auto cpu_start = thread_cpu_time();
+  const auto start = steady_clock::now();
+  for ( unsigned int i = 0; i < count; i++ ) {
+    const auto t1 = steady_clock::now();
+    work( i );
+    wall.add( duration_cast<nanoseconds>( steady_clock::now() - t1 ).count() );
+  }
+  const double elapsed = duration<double>( steady_clock::now() - start ).count();
+  const double cpu_us = duration_cast<nanoseconds>( thread_cpu_time() - cpu_start ).count() / 1000.0 / count;
+
+  printf( "  %-32s %9.1f /s  wall p50 %8.1f  p99 %8.1f us  CPU %8.1f us\n",
+          name.c_str(),
+          count / elapsed,
+          wall.percentile( 0.5 ) / 1e3,
+          wall.percentile( 0.99 ) / 1e3,
+          cpu_us );
+}
+
+/* bytes/s of `count` uploads of `bytes` each, including the wait for the last to land */
+void bandwidth( const string& name, const unsigned int count, const size_t bytes, const function<void()>& upload )
+{
+  const auto start = steady_clock::now();
+  for ( unsigned int i = 0; i < count; i++ ) {
+    upload();
+  }
+  glFinish();
+  const double elapsed = duration<double>( steady_clock::now() - start ).count();
+
+  printf( "  %-32s %9.1f MB/s  (%.1f us per frame)\n",
+          name.c_str(),
+          bytes * count / elapsed / 1e6,
+          elapsed * 1e6 / count );
+}
+
+int main( int argc, char* argv[] )
+{
+  if ( argc > 4 ) {
+    fprintf( stderr, "Usage: %s [frames] [width] [height]\n", argv[0] );
+    return EXIT_FAILURE;
+  }
+
+  const unsigned int count = argc > 1 ? stoul( argv[1] ) : 500;
+  const unsigned int width = argc > 2 ? stoul( argv[2] ) : 1920;
+  const unsigned int height = argc > 3 ? stoul( argv[3] ) : 1080;
+
+  VideoDisplay display { width, height, false, true };
+  printf( "Offscreen %ux%u on %s (%s)\n",
+          width,
+          height,
+          reinterpret_cast<const char*>( glGetString( GL_RENDERER ) ),
+          reinterpret_cast<const char*>( glGetString( GL_VERSION ) ) );
+
+  const LumaRect box_on { 0, 0, BOX_DIM, BOX_DIM, 235 }, box_off { 0, 0, BOX_DIM, BOX_DIM, 16 };
+  const FramePattern white { width, height, 16, { box_on } };
+  const FramePattern black { width, height, 16, { box_off } };
+
+  FrameCache frames;
+  Texture420& white_texture = frames.texture( white );
+  Texture420& black_texture = frames.texture( black );
+
+  printf( "Draws (toggling a %dx%d square):\n", BOX_DIM, BOX_DIM );
+  for ( const auto mode : { SyncMode::Finish, SyncMode::Fence, SyncMode::None } ) {
+    display.set_sync_mode( mode );
+    measure( "draw( Texture420 ), " + sync_mode_name( mode ), count, [&]( const unsigned int i ) {
+      display.draw( i % 2 ? white_texture : black_texture );
+    } );
+    measure( "draw( FramePattern ), " + sync_mode_name( mode ), count, [&]( const unsigned int i ) {
+      display.draw( i % 2 ? white : black );
+    } );
+    display.wait_idle();
+  }
+  display.set_sync_mode( SyncMode::Finish );
+
+  const auto raster = FrameCache::raster( white );
+  const size_t frame_bytes = size_t( width ) * height * 3 / 2;
+  Texture420 target( *raster );
+
+  printf( "Texture420 uploads (%.1f MB per frame):\n", frame_bytes / 1e6 );
+  bandwidth( "load() from memory", count, frame_bytes, [&] { target.load( *raster ); } );
+
+  PixelBufferObject buffer;
+  PixelUnpackBuffer::bind( buffer );
+  PixelUnpackBuffer::allocate( frame_bytes, GL_STREAM_DRAW );
+  bandwidth( "load_from_buffer() via PBO", count, frame_bytes, [&] {
+    void* const destination
+      = glMapBufferRange( PixelUnpackBuffer::id, 0, frame_bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+    if ( not destination ) {
+      throw runtime_error( "could not map pixel buffer" );
+    }
+    uint8_t* const planes = static_cast<uint8_t*>( destination );
+    memcpy( planes, raster->Y.pixels().data(), raster->Y.pixels().size() );
+    memcpy( planes + raster->Y.pixels().size(), raster->Cb.pixels().data(), raster->Cb.pixels().size() );
+    memcpy( planes + raster->Y.pixels().size() + raster->Cb.pixels().size(),
+            raster->Cr.pixels().data(),
+            raster->Cr.pixels().size() );
+    glUnmapBuffer( PixelUnpackBuffer::id );
+    target.load_from_buffer( 0 );
+  } );
+  PixelUnpackBuffer::unbind();
+
+  glCheck( "render_bench" );
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "asg_protocol.hh"
+#include "hdr_histogram.hh"
+#include "poller.hh"
+#include "serial_channel.hh"
+
+#define DROP_EVERY 10       /* in the latency run the fake device ignores every Nth request */
+#define WINDOW 32           /* requests kept in flight in the throughput run */
+#define CODEC_FRAMES 100000 /* frames through the encoder/decoder microbenchmark */
+#define REMOTE_SKEW_PPM 80.0 /* the fake device's clock runs this much fast */
+#define REMOTE_START_US ( ( 1ULL << 32 ) - 2000000 ) /* so its micros() wraps 2 s in */
+#define SYNC_SECONDS 3 /* idle time for the clock sync run */
+
+using namespace std;
+using namespace std::chrono;
+
+static const steady_clock::time_point remote_epoch = steady_clock::now();
+
+/* the fake device's clock, unwrapped */
+double true_remote_us( const steady_clock::time_point t )
+{
+  const double host_us = duration_cast<nanoseconds>( t - remote_epoch ).count() / 1000.0;
+  return REMOTE_START_US + host_us * ( 1 + REMOTE_SKEW_PPM / 1e6 );
+}
+
+/* what the fake device reports for a trial, so replies can be checked */
+uint32_t fake_latency_us( const uint32_t trial )
+{
+  return 5000 + trial % 4000;
+}
+
+/* Stands in for the Arduino on the master side of a pty: answers each
+   toggle frame with a result frame after `delay`, ignoring every
+   `drop_every`th request (0 drops none). Pings are answered from a clock
+   with a known offset and skew, with random delays on the way in and out. */
+void fake_device( const int master,
+                  const atomic<long>& delay_us,
+                  const atomic<unsigned int>& drop_every,
+                  const atomic<bool>& running )
+{
+  AsgDecoder decoder;
+  AsgFrame request;
+  unsigned int requests = 0;
+  mt19937 rng( 1 );
+  uniform_int_distribution<int> queueing_us( 0, 300 );
+
+  while ( running ) {
+    pollfd pfd { master, POLLIN, 0 };
+    if ( poll( &pfd, 1, 10 ) <= 0 ) {
+      continue;
+    }
+
+    const ssize_t length = read( master, decoder.write_ptr(), decoder.writable() );
+    decoder.commit( max<ssize_t>( length, 0 ) );
+    while ( decoder.next( request ) ) {
+      if ( request.type == AsgFrameType::Ping ) {
+        AsgFrame pong = request;
+        pong.type = AsgFrameType::Pong;
+        this_thread::sleep_for( microseconds( queueing_us( rng ) ) );
+        pong.toggle_us = uint32_t( llround( true_remote_us( steady_clock::now() ) ) );
+        pong.edge_us = uint32_t( llround( true_remote_us( steady_clock::now() ) ) );
+        this_thread::sleep_for( microseconds( queueing_us( rng ) ) );
+
+        uint8_t encoded[ASG_FRAME_SIZE];
+        asg_encode( pong, encoded );
+        if ( write( master, encoded, ASG_FRAME_SIZE ) < 0 ) {
+          throw runtime_error( string( "pty write: " ) + strerror( errno ) );
+        }
+        continue;
+      }
+
+      if ( request.type != AsgFrameType::Toggle ) {
+        continue;
+      }
+      if ( drop_every and ++requests % drop_every == 0 ) {
+        continue;
+      }
+
+      this_thread::sleep_for( microseconds( delay_us.load() ) );
+      AsgFrame reply = request;
+      reply.type = AsgFrameType::Result;
+      reply.toggle_us = request.trial * 1000;
+      reply.edge_us = reply.toggle_us + fake_latency_us( request.trial );
+
+      uint8_t encoded[ASG_FRAME_SIZE];
+      asg_encode( reply, encoded );
+      if ( write( master, encoded, ASG_FRAME_SIZE ) < 0 ) {
+        throw runtime_error( string( "pty write: " ) + strerror( errno ) );
+      }
+    }
+  }
+}
+
+bool valid_reply( const SerialReply& reply, const uint32_t sequence )
+{
+  return reply.sequence == sequence and reply.frame.trial == sequence
+         and reply.frame.latency_us() == fake_latency_us( sequence )
+         and reply.frame.threshold == ASG_DEFAULT_THRESHOLD;
+}
+
+/* encode/decode cost, and that a corrupted stream never yields a bad frame */
+bool codec_check()
+{
+  vector<uint8_t> stream( CODEC_FRAMES * ASG_FRAME_SIZE );
+  AsgFrame frame;
+
+  const auto encode_start = steady_clock::now();
+  for ( uint32_t i = 0; i < CODEC_FRAMES; i++ ) {
+    frame.trial = i;
+    frame.toggle_us = i * 3;
+    frame.edge_us = i * 3 + fake_latency_us( i );
+    asg_encode( frame, &stream[i * ASG_FRAME_SIZE] );
+  }
+  const auto encode_ns = duration_cast<nanoseconds>( steady_clock::now() - encode_start ).count();
+
+  /* feed the stream in read()-sized chunks */
+  const auto decode_all = [&]( const auto& on_frame ) {
+    AsgDecoder decoder;
+    for ( size_t offset = 0; offset < stream.size(); offset += 4096 ) {
+      decoder.append( &stream[offset], min<size_t>( 4096, stream.size() - offset ) );
+      while ( decoder.next( frame ) ) {
+        on_frame();
+      }
+    }
+    return decoder.corrupt();
+  };
+
+  unsigned int decoded = 0;
+  const auto decode_start = steady_clock::now();
+  decode_all( [&] { decoded++; } );
+  const auto decode_ns = duration_cast<nanoseconds>( steady_clock::now() - decode_start ).count();
+
+  /* flip one random bit in roughly every 50th frame */
+  srand( 1 );
+  vector<bool> damaged( CODEC_FRAMES, false );
+  for ( uint32_t i = 0; i < CODEC_FRAMES; i += 1 + rand() % 100 ) {
+    stream[i * ASG_FRAME_SIZE + rand() % ASG_FRAME_SIZE] ^= 1 << ( rand() % 8 );
+    damaged[i] = true;
+  }
+
+  unsigned int recovered = 0, bogus = 0;
+  const uint64_t rejected = decode_all( [&] {
+    const bool intact = frame.trial < CODEC_FRAMES and not damaged[frame.trial]
+                        and frame.latency_us() == fake_latency_us( frame.trial );
+    intact ? recovered++ : bogus++;
+  } );
+  const auto undamaged = count( damaged.begin(), damaged.end(), false );
+
+  printf( "codec: encode %.1f ns/frame, decode %.1f ns/frame (%u of %d frames)\n",
+          double( encode_ns ) / CODEC_FRAMES,
+          double( decode_ns ) / CODEC_FRAMES,
+          decoded,
+          CODEC_FRAMES );
+  printf( "  with %ld frames damaged: recovered %u of %ld intact, %llu rejected, %u accepted in error\n",
+          static_cast<long>( CODEC_FRAMES - undamaged ),
+          recovered,
+          static_cast<long>( undamaged ),
+          static_cast<unsigned long long>( rejected ),
+          bogus );
+
+  return decoded == CODEC_FRAMES and bogus == 0;
+}
+
+int main( int argc, char* argv[] )
+{
+  if ( argc > 3 ) {
+    fprintf( stderr, "Usage: %s [requests] [device delay us]\n", argv[0] );
+    return EXIT_FAILURE;
+  }
+
+  const unsigned int count = argc > 1 ? stoul( argv[1] ) : 1000;
+  const long delay = argc > 2 ? stol( argv[2] ) : 200;
+
+  bool ok = codec_check();
+
+  printf( "line time per frame: %.1f us at 115200 baud, %.1f us at 1 Mbaud, %.1f us at 2 Mbaud\n",
+          ASG_FRAME_SIZE * 10 * 1e6 / 115200,
+          ASG_FRAME_SIZE * 10 * 1e6 / 1000000,
+          ASG_FRAME_SIZE * 10 * 1e6 / 2000000 );
+
+  const int master = posix_openpt( O_RDWR | O_NOCTTY );
+  if ( master < 0 or grantpt( master ) < 0 or unlockpt( master ) < 0 ) {
+    perror( "posix_openpt" );
+    return EXIT_FAILURE;
+  }
+  const string slave = ptsname( master );
+
+  SerialChannel channel( slave, baud_constant( 1000000 ) );
+
+  atomic<long> delay_us { delay };
+  atomic<unsigned int> drop_every { DROP_EVERY };
+  atomic<bool> running { true };
+  thread device( fake_device, master, cref( delay_us ), cref( drop_every ), cref( running ) );
+
+  Poller poller( PollMode::Block, &channel.reply_ready() );
+  const auto next_reply = [&]( SerialReply& reply ) {
+    while ( true ) {
+      const uint32_t seen = channel.reply_ready().sequence();
+      if ( channel.receive( reply ) ) {
+        break;
+      }
+      poller.idle( seen );
+    }
+    poller.reset();
+  };
+
+  /* one request at a time, as the trial loop sends them */
+  HdrHistogram round_trip; /* ns */
+  unsigned int timeouts = 0, wrong = 0;
+
+  for ( unsigned int i = 0; i < count; i++ ) {
+    const uint32_t sequence = channel.send( AsgFrame {}, milliseconds( 20 ) );
+
+    SerialReply reply;
+    next_reply( reply );
+
+    if ( reply.timed_out ) {
+      timeouts++;
+    } else if ( not valid_reply( reply, sequence ) ) {
+      wrong++;
+    } else {
+      round_trip.add( duration_cast<nanoseconds>( reply.last_byte - reply.sent ).count() );
+    }
+  }
+
+  printf( "%u requests over %s (device delay %ld us, every %dth dropped)\n", count, slave.c_str(), delay, DROP_EVERY );
+  printf( "  replies %zu, timeouts %u, mismatched %u\n", size_t( round_trip.count() ), timeouts, wrong );
+  printf( "  round trip p50 %.1f us, p99 %.1f us, max %.1f us\n",
+          round_trip.percentile( 0.5 ) / 1e3,
+          round_trip.percentile( 0.99 ) / 1e3,
+          round_trip.max() / 1e3 );
+
+  ok = ok and wrong == 0 and timeouts == count / DROP_EVERY;
+
+  /* pipelined: keep WINDOW requests in flight against an instant device */
+  delay_us = 0;
+  drop_every = 0;
+
+  const SerialStats before = channel.stats();
+  unsigned int sent = 0, received = 0, pipelined_wrong = 0;
+  const auto start = steady_clock::now();
+  while ( received < count ) {
+    while ( sent < count and sent - received < WINDOW ) {
+      channel.send( AsgFrame {}, milliseconds( 1000 ) );
+      sent++;
+    }
+
+    SerialReply reply;
+    next_reply( reply );
+    received++;
+    pipelined_wrong += reply.timed_out or not valid_reply( reply, reply.sequence );
+  }
+  const double elapsed_s = duration_cast<nanoseconds>( steady_clock::now() - start ).count() / 1e9;
+  const SerialStats after = channel.stats();
+
+  printf( "%u pipelined requests (window %d): %.0f round trips/s, %.0f bytes/s each way, %u bad\n",
+          count,
+          WINDOW,
+          count / elapsed_s,
+          ( after.bytes_out - before.bytes_out ) / elapsed_s,
+          pipelined_wrong );
+  printf( "  unmatched frames %llu, corrupt frames %llu\n",
+          static_cast<unsigned long long>( after.unmatched ),
+          static_cast<unsigned long long>( after.corrupt ) );
+
+  /* leave the channel idle so it pings, then check its clock estimate */
+  this_thread::sleep_for( seconds( SYNC_SECONDS ) );
+  const ClockEstimate clock = channel.clock();
+  const auto now = steady_clock::now();
+  const double offset_error_us = clock.remote_at( now ) - true_remote_us( now );
+  const uint32_t wrapped = uint32_t( llround( true_remote_us( now ) ) );
+  const double mapping_error_us = duration_cast<nanoseconds>( clock.host_at( wrapped, now ) - now ).count() / 1000.0;
+  const SerialStats synced = channel.stats();
+
+  printf( "clock sync after %d s idle: %llu pongs, %llu ping timeouts, filtered round trip %.1f us\n",
+          SYNC_SECONDS,
+          static_cast<unsigned long long>( synced.pongs ),
+          static_cast<unsigned long long>( synced.ping_timeouts ),
+          clock.rtt_us );
+  printf( "  offset error %.1f us (bound %.1f us), wrapped timestamp mapped %.1f us off, skew %.1f ppm (true %.1f)\n",
+          offset_error_us,
+          clock.error_us,
+          mapping_error_us,
+          clock.skew * 1e6,
+          REMOTE_SKEW_PPM );
+
+  running = false;
+  device.join();
+  close( master );
+
+  ok = ok and pipelined_wrong == 0 and after.corrupt == 0;
+  ok = ok and clock.valid and abs( offset_error_us ) < 1000 and abs( mapping_error_us ) < 1000;
+  printf( "%s\n", ok ? "OK" : "FAILED" );
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
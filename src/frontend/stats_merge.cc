@@ -0,0 +1,66 @@
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "latency_stats.hh"
+
+using namespace std;
+
+/* Combines the latency histograms saved by several runs of example
+   (--stats) and prints their percentiles, optionally saving the result */
+void merge_runs( const vector<string>& inputs, const string& output )
+{
+  LatencyStats merged;
+  for ( const auto& path : inputs ) {
+    ifstream in( path );
+    if ( not in ) {
+      throw runtime_error( "could not open " + path );
+    }
+    merged.merge( in );
+  }
+
+  cout << "Latency over " << inputs.size() << " run" << ( inputs.size() == 1 ? "" : "s" ) << ":\n";
+  merged.summary( cout );
+
+  if ( not output.empty() ) {
+    ofstream out( output );
+    merged.save( out );
+    if ( not out ) {
+      throw runtime_error( "could not write " + output );
+    }
+  }
+}
+
+int main( int argc, char* argv[] )
+{
+  string output;
+  int opt;
+  while ( ( opt = getopt( argc, argv, "o:h" ) ) != -1 ) {
+    if ( opt == 'o' ) {
+      output = optarg;
+    } else {
+      cerr << "Usage: " << argv[0] << " [-o MERGED] RUN.hdr...\n";
+      return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  if ( optind == argc ) {
+    cerr << "Usage: " << argv[0] << " [-o MERGED] RUN.hdr...\n";
+    return EXIT_FAILURE;
+  }
+
+  try {
+    merge_runs( vector<string>( argv + optind, argv + argc ), output );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
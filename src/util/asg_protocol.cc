@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "asg_protocol.hh"
+
+using namespace std;
+
+static void put_u16( uint8_t* out, const uint16_t value )
+{
+  out[0] = value;
+  out[1] = value >> 8;
+}
+
+static void put_u32( uint8_t* out, const uint32_t value )
+{
+  put_u16( out, value );
+  put_u16( out + 2, value >> 16 );
+}
+
+static uint16_t get_u16( const uint8_t* in )
+{
+  return in[0] | ( in[1] << 8 );
+}
+
+static uint32_t get_u32( const uint8_t* in )
+{
+  return get_u16( in ) | ( uint32_t( get_u16( in + 2 ) ) << 16 );
+}
+
+uint16_t asg_crc16( const uint8_t* data, const size_t length )
+{
+  /* bitwise is fine for 17 bytes, and matches the firmware step for step */
+  uint16_t crc = 0xFFFF;
+  for ( size_t i = 0; i < length; i++ ) {
+    crc ^= data[i];
+    for ( unsigned int bit = 0; bit < 8; bit++ ) {
+      crc = ( crc & 1 ) ? ( crc >> 1 ) ^ 0x8408 : crc >> 1;
+    }
+  }
+  return crc;
+}
+
+void asg_encode( const AsgFrame& frame, uint8_t* out )
+{
+  out[0] = ASG_SYNC;
+  out[1] = static_cast<uint8_t>( frame.type );
+  put_u32( out + 2, frame.trial );
+  put_u32( out + 6, frame.toggle_us );
+  put_u32( out + 10, frame.edge_us );
+  put_u16( out + 14, frame.threshold );
+  put_u16( out + 16, asg_crc16( out + 1, ASG_FRAME_SIZE - 3 ) );
+}
+
+void asg_encode_waveform( const AsgFrame& header, const uint8_t* samples, uint8_t* out )
+{
+  AsgFrame frame = header;
+  frame.type = AsgFrameType::Waveform;
+  asg_encode( frame, out );
+  memcpy( out + ASG_FRAME_SIZE, samples, frame.threshold );
+  put_u16( out + ASG_FRAME_SIZE + frame.threshold, asg_crc16( samples, frame.threshold ) );
+}
+
+/* a well-formed fixed-size frame at `in` */
+static bool decode( const uint8_t* in, AsgFrame& frame )
+{
+  const uint8_t type = in[1];
+  switch ( static_cast<AsgFrameType>( type ) ) {
+    case AsgFrameType::Toggle:
+    case AsgFrameType::Result:
+    case AsgFrameType::Waveform:
+    case AsgFrameType::Ping:
+    case AsgFrameType::Pong:
+      break;
+    default:
+      return false;
+  }
+
+  if ( in[0] != ASG_SYNC or asg_crc16( in + 1, ASG_FRAME_SIZE - 3 ) != get_u16( in + 16 ) ) {
+    return false;
+  }
+
+  frame.type = static_cast<AsgFrameType>( type );
+  frame.trial = get_u32( in + 2 );
+  frame.toggle_us = get_u32( in + 6 );
+  frame.edge_us = get_u32( in + 10 );
+  frame.threshold = get_u16( in + 14 );
+  return true;
+}
+
+AsgDecoder::AsgDecoder( const size_t capacity )
+  : ring_( max( capacity, 2 * asg_waveform_size( ASG_MAX_SAMPLES ) ) )
+{}
+
+void AsgDecoder::append( const uint8_t* data, size_t length )
+{
+  while ( length > 0 ) {
+    const size_t chunk = min( length, writable() );
+    if ( chunk == 0 ) {
+      throw runtime_error( "AsgDecoder ring is full" );
+    }
+    memcpy( write_ptr(), data, chunk );
+    commit( chunk );
+    data += chunk;
+    length -= chunk;
+  }
+}
+
+/* Skip the sync byte of a candidate frame that failed to check out. The
+   bytes after a damaged frame hold many false candidates, so only the first
+   rejection since the last good frame counts as a corrupt frame. */
+void AsgDecoder::reject()
+{
+  if ( not resyncing_ ) {
+    resyncing_ = true;
+    corrupt_++;
+  }
+  skipped_++;
+  ring_.consume( 1 );
+}
+
+bool AsgDecoder::next( AsgFrame& frame, const uint8_t** samples )
+{
+  ring_.consume( pending_consume_ );
+  pending_consume_ = 0;
+
+  while ( true ) {
+    /* skip to a sync byte */
+    const uint8_t* data = ring_.read_ptr();
+    const size_t available = ring_.readable();
+    const uint8_t* sync = static_cast<const uint8_t*>( memchr( data, ASG_SYNC, available ) );
+    const size_t skip = sync ? sync - data : available;
+    skipped_ += skip;
+    ring_.consume( skip );
+
+    if ( ring_.readable() < ASG_FRAME_SIZE ) {
+      return false;
+    }
+
+    if ( not decode( ring_.read_ptr(), frame ) ) {
+      reject();
+      continue;
+    }
+
+    if ( frame.type != AsgFrameType::Waveform ) {
+      resyncing_ = false;
+      pending_consume_ = ASG_FRAME_SIZE;
+      return true;
+    }
+
+    const size_t count = frame.threshold;
+    if ( count > ASG_MAX_SAMPLES ) {
+      reject();
+      continue;
+    }
+
+    if ( ring_.readable() < asg_waveform_size( count ) ) {
+      return false; /* wait for the rest of the samples */
+    }
+
+    const uint8_t* payload = ring_.read_ptr() + ASG_FRAME_SIZE;
+    if ( asg_crc16( payload, count ) != get_u16( payload + count ) ) {
+      reject();
+      continue;
+    }
+
+    resyncing_ = false;
+    if ( samples ) {
+      *samples = payload;
+    }
+    pending_consume_ = asg_waveform_size( count );
+    return true;
+  }
+}
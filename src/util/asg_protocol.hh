@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "mirrored_ring.hh"
+
+/* Binary frames between the host and the artificial saccade generator
+   (mirrored in scripts/arduino.ino). Every frame is ASG_FRAME_SIZE bytes:
+
+     offset  size  field
+          0     1  sync byte, 0xA5
+          1     1  type ('G' or 'P' host -> ASG, 'R', 'W' or 'O' ASG -> host)
+          2     4  trial id (or ping id)
+          6     4  ASG micros() when the LEDs were toggled (or the ping arrived)
+         10     4  ASG micros() at the photodiode edge (or the pong was sent)
+         14     2  photodiode ADC threshold
+         16     2  CRC-16 of bytes 1-15
+
+   Integers are little-endian. The CRC is the reflected CCITT polynomial
+   (0x8408) seeded with 0xFFFF, which is avr-libc's _crc_ccitt_update.
+
+   In a toggle request the edge field carries option flags. A Waveform
+   frame reuses the time fields for the ASG times of its first and last
+   sample and the threshold field for its sample count; that many 8-bit
+   photodiode samples and a CRC-16 of them follow it. */
+
+constexpr size_t ASG_FRAME_SIZE = 18;
+constexpr uint8_t ASG_SYNC = 0xA5;
+constexpr uint16_t ASG_DEFAULT_THRESHOLD = 512; /* half of the Uno's 10-bit ADC range */
+constexpr uint32_t ASG_FLAG_WAVEFORM = 1;       /* toggle request: send the waveform around the edge */
+constexpr size_t ASG_MAX_SAMPLES = 1024;
+
+enum class AsgFrameType : uint8_t
+{
+  Toggle = 'G',   /* request: toggle the LEDs and time the photodiode edge */
+  Result = 'R',   /* reply: the two timestamps */
+  Waveform = 'W', /* reply, just before its result: photodiode samples around the edge */
+  Ping = 'P',     /* request: report the ASG clock, for clock synchronization */
+  Pong = 'O',     /* reply: when the ping arrived and when the pong left */
+};
+
+struct AsgFrame
+{
+  AsgFrameType type = AsgFrameType::Toggle;
+  uint32_t trial = 0;
+  uint32_t toggle_us = 0;
+  uint32_t edge_us = 0;
+  uint16_t threshold = ASG_DEFAULT_THRESHOLD;
+
+  /* end-to-end latency as the ASG measured it (wraps with micros()) */
+  uint32_t latency_us() const { return edge_us - toggle_us; }
+};
+
+/* A received waveform: the ASG times of its first and last sample, and the samples */
+struct AsgWaveform
+{
+  uint32_t trial = 0;
+  uint32_t first_us = 0, last_us = 0;
+  uint16_t count = 0;
+  std::array<uint8_t, ASG_MAX_SAMPLES> samples {};
+
+  double period_us() const { return count > 1 ? double( last_us - first_us ) / ( count - 1 ) : 0; }
+};
+
+uint16_t asg_crc16( const uint8_t* data, const size_t length );
+
+/* serialize into exactly ASG_FRAME_SIZE bytes */
+void asg_encode( const AsgFrame& frame, uint8_t* out );
+
+/* bytes on the wire for a waveform of `count` samples */
+constexpr size_t asg_waveform_size( const size_t count )
+{
+  return ASG_FRAME_SIZE + count + 2;
+}
+
+/* serialize a Waveform frame (header.threshold is the sample count) and its samples */
+void asg_encode_waveform( const AsgFrame& header, const uint8_t* samples, uint8_t* out );
+
+/* Stream decoder over a MirroredRing: read() straight into write_ptr(),
+   commit() what arrived, and take frames out with next(), which parses
+   them where they lie. After a bad CRC it resumes at the next sync byte,
+   so one corrupted byte costs at most the frames it overlaps. */
+class AsgDecoder
+{
+  MirroredRing ring_;
+  size_t pending_consume_ = 0; /* the frame last returned, kept until the next call */
+
+  uint64_t skipped_ = 0;   /* bytes discarded while looking for a frame */
+  uint64_t corrupt_ = 0;   /* resyncs: runs of rejected candidates between good frames */
+  bool resyncing_ = false; /* a candidate was rejected since the last good frame */
+
+  void reject();
+
+public:
+  explicit AsgDecoder( const size_t capacity = 1 << 16 );
+
+  uint8_t* write_ptr() { return ring_.write_ptr(); }
+  size_t writable() const { return ring_.writable(); }
+  void commit( const size_t length ) { ring_.commit( length ); }
+
+  /* copy bytes in, for callers that already have them in hand */
+  void append( const uint8_t* data, const size_t length );
+
+  /* The next valid frame, if one is complete. For a Waveform, `samples`
+     (if given) points at its samples in the ring, valid until the next call. */
+  bool next( AsgFrame& frame, const uint8_t** samples = nullptr );
+
+  /* no bytes of an unfinished frame are buffered */
+  bool idle() const { return ring_.readable() == pending_consume_; }
+
+  uint64_t skipped() const { return skipped_; }
+  uint64_t corrupt() const { return corrupt_; }
+};
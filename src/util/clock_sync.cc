@@ -0,0 +1,105 @@
+#include <cmath>
+
+#include "clock_sync.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+static double us_between( const steady_clock::time_point from, const steady_clock::time_point to )
+{
+  return duration_cast<nanoseconds>( to - from ).count() / 1000.0;
+}
+
+double ClockEstimate::remote_at( const steady_clock::time_point host ) const
+{
+  return remote_us + ( 1.0 + skew ) * us_between( reference, host );
+}
+
+steady_clock::time_point ClockEstimate::host_at( const uint32_t remote, const steady_clock::time_point near ) const
+{
+  /* unwrap to the 64-bit device time closest to the prediction for `near` */
+  const int64_t predicted = llround( remote_at( near ) );
+  const int64_t unwrapped = predicted + int32_t( remote - uint32_t( predicted ) );
+
+  const double host_us = ( unwrapped - remote_us ) / ( 1.0 + skew );
+  return reference + nanoseconds( llround( host_us * 1000 ) );
+}
+
+ClockSync::ClockSync( const double resolution_us )
+{
+  history_.reserve( HISTORY );
+  estimate_.resolution_us = resolution_us;
+}
+
+uint64_t ClockSync::unwrap( const uint32_t remote )
+{
+  /* micros() wraps every 71 minutes; exchanges are far more frequent than that */
+  last_remote_ += int32_t( remote - uint32_t( last_remote_ ) );
+  return last_remote_;
+}
+
+void ClockSync::add( const ClockExchange& exchange )
+{
+  if ( not started_ ) {
+    started_ = true;
+    epoch_ = exchange.host_sent;
+    last_remote_ = exchange.remote_received_us;
+  }
+
+  const uint64_t remote_received = unwrap( exchange.remote_received_us );
+  const uint64_t remote_sent = unwrap( exchange.remote_sent_us );
+  const double host_sent = us_between( epoch_, exchange.host_sent );
+  const double host_received = us_between( epoch_, exchange.host_received );
+
+  const Point point {
+    ( host_sent + host_received ) / 2,
+    ( ( remote_received - host_sent ) + ( remote_sent - host_received ) ) / 2,
+    ( host_received - host_sent ) - double( remote_sent - remote_received ),
+  };
+
+  estimate_.exchanges++;
+  if ( block_count_ == 0 or point.rtt_us < best_.rtt_us ) {
+    best_ = point;
+  }
+
+  /* the first block is cut short so an estimate is available quickly */
+  const unsigned int block = history_.empty() ? 2 : FILTER_BLOCK;
+  if ( ++block_count_ < block ) {
+    return;
+  }
+  block_count_ = 0;
+
+  if ( history_.size() < HISTORY ) {
+    history_.push_back( best_ );
+  } else {
+    history_[history_next_] = best_;
+    history_next_ = ( history_next_ + 1 ) % HISTORY;
+  }
+
+  estimate_.rtt_us = best_.rtt_us;
+  estimate_.error_us = best_.rtt_us / 2 + estimate_.resolution_us / 2;
+  fit();
+}
+
+void ClockSync::fit()
+{
+  double mean_host = 0, mean_offset = 0;
+  for ( const auto& p : history_ ) {
+    mean_host += p.host_us;
+    mean_offset += p.offset_us;
+  }
+  mean_host /= history_.size();
+  mean_offset /= history_.size();
+
+  double covariance = 0, variance = 0;
+  for ( const auto& p : history_ ) {
+    covariance += ( p.host_us - mean_host ) * ( p.offset_us - mean_offset );
+    variance += ( p.host_us - mean_host ) * ( p.host_us - mean_host );
+  }
+
+  /* offset = remote - host, so its slope against host time is the skew */
+  estimate_.skew = variance > 0 ? covariance / variance : 0;
+  estimate_.reference = epoch_ + nanoseconds( llround( mean_host * 1000 ) );
+  estimate_.remote_us = mean_host + mean_offset;
+  estimate_.valid = true;
+}
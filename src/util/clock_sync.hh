@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/* One ping-pong exchange with a device that has its own microsecond
+   clock: when the host sent the ping and got the pong back, and the
+   device's micros() when the ping arrived and when the pong left. */
+struct ClockExchange
+{
+  std::chrono::steady_clock::time_point host_sent {}, host_received {};
+  uint32_t remote_received_us = 0, remote_sent_us = 0;
+};
+
+/* The device clock as a linear function of the host clock. Remote times
+   are unwrapped to 64 bits, counting from the first exchange. */
+struct ClockEstimate
+{
+  bool valid = false;
+  uint64_t exchanges = 0;
+
+  std::chrono::steady_clock::time_point reference {}; /* host time the line is anchored at */
+  double remote_us = 0;  /* unwrapped device time at `reference` */
+  double skew = 0;       /* device rate relative to the host's, minus one */
+  double rtt_us = 0;        /* round trip of the latest filtered exchange */
+  double resolution_us = 1; /* tick of the device's timestamps */
+  double error_us = 0;      /* its offset is uncertain by half its round trip plus half a tick */
+
+  /* unwrapped device time at a host time */
+  double remote_at( const std::chrono::steady_clock::time_point host ) const;
+
+  /* host time of a 32-bit device timestamp taken near host time `near` */
+  std::chrono::steady_clock::time_point host_at( const uint32_t remote_us,
+                                                 const std::chrono::steady_clock::time_point near ) const;
+};
+
+/* NTP-style estimate of a device clock's offset and drift. Each exchange
+   gives an offset bounded by its round trip; queueing only ever adds
+   delay, so within each block of exchanges only the one with the smallest
+   round trip is kept. A least-squares line through the recent filtered
+   offsets gives the offset and the skew. */
+class ClockSync
+{
+  constexpr static unsigned int FILTER_BLOCK = 8; /* exchanges per min-RTT filter block */
+  constexpr static unsigned int HISTORY = 32;     /* filtered points in the drift fit */
+
+  struct Point
+  {
+    double host_us, offset_us, rtt_us;
+  };
+
+  bool started_ = false;
+  std::chrono::steady_clock::time_point epoch_ {}; /* host time 0 */
+  uint64_t last_remote_ = 0;                      /* unwrapped, to unwrap the next timestamp */
+
+  Point best_ {};
+  unsigned int block_count_ = 0;
+  std::vector<Point> history_ {};
+  size_t history_next_ = 0;
+
+  ClockEstimate estimate_ {};
+
+  uint64_t unwrap( const uint32_t remote_us );
+  void fit();
+
+public:
+  /* resolution_us is the tick the device's timestamps count in */
+  explicit ClockSync( const double resolution_us = 1 );
+
+  void add( const ClockExchange& exchange );
+
+  const ClockEstimate& estimate() const { return estimate_; }
+};
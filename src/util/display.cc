@@ -26,9 +26,13 @@
    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
+#include <cmath>
+#include <stdexcept>
+
 #include "display.hh"
 
 using namespace std;
+using namespace std::chrono;
 
 const string VideoDisplay::shader_source_scale_from_pixel_coordinates = R"( #version 130
 
@@ -92,17 +96,39 @@ const string VideoDisplay::shader_source_ycbcr = R"( #version 130
 VideoDisplay::CurrentContextWindow::CurrentContextWindow( const unsigned int width,
                                                           const unsigned int height,
                                                           const string& title,
-                                                          const bool fullscreen )
-  : window_( width, height, title, fullscreen )
+                                                          const bool fullscreen,
+                                                          const bool visible,
+                                                          const unsigned int monitor,
+                                                          const unsigned int refresh_hz )
+  : window_( width, height, title, fullscreen, visible, monitor, refresh_hz )
 {
   window_.make_context_current();
 }
 
-VideoDisplay::VideoDisplay( const unsigned int width, const unsigned int height, const bool fullscreen )
+/* size of the hidden window that holds an offscreen display's context */
+static constexpr unsigned int HIDDEN_WINDOW_DIM = 64;
+
+VideoDisplay::VideoDisplay( const unsigned int width,
+                            const unsigned int height,
+                            const bool fullscreen,
+                            const bool offscreen,
+                            const unsigned int monitor,
+                            const unsigned int refresh_hz )
   : width_( width )
   , height_( height )
-  , current_context_window_( width_, height_, "OpenGL Example", fullscreen )
+  , offscreen_( offscreen )
+  , current_context_window_( offscreen ? HIDDEN_WINDOW_DIM : width_,
+                             offscreen ? HIDDEN_WINDOW_DIM : height_,
+                             "OpenGL Example",
+                             fullscreen and not offscreen,
+                             not offscreen,
+                             monitor,
+                             refresh_hz )
 {
+  if ( offscreen_ ) {
+    framebuffer_ = make_unique<Framebuffer>( width_, height_ );
+  }
+
   texture_shader_program_.attach( scale_from_pixel_coordinates_ );
   texture_shader_program_.attach( ycbcr_shader_ );
   texture_shader_program_.link();
@@ -122,12 +148,76 @@ VideoDisplay::VideoDisplay( const unsigned int width, const unsigned int height,
                          (const void*)( 2 * sizeof( float ) ) );
   glEnableVertexAttribArray( texture_shader_program_.attribute_location( "chroma_texcoord" ) );
 
-  const auto window_size = window().framebuffer_size();
+  const auto window_size = offscreen_ ? make_pair( width_, height_ ) : window().framebuffer_size();
   resize( window_size.first, window_size.second );
 
   glCheck( "VideoDisplay constructor" );
 }
 
+VideoDisplay::~VideoDisplay()
+{
+  for ( auto& frame : in_flight_ ) {
+    if ( frame.fence ) {
+      glDeleteSync( frame.fence );
+    }
+  }
+}
+
+SyncMode parse_sync_mode( const string& name )
+{
+  if ( name == "finish" ) {
+    return SyncMode::Finish;
+  } else if ( name == "fence" ) {
+    return SyncMode::Fence;
+  } else if ( name == "none" ) {
+    return SyncMode::None;
+  }
+
+  throw runtime_error( "unknown sync mode: " + name + " (expected finish, fence or none)" );
+}
+
+string sync_mode_name( const SyncMode mode )
+{
+  switch ( mode ) {
+    case SyncMode::Finish:
+      return "finish";
+    case SyncMode::Fence:
+      return "fence";
+    case SyncMode::None:
+      return "none";
+  }
+
+  return "unknown";
+}
+
+void VideoDisplay::set_sync_mode( const SyncMode mode, const unsigned int max_frames_in_flight )
+{
+  if ( max_frames_in_flight < 1 or max_frames_in_flight > FENCE_RING ) {
+    throw runtime_error( "frames in flight must be between 1 and " + to_string( FENCE_RING ) );
+  }
+
+  wait_idle();
+  sync_mode_ = mode;
+  max_frames_in_flight_ = max_frames_in_flight;
+  timer_.set_track_completion( mode != SyncMode::None );
+}
+
+void VideoDisplay::set_interrupt( const atomic<bool>* interrupt, const nanoseconds poll )
+{
+  interrupt_ = interrupt;
+  interrupt_poll_ = poll;
+}
+
+void VideoDisplay::wait_idle()
+{
+  if ( frames_in_flight_ > 0 ) {
+    retire_fences( 0 );
+  } else {
+    glFinish();
+  }
+  timer_.collect();
+}
+
 void VideoDisplay::resize( const unsigned int width, const unsigned int height )
 {
   glViewport( 0, 0, width, height );
@@ -155,7 +245,7 @@ void VideoDisplay::resize( const unsigned int width, const unsigned int height )
 
   glCheck( "after resizing" );
 
-  const auto new_window_size = window().window_size();
+  const auto new_window_size = offscreen_ ? make_pair( width, height ) : window().window_size();
   if ( new_window_size.first != width or new_window_size.second != height ) {
     throw runtime_error( "failed to resize window to " + to_string( width ) + "x" + to_string( height ) );
   }
@@ -171,20 +261,191 @@ void VideoDisplay::draw( Texture420& image )
 {
   image.bind();
   repaint();
+
+  /* the texture covered the whole frame, so patches must re-establish the background */
+  background_frames_ = BACKGROUND_FRAMES;
 }
 
-void VideoDisplay::repaint()
+/* Y'CbCr studio-range luma to full-range gray */
+static float gray( const uint8_t luma )
+{
+  return max( 0.0f, min( 1.0f, ( luma - 16 ) / 219.0f ) );
+}
+
+void VideoDisplay::draw( const FramePattern& pattern )
+{
+  timer_.begin_frame();
+  update_size();
+
+  if ( background_frames_ > 0 ) {
+    const float level = gray( pattern.background );
+    glClearColor( level, level, level, 1.0 );
+    glClear( GL_COLOR_BUFFER_BIT );
+    background_frames_--;
+  }
+
+  paint_rects( pattern );
+  present();
+}
+
+void VideoDisplay::draw( Texture420& image, const FramePattern& overlay )
+{
+  timer_.begin_frame();
+  image.bind();
+  update_size();
+
+  glDrawArrays( GL_TRIANGLE_FAN, 0, 4 );
+  paint_rects( overlay );
+  present();
+
+  background_frames_ = BACKGROUND_FRAMES;
+}
+
+void VideoDisplay::paint_rects( const FramePattern& pattern )
+{
+  /* scale from pattern to window coordinates (GL's origin is the bottom left) */
+  const float sx = float( width_ ) / pattern.width;
+  const float sy = float( height_ ) / pattern.height;
+
+  glEnable( GL_SCISSOR_TEST );
+  for ( const auto& rect : pattern.rects ) {
+    const float level = gray( rect.luma );
+    glScissor( lround( rect.x * sx ),
+               lround( height_ - ( rect.y + rect.height ) * sy ),
+               lround( rect.width * sx ),
+               lround( rect.height * sy ) );
+    glClearColor( level, level, level, 1.0 );
+    glClear( GL_COLOR_BUFFER_BIT );
+  }
+  glDisable( GL_SCISSOR_TEST );
+}
+
+void VideoDisplay::update_size()
 {
+  if ( offscreen_ ) {
+    return;
+  }
+
   const auto window_size = window().window_size();
 
   if ( window_size.first != width_ or window_size.second != height_ ) {
     width_ = window_size.first;
     height_ = window_size.second;
     resize( width_, height_ );
+    background_frames_ = BACKGROUND_FRAMES;
   }
+}
+
+void VideoDisplay::repaint()
+{
+  timer_.begin_frame();
+  update_size();
 
   glDrawArrays( GL_TRIANGLE_FAN, 0, 4 );
 
-  current_context_window_.window_.swap_buffers();
+  present();
+}
+
+void VideoDisplay::present()
+{
+  timer_.end_draw();
+  if ( offscreen_ ) {
+    glFlush();
+  } else {
+    current_context_window_.window_.swap_buffers();
+  }
+  timer_.swapped();
+
+  switch ( sync_mode_ ) {
+    case SyncMode::Finish:
+      if ( interrupt_ ) {
+        if ( not wait_interruptibly() ) {
+          break;
+        }
+      } else {
+        glFinish();
+      }
+      timer_.completed( timer_.next_frame(), steady_clock::now() );
+
+      /* frames abandoned by earlier interrupted waits are done too */
+      retire_fences( 0 );
+      break;
+
+    case SyncMode::Fence: {
+      /* make room for this frame, then note whichever older frames are done */
+      retire_fences( max_frames_in_flight_ - 1 );
+
+      InFlight& slot = in_flight_[( oldest_in_flight_ + frames_in_flight_ ) % FENCE_RING];
+      slot.fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+      slot.frame = timer_.next_frame();
+      frames_in_flight_++;
+      break;
+    }
+
+    case SyncMode::None:
+      break;
+  }
+
+  timer_.finished();
+}
+
+/* Wait for the frame just swapped, unless interrupted first. On an
+   interruption the frame's fence joins the in-flight ring and false is
+   returned. A fence after the swap can signal once the frame is drawn,
+   before its flip, so the wait ends with glFinish to return at the vblank
+   like an ordinary Finish (by then the flip is queued, so a triggered frame
+   couldn't be shown any sooner by skipping it). */
+bool VideoDisplay::wait_interruptibly()
+{
+  GLsync fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+  GLenum status = glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0 );
+
+  while ( status == GL_TIMEOUT_EXPIRED ) {
+    if ( interrupt_->load( memory_order_acquire ) and frames_in_flight_ < FENCE_RING ) {
+      InFlight& slot = in_flight_[( oldest_in_flight_ + frames_in_flight_ ) % FENCE_RING];
+      slot.fence = fence;
+      slot.frame = timer_.next_frame();
+      frames_in_flight_++;
+      timer_.interrupted( slot.frame );
+      interrupted_++;
+      return false;
+    }
+    status = glClientWaitSync( fence, 0, interrupt_poll_.count() );
+  }
+
+  glDeleteSync( fence );
+  if ( status == GL_WAIT_FAILED ) {
+    throw runtime_error( "glClientWaitSync failed" );
+  }
   glFinish();
+  return true;
+}
+
+/* Retire completed frames in order, blocking on the oldest ones until at
+   most max_remaining are still in flight. */
+void VideoDisplay::retire_fences( const unsigned int max_remaining )
+{
+  while ( frames_in_flight_ > 0 ) {
+    InFlight& oldest = in_flight_[oldest_in_flight_];
+    const bool must_wait = frames_in_flight_ > max_remaining;
+
+    GLenum status = glClientWaitSync( oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0 );
+    while ( must_wait and status == GL_TIMEOUT_EXPIRED ) {
+      status = glClientWaitSync( oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000 /* ns */ );
+    }
+
+    if ( status == GL_WAIT_FAILED ) {
+      throw runtime_error( "glClientWaitSync failed" );
+    }
+
+    if ( status == GL_TIMEOUT_EXPIRED ) {
+      return;
+    }
+
+    timer_.completed( oldest.frame, steady_clock::now() );
+    glDeleteSync( oldest.fence );
+    oldest = {};
+    oldest_in_flight_ = ( oldest_in_flight_ + 1 ) % FENCE_RING;
+    frames_in_flight_--;
+  }
 }
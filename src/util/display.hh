@@ -31,8 +31,27 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "frame_cache.hh"
+#include "frame_timer.hh"
 #include "gl_objects.hh"
 
+/* How a frame's present() waits for the GPU after the swap */
+enum class SyncMode
+{
+  Finish, /* glFinish: the frame is complete when present() returns */
+  Fence,  /* a fence per frame; only wait when too many frames are in flight */
+  None,   /* never wait (beyond whatever the driver imposes) */
+};
+
+SyncMode parse_sync_mode( const std::string& name );
+std::string sync_mode_name( const SyncMode mode );
+
 class VideoDisplay
 {
 private:
@@ -40,6 +59,7 @@ private:
   static const std::string shader_source_ycbcr;
 
   unsigned int width_, height_;
+  bool offscreen_;
 
   struct CurrentContextWindow
   {
@@ -49,9 +69,14 @@ private:
     CurrentContextWindow( const unsigned int width,
                           const unsigned int height,
                           const std::string& title,
-                          const bool fullscreen );
+                          const bool fullscreen,
+                          const bool visible,
+                          const unsigned int monitor,
+                          const unsigned int refresh_hz );
   } current_context_window_;
 
+  std::unique_ptr<Framebuffer> framebuffer_ {}; /* the render target when offscreen */
+
   VertexShader scale_from_pixel_coordinates_ = { shader_source_scale_from_pixel_coordinates };
   FragmentShader ycbcr_shader_ = { shader_source_ycbcr };
 
@@ -61,13 +86,92 @@ private:
   VertexBufferObject screen_corners_ = {};
   VertexBufferObject other_vertices_ = {};
 
+  FrameTimer timer_ {};
+
+  /* frames left in which draw( FramePattern ) must repaint the background
+     (enough to cover every buffer in a triple-buffered swap chain) */
+  constexpr static unsigned int BACKGROUND_FRAMES = 3;
+  unsigned int background_frames_ = BACKGROUND_FRAMES;
+
+  SyncMode sync_mode_ = SyncMode::Finish;
+  unsigned int max_frames_in_flight_ = 2;
+
+  /* unretired frames in SyncMode::Fence, oldest first */
+  struct InFlight
+  {
+    GLsync fence = nullptr;
+    uint64_t frame = 0;
+  };
+  constexpr static unsigned int FENCE_RING = 4;
+  std::array<InFlight, FENCE_RING> in_flight_ {};
+  unsigned int oldest_in_flight_ = 0, frames_in_flight_ = 0;
+
+  /* if set, SyncMode::Finish stops waiting for the frame as soon as it's true */
+  const std::atomic<bool>* interrupt_ = nullptr;
+  std::chrono::nanoseconds interrupt_poll_ { 0 };
+  uint64_t interrupted_ = 0;
+
+  void update_size();
+  void paint_rects( const FramePattern& pattern );
+  void present();
+  bool wait_interruptibly();
+  void retire_fences( const unsigned int max_remaining );
+
 public:
-  VideoDisplay( const unsigned int width, const unsigned int height, const bool fullscreen = false );
+  /* An offscreen display draws into a width x height framebuffer object,
+     with only a hidden window to hold the GL context (no monitor needed,
+     though GLFW still needs an X server such as Xvfb). present() submits
+     the frame instead of swapping. A fullscreen display covers the given
+     monitor (see Window::monitor_names(); 0 is the primary), switching it
+     to the closest mode to width x height at refresh_hz (0 for any rate). */
+  VideoDisplay( const unsigned int width,
+                const unsigned int height,
+                const bool fullscreen = false,
+                const bool offscreen = false,
+                const unsigned int monitor = 0,
+                const unsigned int refresh_hz = 0 );
+  ~VideoDisplay();
+
+  /* max_frames_in_flight (1 to 4) bounds how far SyncMode::Fence lets the GPU fall behind */
+  void set_sync_mode( const SyncMode mode, const unsigned int max_frames_in_flight = 2 );
+  SyncMode sync_mode() const { return sync_mode_; }
+
+  bool offscreen() const { return offscreen_; }
+
+  /* wait for every submitted frame to complete */
+  void wait_idle();
+
+  /* Make SyncMode::Finish waits abortable: until cleared (with nullptr),
+     present() waits on a fence, checking `interrupt` every `poll` (0 to
+     spin), and returns early once it is true, leaving the frame in flight.
+     Its completion is noted when the next frame's wait ends. An
+     uninterrupted wait still returns at the flip, as glFinish does. */
+  void set_interrupt( const std::atomic<bool>* interrupt,
+                      const std::chrono::nanoseconds poll = std::chrono::nanoseconds( 0 ) );
+
+  /* frames whose wait was cut short */
+  uint64_t interrupted() const { return interrupted_; }
 
   void draw( Texture420& image );
+
+  /* Lightweight path: paint the pattern's rectangles with scissored clears
+     instead of sampling full-screen textures. Only the rectangles are
+     redrawn once the background is established, so a region that should go
+     dark must still be listed (with the background luma). */
+  void draw( const FramePattern& pattern );
+
+  /* make the next few draw( FramePattern ) calls clear the whole frame first */
+  void repaint_background() { background_frames_ = BACKGROUND_FRAMES; }
+
+  /* full-screen image with the pattern's rectangles painted over it */
+  void draw( Texture420& image, const FramePattern& overlay );
+
   void repaint();
   void resize( const unsigned int width, const unsigned int height );
 
+  /* per-frame CPU and GPU timestamps of every draw */
+  FrameTimer& timer() { return timer_; }
+
   Window& window() { return current_context_window_.window_; }
   const Window& window() const { return current_context_window_.window_; }
 
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cmath>
+
+#include "edge_fit.hh"
+
+using namespace std;
+
+static double mean( const uint8_t* samples, const size_t begin, const size_t end )
+{
+  double sum = 0;
+  for ( size_t i = begin; i < end; i++ ) {
+    sum += samples[i];
+  }
+  return sum / ( end - begin );
+}
+
+/* where the line between samples j - 1 and j reaches `level` */
+static double interpolate( const uint8_t* samples, const size_t j, const double level )
+{
+  const double below = samples[j - 1], above = samples[j];
+  return ( j - 1 ) + ( above > below ? ( level - below ) / ( above - below ) : 1.0 );
+}
+
+EdgeFit fit_edge( const uint8_t* s, const size_t count )
+{
+  EdgeFit fit;
+  if ( count < 32 ) {
+    return fit;
+  }
+
+  fit.baseline = mean( s, 0, count / 8 );
+  fit.top = mean( s, count - count / 4, count );
+  const double step = fit.top - fit.baseline;
+  if ( step < 8 ) {
+    return fit; /* no edge in this window */
+  }
+
+  const auto level = [&]( const double fraction ) { return fit.baseline + fraction * step; };
+
+  /* the first upward crossing of 50% */
+  size_t mid = 1;
+  while ( mid < count and not( s[mid - 1] < level( 0.5 ) and s[mid] >= level( 0.5 ) ) ) {
+    mid++;
+  }
+  if ( mid == count ) {
+    return fit;
+  }
+
+  /* the 10% crossing just before it and the 90% crossing just after */
+  size_t low = mid;
+  while ( low > 1 and s[low - 1] >= level( 0.1 ) ) {
+    low--;
+  }
+  size_t high = mid;
+  while ( high < count - 1 and s[high] < level( 0.9 ) ) {
+    high++;
+  }
+
+  fit.start = s[low - 1] < level( 0.1 ) ? interpolate( s, low, level( 0.1 ) ) : low - 1;
+  fit.end = s[high] >= level( 0.9 ) ? interpolate( s, high, level( 0.9 ) ) : high;
+  fit.edge = interpolate( s, mid, level( 0.5 ) );
+
+  /* refine the 50% point with a line through the middle of the rise,
+     which averages out noise that a two-sample interpolation can't */
+  size_t first = mid, last = mid;
+  while ( first > 0 and s[first - 1] >= level( 0.25 ) and s[first - 1] <= s[first] ) {
+    first--;
+  }
+  while ( last + 1 < count and s[last + 1] <= level( 0.75 ) and s[last + 1] >= s[last] ) {
+    last++;
+  }
+
+  if ( last - first >= 2 ) {
+    const double n = last - first + 1;
+    double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    for ( size_t i = first; i <= last; i++ ) {
+      sum_x += i;
+      sum_y += s[i];
+      sum_xx += double( i ) * i;
+      sum_xy += double( i ) * s[i];
+    }
+    const double slope = ( n * sum_xy - sum_x * sum_y ) / ( n * sum_xx - sum_x * sum_x );
+    const double intercept = ( sum_y - slope * sum_x ) / n;
+    const double fitted = slope > 0 ? ( level( 0.5 ) - intercept ) / slope : -1;
+    if ( fitted >= fit.start and fitted <= fit.end ) {
+      fit.edge = fitted;
+    }
+  }
+
+  /* plateau ripple, from one rise time after the 90% point */
+  const size_t plateau = min( count, size_t( ceil( fit.end + fit.rise() ) ) );
+  if ( count - plateau >= 16 ) {
+    const auto [lowest, highest] = minmax_element( s + plateau, s + count );
+    const double swing = *highest - *lowest;
+    const double centre = mean( s, plateau, count );
+    fit.ripple = swing / step;
+
+    /* count upward crossings of the plateau mean, with hysteresis */
+    const double hysteresis = max( 2.0, swing / 4 );
+    bool above = s[plateau] > centre;
+    size_t crossings = 0, first_up = 0, last_up = 0;
+    for ( size_t i = plateau; i < count and swing >= 4; i++ ) {
+      if ( not above and s[i] > centre + hysteresis ) {
+        above = true;
+        if ( crossings++ == 0 ) {
+          first_up = i;
+        }
+        last_up = i;
+      } else if ( above and s[i] < centre - hysteresis ) {
+        above = false;
+      }
+    }
+    fit.ripple_period = crossings >= 2 ? double( last_up - first_up ) / ( crossings - 1 ) : 0;
+  }
+
+  fit.valid = true;
+  return fit;
+}
+
+void synthesize_edge( const PhotodiodeModel& model,
+                      const double edge,
+                      uint8_t* out,
+                      const size_t count,
+                      mt19937_64& rng )
+{
+  normal_distribution<double> noise( 0, model.noise );
+  const double ramp = model.rise / 0.8; /* a linear ramp spends 80% of its time between 10% and 90% */
+  const double ramp_start = edge - ramp / 2;
+
+  for ( size_t i = 0; i < count; i++ ) {
+    const double progress = ramp > 0 ? clamp( ( i - ramp_start ) / ramp, 0.0, 1.0 ) : ( i >= edge ? 1.0 : 0.0 );
+    double lit = 1.0;
+    if ( model.pwm_period > 0 and fmod( i, model.pwm_period ) >= model.pwm_period / 2 ) {
+      lit = 1.0 - model.pwm_depth;
+    }
+
+    const double value = model.baseline + ( model.top - model.baseline ) * progress * lit + noise( rng );
+    out[i] = static_cast<uint8_t>( clamp( lround( value ), 0L, 255L ) );
+  }
+}
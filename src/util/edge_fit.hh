@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+/* The display's rising edge as seen in a photodiode waveform. Positions
+   are in (fractional) samples from the start of the waveform. */
+struct EdgeFit
+{
+  bool valid = false;
+
+  double baseline = 0, top = 0; /* mean levels before and after the edge */
+  double start = 0;             /* 10% crossing */
+  double edge = 0;              /* 50% crossing, fitted through the middle of the rise */
+  double end = 0;               /* 90% crossing */
+
+  double ripple = 0;        /* peak-to-peak on the plateau, as a fraction of the step */
+  double ripple_period = 0; /* samples per cycle of plateau ripple (e.g. backlight PWM), or 0 */
+
+  double rise() const { return end - start; }
+};
+
+/* Find the step in 8-bit samples: levels from the first and last parts of
+   the window, crossings interpolated between samples, and the 50% point
+   from a least-squares line through the samples between 25% and 75%. */
+EdgeFit fit_edge( const uint8_t* samples, const size_t count );
+
+/* A synthetic photodiode response, for the emulator and benchmarks */
+struct PhotodiodeModel
+{
+  double baseline = 20, top = 200; /* ADC levels (8-bit) */
+  double rise = 40;                /* 10-90% rise, in samples (the ramp is linear) */
+  double pwm_period = 0;           /* backlight PWM period in samples, 0 for none */
+  double pwm_depth = 0;            /* fraction of the step the PWM takes away when off */
+  double noise = 1;                /* Gaussian noise, standard deviation in ADC levels */
+};
+
+/* fill `count` samples with the model's step, its 50% point at `edge` */
+void synthesize_edge( const PhotodiodeModel& model,
+                      const double edge,
+                      uint8_t* out,
+                      const size_t count,
+                      std::mt19937_64& rng );
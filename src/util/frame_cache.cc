@@ -0,0 +1,68 @@
+#include "frame_cache.hh"
+
+using namespace std;
+
+mutex FrameCache::rasters_mutex_ {};
+FrameCache::RasterMap FrameCache::rasters_ {};
+
+shared_ptr<const Raster420> FramePattern::build() const
+{
+  auto raster = make_shared<Raster420>( width, height );
+
+  /* luma from the pattern, neutral chroma */
+  raster->fill( background );
+  for ( const auto& rect : rects ) {
+    raster->Y.fill_rect( rect.x, rect.y, rect.width, rect.height, rect.luma );
+  }
+
+  return raster;
+}
+
+size_t FramePatternHash::operator()( const FramePattern& pattern ) const
+{
+  /* FNV-1a over the parameters */
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  const auto mix = [&]( const uint64_t value ) {
+    hash ^= value;
+    hash *= 0x100000001b3ULL;
+  };
+
+  mix( pattern.width );
+  mix( pattern.height );
+  mix( pattern.background );
+  for ( const auto& rect : pattern.rects ) {
+    mix( rect.x );
+    mix( rect.y );
+    mix( rect.width );
+    mix( rect.height );
+    mix( rect.luma );
+  }
+
+  return hash;
+}
+
+shared_ptr<const Raster420> FrameCache::raster( const FramePattern& pattern )
+{
+  lock_guard<mutex> lock( rasters_mutex_ );
+
+  auto& entry = rasters_[pattern];
+  if ( not entry ) {
+    entry = pattern.build();
+  }
+  return entry;
+}
+
+void FrameCache::clear_rasters()
+{
+  lock_guard<mutex> lock( rasters_mutex_ );
+  rasters_.clear();
+}
+
+Texture420& FrameCache::texture( const FramePattern& pattern )
+{
+  auto& entry = textures_[pattern];
+  if ( not entry ) {
+    entry = make_unique<Texture420>( *raster( pattern ) );
+  }
+  return *entry;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "gl_objects.hh"
+
+/* A solid luma rectangle drawn over the background */
+struct LumaRect
+{
+  unsigned int x, y, width, height;
+  uint8_t luma;
+
+  bool operator==( const LumaRect& other ) const
+  {
+    return x == other.x and y == other.y and width == other.width and height == other.height
+           and luma == other.luma;
+  }
+};
+
+/* Parameters that fully determine a generated frame */
+struct FramePattern
+{
+  unsigned int width, height;
+  uint8_t background;
+  std::vector<LumaRect> rects;
+
+  bool operator==( const FramePattern& other ) const
+  {
+    return width == other.width and height == other.height and background == other.background
+           and rects == other.rects;
+  }
+
+  /* render the pattern into a new raster */
+  std::shared_ptr<const Raster420> build() const;
+};
+
+struct FramePatternHash
+{
+  size_t operator()( const FramePattern& pattern ) const;
+};
+
+/* Generated frames, keyed by their pattern. Rasters are shared by every
+   FrameCache in the process; textures belong to the GL context that was
+   current when they were created, so each render thread keeps its own
+   FrameCache and must destroy it before its context goes away. */
+class FrameCache
+{
+  using RasterMap = std::unordered_map<FramePattern, std::shared_ptr<const Raster420>, FramePatternHash>;
+
+  static std::mutex rasters_mutex_;
+  static RasterMap rasters_;
+
+  std::unordered_map<FramePattern, std::unique_ptr<Texture420>, FramePatternHash> textures_ {};
+
+public:
+  FrameCache() {}
+
+  /* thread-safe; builds the raster on first use */
+  static std::shared_ptr<const Raster420> raster( const FramePattern& pattern );
+
+  /* drop all cached rasters (textures already uploaded are unaffected) */
+  static void clear_rasters();
+
+  /* requires a current GL context; uploads the texture on first use */
+  Texture420& texture( const FramePattern& pattern );
+
+  /* forbid copying */
+  FrameCache( const FrameCache& other ) = delete;
+  FrameCache& operator=( const FrameCache& other ) = delete;
+};
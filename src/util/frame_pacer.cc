@@ -0,0 +1,79 @@
+#include <cmath>
+
+#include "frame_pacer.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+/* loop gains: the phase follows each observation a little, the period much less */
+static constexpr double PHASE_GAIN = 0.1;
+static constexpr double PERIOD_GAIN = 0.01;
+static constexpr double COST_GAIN = 0.05;
+static constexpr unsigned int LOCK_COUNT = 32;
+
+FramePacer::FramePacer( const nanoseconds nominal_period, const nanoseconds safety )
+  : period_( nominal_period )
+  , safety_( safety )
+{}
+
+void FramePacer::observe( const FrameTiming& timing )
+{
+  /* the draw cost tracks increases quickly and decreases slowly */
+  const double cost = ( timing.cpu_submitted - timing.cpu_start ).count();
+  cost_ns_ += ( cost > cost_ns_ ? 0.5 : COST_GAIN ) * ( cost - cost_ns_ );
+
+  /* an interrupted frame's completion was only noticed later */
+  if ( not timing.completion_valid() or timing.interrupted ) {
+    return;
+  }
+
+  const clock::time_point vblank = timing.cpu_completed;
+  if ( not have_vblank_ ) {
+    last_vblank_ = vblank;
+    have_vblank_ = true;
+    return;
+  }
+
+  const double period = period_.count();
+  const double since = ( vblank - last_vblank_ ).count();
+  const double cycles = round( since / period );
+  const double error = since - cycles * period;
+
+  /* a missed lock (or a frame that wasn't vsynced): start over from here */
+  if ( cycles < 1 or abs( error ) > period / 4 ) {
+    last_vblank_ = vblank;
+    locked_count_ = 0;
+    return;
+  }
+
+  last_vblank_ += nanoseconds( int64_t( cycles * period + PHASE_GAIN * error ) );
+  period_ = nanoseconds( int64_t( period + PERIOD_GAIN * error / cycles ) );
+  locked_count_++;
+  vblanks_++;
+}
+
+FramePacer::clock::time_point FramePacer::next_vblank( const clock::time_point now ) const
+{
+  if ( not have_vblank_ or now < last_vblank_ ) {
+    return have_vblank_ ? last_vblank_ : now + period_;
+  }
+
+  const auto cycles = ( now - last_vblank_ ) / period_ + 1;
+  return last_vblank_ + cycles * period_;
+}
+
+FramePacer::clock::time_point FramePacer::submit_deadline( const clock::time_point now ) const
+{
+  const auto lead = draw_cost() + safety_;
+
+  auto vblank = next_vblank( now );
+  if ( vblank - lead < now ) {
+    vblank += period_;
+  }
+  return vblank - lead;
+}
+
+bool FramePacer::locked() const
+{
+  return locked_count_ >= LOCK_COUNT;
+}
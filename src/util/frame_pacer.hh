@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include "frame_timer.hh"
+
+/* Predicts vertical blanks from the completion times of vsynced frames (a
+   swap followed by glFinish returns just after the vblank that showed it,
+   so this needs SyncMode::Finish)
+   with a phase-locked loop, and learns how long a frame takes to draw, so
+   that frames can be submitted at the last moment that still makes the
+   next scanout. */
+class FramePacer
+{
+  using clock = std::chrono::steady_clock;
+
+  std::chrono::nanoseconds period_;
+  std::chrono::nanoseconds safety_;
+
+  clock::time_point last_vblank_ {};
+  bool have_vblank_ = false;
+  unsigned int locked_count_ = 0;
+  uint64_t vblanks_ = 0;
+
+  double cost_ns_ = 0; /* smoothed time from starting a frame to issuing its swap */
+
+public:
+  /* nominal_period seeds the estimate (e.g. from the monitor's refresh rate);
+     safety is extra slack left before the predicted vblank */
+  explicit FramePacer( const std::chrono::nanoseconds nominal_period,
+                       const std::chrono::nanoseconds safety = std::chrono::microseconds( 500 ) );
+
+  /* feed the timing of each vsynced frame, in order */
+  void observe( const FrameTiming& timing );
+
+  /* first predicted vblank strictly after `now` */
+  clock::time_point next_vblank( const clock::time_point now ) const;
+
+  /* when to start drawing to make the earliest vblank still reachable from `now` */
+  clock::time_point submit_deadline( const clock::time_point now ) const;
+
+  std::chrono::nanoseconds period() const { return period_; }
+  std::chrono::nanoseconds draw_cost() const { return std::chrono::nanoseconds( int64_t( cost_ns_ ) ); }
+
+  /* enough consecutive vblanks have matched the prediction to trust it */
+  bool locked() const;
+
+  /* observations that matched the prediction and corrected it, ever */
+  uint64_t vblanks() const { return vblanks_; }
+};
@@ -0,0 +1,214 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "frame_stream.hh"
+#include "poller.hh"
+#include "threads.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+/* smallest power of two >= n, for the ring capacities */
+static size_t ring_capacity( const size_t n )
+{
+  size_t capacity = 1;
+  while ( capacity < n ) {
+    capacity *= 2;
+  }
+  return capacity;
+}
+
+FrameStream::FrameStream( const Y4MReader& reader, const unsigned int depth, const bool loop, const int loader_cpu )
+  : reader_( reader )
+  , loop_( loop )
+  , requests_( ring_capacity( depth ) )
+  , loaded_( ring_capacity( depth ) )
+{
+  if ( depth < 2 ) {
+    throw runtime_error( "FrameStream needs at least two slots" );
+  }
+
+  for ( unsigned int i = 0; i < depth; i++ ) {
+    slots_.push_back( make_unique<Slot>( reader_.width(), reader_.height() ) );
+
+    PixelUnpackBuffer::bind( slots_.back()->buffer );
+    PixelUnpackBuffer::allocate( reader_.frame_size(), GL_STREAM_DRAW );
+  }
+  PixelUnpackBuffer::unbind();
+
+  reader_.will_need( 0, depth );
+
+  loader_ = thread( &FrameStream::loader_loop, this, loader_cpu );
+
+  /* prime every slot (this is setup, so blocking is fine); the loader
+     must not outlive a constructor that throws */
+  try {
+    map_free_slots();
+    const auto loading = [&] {
+      for ( const auto& slot : slots_ ) {
+        if ( slot->state == SlotState::Loading ) {
+          return true;
+        }
+      }
+      return false;
+    };
+
+    while ( loading() ) {
+      const uint32_t seen = loaded_signal_.sequence();
+      if ( collect_loaded() == 0 ) {
+        loaded_signal_.wait( seen, milliseconds( 10 ) );
+      }
+    }
+  } catch ( ... ) {
+    stop_loader();
+    throw;
+  }
+}
+
+FrameStream::~FrameStream()
+{
+  stop_loader();
+}
+
+void FrameStream::stop_loader()
+{
+  running_ = false;
+  requested_.notify();
+  loader_.join();
+
+  /* release mappings the loader never got to */
+  for ( auto& slot : slots_ ) {
+    if ( slot->state == SlotState::Loading ) {
+      PixelUnpackBuffer::bind( slot->buffer );
+      glUnmapBuffer( PixelUnpackBuffer::id );
+    }
+  }
+  PixelUnpackBuffer::unbind();
+}
+
+/* Map free slots in ring order and queue them for the loader. Invalidating
+   the whole buffer lets the driver hand back fresh storage instead of
+   waiting for an earlier upload from the same buffer to finish. */
+void FrameStream::map_free_slots()
+{
+  bool queued = false;
+
+  while ( slots_[next_map_]->state == SlotState::Free ) {
+    if ( next_frame_ == reader_.frame_count() ) {
+      if ( not loop_ ) {
+        break;
+      }
+      next_frame_ = 0;
+    }
+
+    Slot& slot = *slots_[next_map_];
+    PixelUnpackBuffer::bind( slot.buffer );
+    void* const destination = glMapBufferRange(
+      PixelUnpackBuffer::id, 0, reader_.frame_size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+    if ( not destination ) {
+      PixelUnpackBuffer::unbind();
+      throw runtime_error( "could not map pixel buffer" );
+    }
+
+    requests_.push( { next_map_, next_frame_++, static_cast<uint8_t*>( destination ) } );
+    slot.state = SlotState::Loading;
+    next_map_ = ( next_map_ + 1 ) % slots_.size();
+    queued = true;
+  }
+
+  PixelUnpackBuffer::unbind();
+
+  if ( queued ) {
+    requested_.notify();
+  }
+}
+
+/* Unmap slots the loader has filled and start their texture uploads. The
+   source is a buffer object, so glTexSubImage2D returns without copying. */
+unsigned int FrameStream::collect_loaded()
+{
+  unsigned int count = 0;
+  unsigned int index;
+
+  while ( loaded_.pop( index ) ) {
+    Slot& slot = *slots_[index];
+    PixelUnpackBuffer::bind( slot.buffer );
+    if ( glUnmapBuffer( PixelUnpackBuffer::id ) != GL_TRUE ) {
+      PixelUnpackBuffer::unbind();
+      throw runtime_error( "pixel buffer contents were lost while mapped" );
+    }
+    slot.texture.load_from_buffer( 0 );
+    slot.state = SlotState::Ready;
+    count++;
+  }
+
+  PixelUnpackBuffer::unbind();
+  return count;
+}
+
+Texture420* FrameStream::next()
+{
+  collect_loaded();
+
+  Slot& candidate = *slots_[next_show_];
+  if ( candidate.state != SlotState::Ready ) {
+    stats_.repeated++;
+    map_free_slots();
+    return nullptr;
+  }
+
+  /* the slot shown until now can be refilled */
+  const unsigned int previous = ( next_show_ + slots_.size() - 1 ) % slots_.size();
+  if ( slots_[previous]->state == SlotState::Showing ) {
+    slots_[previous]->state = SlotState::Free;
+  }
+
+  candidate.state = SlotState::Showing;
+  next_show_ = ( next_show_ + 1 ) % slots_.size();
+  stats_.shown++;
+
+  map_free_slots();
+
+  candidate.texture.bind();
+  return &candidate.texture;
+}
+
+bool FrameStream::finished() const
+{
+  if ( loop_ or next_frame_ < reader_.frame_count() ) {
+    return false;
+  }
+
+  for ( const auto& slot : slots_ ) {
+    if ( slot->state == SlotState::Loading or slot->state == SlotState::Ready ) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void FrameStream::loader_loop( const int cpu )
+{
+  pin_this_thread( cpu );
+
+  /* not latency-critical: sleep as soon as there is nothing to copy */
+  Poller poller( PollMode::Block, &requested_, 0, milliseconds( 10 ) );
+  LoadRequest request;
+
+  while ( true ) {
+    const uint32_t seen = requested_.sequence();
+
+    if ( requests_.pop( request ) ) {
+      poller.reset();
+      memcpy( request.destination, reader_.frame( request.frame ), reader_.frame_size() );
+      reader_.will_need( request.frame + 1, slots_.size() );
+      loaded_.push( request.slot );
+      loaded_signal_.notify();
+    } else if ( not running_ ) {
+      return;
+    } else {
+      poller.idle( seen );
+    }
+  }
+}
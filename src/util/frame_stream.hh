@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gl_objects.hh"
+#include "spsc_ring.hh"
+#include "wake_signal.hh"
+#include "y4m_reader.hh"
+
+struct FrameStreamStats
+{
+  uint64_t shown = 0;    /* new frames returned by next() */
+  uint64_t repeated = 0; /* calls to next() that found no frame ready */
+};
+
+/* Streams the frames of a Y4MReader into textures without stalling the
+   render thread. Each slot of a small ring owns a pixel buffer object and a
+   texture. The render thread maps a free slot's buffer and hands the pointer
+   to a loader thread, which copies the frame out of the file mapping (taking
+   any page faults); the render thread then unmaps it and starts an
+   asynchronous PBO-to-texture upload, and shows the slot one or more frames
+   later.
+
+   Everything except the loader's memcpy runs on the thread whose GL context
+   was current at construction, and the stream must be destroyed on that
+   thread before the context goes away. */
+class FrameStream
+{
+  enum class SlotState
+  {
+    Free,
+    Loading, /* mapped and queued for (or being filled by) the loader */
+    Ready,   /* upload issued; can be shown */
+    Showing,
+  };
+
+  struct Slot
+  {
+    PixelBufferObject buffer {};
+    Texture420 texture;
+    SlotState state = SlotState::Free;
+
+    Slot( const unsigned int width, const unsigned int height )
+      : texture( width, height )
+    {}
+  };
+
+  struct LoadRequest
+  {
+    unsigned int slot;
+    size_t frame;
+    uint8_t* destination;
+  };
+
+  const Y4MReader& reader_;
+  bool loop_;
+
+  std::vector<std::unique_ptr<Slot>> slots_ {};
+  unsigned int next_map_ = 0, next_show_ = 0;
+  size_t next_frame_ = 0;
+  FrameStreamStats stats_ {};
+
+  SPSCRing<LoadRequest> requests_;
+  SPSCRing<unsigned int> loaded_;
+  WakeSignal requested_ {}, loaded_signal_ {};
+
+  std::atomic<bool> running_ { true };
+  std::thread loader_ {};
+
+  void map_free_slots();
+  unsigned int collect_loaded();
+  void loader_loop( const int cpu );
+  void stop_loader();
+
+public:
+  /* depth is the number of slots (2 = double buffered, 3 = triple buffered);
+     returns once every slot holds a frame */
+  FrameStream( const Y4MReader& reader,
+               const unsigned int depth = 3,
+               const bool loop = true,
+               const int loader_cpu = -1 );
+  ~FrameStream();
+
+  /* Call once per displayed frame. Returns the next frame's texture (bound
+     to the same units as Texture420::bind), or nullptr if it isn't ready
+     yet, in which case the caller should show the previous one again. */
+  Texture420* next();
+
+  /* true once a non-looping stream has shown its last frame */
+  bool finished() const;
+
+  const FrameStreamStats& stats() const { return stats_; }
+
+  /* forbid copying */
+  FrameStream( const FrameStream& other ) = delete;
+  FrameStream& operator=( const FrameStream& other ) = delete;
+};
@@ -0,0 +1,126 @@
+#include "frame_timer.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+FrameTimer::FrameTimer( const size_t capacity )
+  : gpu_supported_( GLEW_ARB_timer_query )
+  , completed_( capacity )
+{
+  if ( gpu_supported_ ) {
+    for ( auto& pending : pending_ ) {
+      glGenQueries( MARKS, pending.queries.data() );
+    }
+  }
+}
+
+FrameTimer::~FrameTimer()
+{
+  if ( gpu_supported_ ) {
+    for ( auto& pending : pending_ ) {
+      glDeleteQueries( MARKS, pending.queries.data() );
+    }
+  }
+}
+
+void FrameTimer::mark( const Mark mark )
+{
+  if ( gpu_supported_ ) {
+    glQueryCounter( current().queries[mark], GL_TIMESTAMP );
+  }
+}
+
+void FrameTimer::begin_frame()
+{
+  Pending& pending = current();
+
+  /* the GPU is more than DEPTH frames behind: give up on this slot's marks rather than wait */
+  if ( pending.outstanding ) {
+    gpu_overruns_++;
+    publish( pending );
+    next_collect_++;
+  }
+
+  pending.timing = {};
+  pending.timing.frame = next_frame_;
+  pending.timing.cpu_start = steady_clock::now();
+  mark( DRAW_START );
+}
+
+void FrameTimer::end_draw()
+{
+  mark( DRAW_END );
+  current().timing.cpu_submitted = steady_clock::now();
+}
+
+void FrameTimer::swapped()
+{
+  current().timing.cpu_swapped = steady_clock::now();
+  mark( SWAP );
+}
+
+void FrameTimer::finished()
+{
+  Pending& pending = current();
+  pending.timing.cpu_finished = steady_clock::now();
+  pending.outstanding = true;
+  next_frame_++;
+
+  collect();
+}
+
+void FrameTimer::completed( const uint64_t frame, const steady_clock::time_point when )
+{
+  Pending& pending = pending_[frame % DEPTH];
+  if ( pending.timing.frame == frame and ( pending.outstanding or frame == next_frame_ ) ) {
+    pending.timing.cpu_completed = when;
+  }
+}
+
+void FrameTimer::interrupted( const uint64_t frame )
+{
+  Pending& pending = pending_[frame % DEPTH];
+  if ( pending.timing.frame == frame ) {
+    pending.timing.interrupted = true;
+  }
+}
+
+void FrameTimer::publish( Pending& pending )
+{
+  pending.outstanding = false;
+  if ( not completed_.push( pending.timing ) ) {
+    dropped_++;
+  }
+}
+
+/* read back every frame whose queries have landed, oldest first */
+void FrameTimer::collect()
+{
+  while ( next_collect_ < next_frame_ ) {
+    Pending& pending = pending_[next_collect_ % DEPTH];
+
+    if ( track_completion_ and not pending.timing.completion_valid() ) {
+      return;
+    }
+
+    if ( gpu_supported_ ) {
+      /* queries complete in order, so the last mark being ready means all are */
+      GLint available = 0;
+      glGetQueryObjectiv( pending.queries[SWAP], GL_QUERY_RESULT_AVAILABLE, &available );
+      if ( not available ) {
+        return;
+      }
+
+      GLuint64 gpu[MARKS];
+      for ( unsigned int i = 0; i < MARKS; i++ ) {
+        glGetQueryObjectui64v( pending.queries[i], GL_QUERY_RESULT, &gpu[i] );
+      }
+      pending.timing.gpu_draw_start = gpu[DRAW_START];
+      pending.timing.gpu_draw_end = gpu[DRAW_END];
+      pending.timing.gpu_swap = gpu[SWAP];
+    }
+
+    publish( pending );
+    next_collect_++;
+  }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include "gl_objects.hh"
+#include "spsc_ring.hh"
+
+/* Where the time of one presented frame went. CPU marks come from
+   steady_clock on the render thread; GPU marks are GL_TIMESTAMP values (ns
+   on the GPU's clock, comparable only with each other) and are zero when
+   the driver lacks timer queries or the results were not collected in time. */
+struct FrameTiming
+{
+  using time_point = std::chrono::steady_clock::time_point;
+
+  uint64_t frame = 0;
+
+  time_point cpu_start {};     /* draw call began */
+  time_point cpu_submitted {}; /* draw commands issued, before the swap */
+  time_point cpu_swapped {};   /* SwapBuffers returned */
+  time_point cpu_finished {};  /* present() returned */
+  time_point cpu_completed {}; /* GPU completion observed (glFinish returned or fence seen signaled) */
+
+  uint64_t gpu_draw_start = 0, gpu_draw_end = 0, gpu_swap = 0;
+
+  bool interrupted = false; /* the wait for completion was cut short, so cpu_completed is late */
+
+  bool gpu_valid() const { return gpu_swap != 0; }
+  bool completion_valid() const { return cpu_completed != time_point {}; }
+
+  /* stages */
+  std::chrono::nanoseconds cpu_submit() const { return cpu_submitted - cpu_start; }
+  std::chrono::nanoseconds cpu_swap() const { return cpu_swapped - cpu_submitted; }
+  std::chrono::nanoseconds cpu_finish() const { return cpu_finished - cpu_swapped; }
+  std::chrono::nanoseconds cpu_complete() const { return cpu_completed - cpu_swapped; }
+  std::chrono::nanoseconds gpu_draw() const { return std::chrono::nanoseconds( gpu_draw_end - gpu_draw_start ); }
+  std::chrono::nanoseconds gpu_to_swap() const { return std::chrono::nanoseconds( gpu_swap - gpu_draw_end ); }
+};
+
+/* Brackets each frame with timestamp queries. Query results are read back
+   only once the GPU reports them available (a few frames later if the
+   frame isn't finished synchronously), so timing adds no sync points.
+   Completed records go into a preallocated ring for one consumer. */
+class FrameTimer
+{
+  enum Mark
+  {
+    DRAW_START,
+    DRAW_END,
+    SWAP,
+    MARKS,
+  };
+
+  constexpr static unsigned int DEPTH = 8; /* frames whose queries may be in flight */
+
+  struct Pending
+  {
+    FrameTiming timing {};
+    std::array<GLuint, MARKS> queries {};
+    bool outstanding = false;
+  };
+
+  bool gpu_supported_;
+  bool track_completion_ = true;
+  std::array<Pending, DEPTH> pending_ {};
+  uint64_t next_frame_ = 0, next_collect_ = 0;
+  uint64_t gpu_overruns_ = 0, dropped_ = 0;
+
+  SPSCRing<FrameTiming> completed_;
+
+  Pending& current() { return pending_[next_frame_ % DEPTH]; }
+  void mark( const Mark mark );
+  void publish( Pending& pending );
+
+public:
+  /* requires a current GL context */
+  explicit FrameTimer( const size_t capacity = 1024 );
+  ~FrameTimer();
+
+  /* called by the display around each frame, on the render thread */
+  void begin_frame();
+  void end_draw();
+  void swapped();
+  void finished();
+
+  /* GPU completion of `frame` was observed at `when` (may come after finished()) */
+  void completed( const uint64_t frame, const std::chrono::steady_clock::time_point when );
+
+  /* the display stopped waiting for the current frame to complete */
+  void interrupted( const uint64_t frame );
+
+  /* publish records whose results have arrived (done after every frame) */
+  void collect();
+
+  /* whether to hold each record until completed() is called for it */
+  void set_track_completion( const bool track ) { track_completion_ = track; }
+
+  /* number of the next frame to be drawn */
+  uint64_t next_frame() const { return next_frame_; }
+
+  /* completed frames, oldest first (one consumer thread) */
+  SPSCRing<FrameTiming>& timings() { return completed_; }
+
+  bool gpu_supported() const { return gpu_supported_; }
+  uint64_t gpu_overruns() const { return gpu_overruns_; } /* frames published without GPU marks */
+  uint64_t dropped() const { return dropped_; }           /* frames lost to a full ring */
+
+  /* forbid copying */
+  FrameTimer( const FrameTimer& other ) = delete;
+  FrameTimer& operator=( const FrameTimer& other ) = delete;
+};
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "gaze_source.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+/* Stateless pseudo-random numbers, so that sample i is the same no matter
+   when (or how often) it is generated */
+static uint64_t splitmix64( uint64_t x )
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+  x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebULL;
+  return x ^ ( x >> 31 );
+}
+
+static double uniform( const uint64_t seed, const uint64_t index, const uint64_t stream )
+{
+  const uint64_t bits = splitmix64( splitmix64( seed ^ ( stream << 56 ) ) ^ index );
+  return ( bits >> 11 ) * ( 1.0 / 9007199254740992.0 ); /* [0, 1) */
+}
+
+static double gaussian( const uint64_t seed, const uint64_t index, const uint64_t stream )
+{
+  const double u1 = max( uniform( seed, index, stream ), 1e-300 );
+  const double u2 = uniform( seed, index, stream + 1 );
+  return sqrt( -2.0 * log( u1 ) ) * cos( 2.0 * M_PI * u2 );
+}
+
+SyntheticGazeSource::SyntheticGazeSource( const SyntheticGazeConfig& config )
+  : config_( config )
+  , period_( nanoseconds( 1000000000 ) / max( config.rate_hz, 1u ) )
+{
+  if ( config_.rate_hz == 0 ) {
+    throw runtime_error( "synthetic gaze rate must be nonzero" );
+  }
+
+  sort( config_.saccade_onsets.begin(), config_.saccade_onsets.end() );
+}
+
+bool SyntheticGazeSource::start()
+{
+  start_time_ = steady_clock::now();
+  next_index_ = 0;
+  running_ = true;
+  return true;
+}
+
+void SyntheticGazeSource::stop()
+{
+  running_ = false;
+  time_requested_ = false;
+}
+
+bool SyntheticGazeSource::request_time()
+{
+  if ( not running_ ) {
+    return false;
+  }
+
+  requested_time_us_ = duration_cast<microseconds>( steady_clock::now() - start_time_ ).count();
+  time_requested_ = true;
+  return true;
+}
+
+bool SyntheticGazeSource::read_time( uint64_t& tracker_time_us )
+{
+  if ( not time_requested_ ) {
+    return false;
+  }
+
+  tracker_time_us = requested_time_us_;
+  time_requested_ = false;
+  return true;
+}
+
+bool SyntheticGazeSource::sample_at( const uint64_t index, GazeSample& sample ) const
+{
+  enum : uint64_t
+  {
+    DROP_STREAM = 1,
+    MISSING_STREAM,
+    NOISE_X_STREAM,
+    NOISE_Y_STREAM = NOISE_X_STREAM + 2,
+  };
+
+  if ( config_.drop_probability > 0 and uniform( config_.seed, index, DROP_STREAM ) < config_.drop_probability ) {
+    return false;
+  }
+
+  const uint64_t t_ns = index * period_.count();
+  sample.tracker_time_us = t_ns / 1000;
+
+  /* how far along the current saccade we are (0 = old position, 1 = new) */
+  const auto& onsets = config_.saccade_onsets;
+  const auto t = duration_cast<microseconds>( nanoseconds( t_ns ) );
+  const size_t passed = upper_bound( onsets.begin(), onsets.end(), t ) - onsets.begin();
+  double level = passed % 2;
+
+  if ( passed > 0 and config_.saccade_duration.count() > 0 ) {
+    const auto into = t - onsets[passed - 1];
+    if ( into < config_.saccade_duration ) {
+      const double progress = double( into.count() ) / config_.saccade_duration.count();
+      const double eased = ( 1.0 - cos( M_PI * progress ) ) / 2.0;
+      level = ( passed % 2 ) ? eased : 1.0 - eased;
+    }
+  }
+
+  sample.x = config_.fixation_x + level * config_.saccade_dx
+             + config_.noise_px * gaussian( config_.seed, index, NOISE_X_STREAM );
+  sample.y = config_.fixation_y + level * config_.saccade_dy
+             + config_.noise_px * gaussian( config_.seed, index, NOISE_Y_STREAM );
+
+  const bool missing
+    = config_.missing_probability > 0 and uniform( config_.seed, index, MISSING_STREAM ) < config_.missing_probability;
+  sample.pupil = missing ? 0 : 1000;
+
+  return true;
+}
+
+bool SyntheticGazeSource::newest_sample( GazeSample& sample )
+{
+  if ( not running_ ) {
+    return false;
+  }
+
+  const uint64_t available = ( steady_clock::now() - start_time_ ) / period_ + 1;
+
+  /* walk back from the newest sample until one survived the dropout */
+  for ( uint64_t index = available; index > next_index_; index-- ) {
+    if ( sample_at( index - 1, sample ) ) {
+      next_index_ = available;
+      return true;
+    }
+  }
+
+  next_index_ = available;
+  return false;
+}
+
+bool SyntheticGazeSource::next_sample( GazeSample& sample )
+{
+  if ( not running_ ) {
+    return false;
+  }
+
+  const uint64_t available = ( steady_clock::now() - start_time_ ) / period_ + 1;
+
+  while ( next_index_ < available ) {
+    if ( sample_at( next_index_++, sample ) ) {
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/* A single gaze sample in screen pixel coordinates */
+struct GazeSample
+{
+  uint64_t tracker_time_us = 0; /* timestamp assigned by the tracker (or generator) */
+  float x = 0, y = 0;           /* gaze position */
+  float pupil = 0;              /* pupil area; 0 if the pupil was not found */
+
+  bool valid() const { return pupil > 0; }
+};
+
+/* Anything that can feed gaze samples to the trigger loop */
+class GazeSource
+{
+public:
+  virtual ~GazeSource() {}
+
+  /* begin streaming samples; returns false if the source could not start */
+  virtual bool start() = 0;
+
+  /* stop streaming samples */
+  virtual void stop() = 0;
+
+  /* whether the source is still usable (e.g., the tracker link is up) */
+  virtual bool connected() const = 0;
+
+  /* fetch the newest sample, if one has arrived since the last call */
+  virtual bool newest_sample( GazeSample& sample ) = 0;
+
+  /* fetch the oldest sample not yet consumed, so that none are skipped */
+  virtual bool next_sample( GazeSample& sample ) = 0;
+
+  /* nominal samples per second */
+  virtual unsigned int sample_rate() const = 0;
+
+  /* Clock correlation: request_time() asks for the source's clock, and
+     read_time() returns true once the answer (in the same microseconds as
+     tracker_time_us) is in. Called only from the thread reading samples. */
+  virtual bool request_time() { return false; }
+  virtual bool read_time( uint64_t& /* tracker_time_us */ ) { return false; }
+
+  /* tick (us) that tracker_time_us and read_time() count in */
+  virtual unsigned int time_resolution_us() const { return 1; }
+};
+
+struct SyntheticGazeConfig
+{
+  unsigned int rate_hz = 1000; /* 500, 1000 or 2000 Hz, like the EyeLink 1000 */
+
+  float fixation_x = 960, fixation_y = 540; /* resting gaze position */
+  float noise_px = 0.5;                     /* std. deviation of fixation noise */
+
+  /* Each onset (relative to start()) toggles gaze between the fixation point
+     and the fixation point plus this offset, like the ASG switching LEDs. */
+  float saccade_dx = 200, saccade_dy = 0;
+  std::vector<std::chrono::microseconds> saccade_onsets = { std::chrono::milliseconds( 100 ) };
+
+  /* 0 gives an instantaneous step, otherwise a raised-cosine ramp */
+  std::chrono::microseconds saccade_duration { 0 };
+
+  double missing_probability = 0; /* chance a sample arrives without a pupil */
+  double drop_probability = 0;    /* chance a sample never arrives at all */
+
+  uint64_t seed = 1;
+};
+
+/* Generates tracker-like samples in real time without any hardware. Samples
+   are a pure function of their index, so the same stream can be replayed
+   offline through sample_at(). */
+class SyntheticGazeSource : public GazeSource
+{
+  SyntheticGazeConfig config_;
+  std::chrono::nanoseconds period_;
+
+  std::chrono::steady_clock::time_point start_time_ {};
+  bool running_ = false;
+  uint64_t next_index_ = 0; /* first index not yet handed out */
+  uint64_t requested_time_us_ = 0;
+  bool time_requested_ = false;
+
+public:
+  explicit SyntheticGazeSource( const SyntheticGazeConfig& config );
+
+  bool start() override;
+  void stop() override;
+  bool connected() const override { return true; }
+  bool newest_sample( GazeSample& sample ) override;
+  bool next_sample( GazeSample& sample ) override;
+  unsigned int sample_rate() const override { return config_.rate_hz; }
+
+  /* answered at once: the generator's clock is the host's, from start() */
+  bool request_time() override;
+  bool read_time( uint64_t& tracker_time_us ) override;
+
+  /* sample number `index`; returns false if that sample is dropped */
+  bool sample_at( const uint64_t index, GazeSample& sample ) const;
+
+  /* ground-truth onset of saccade `n`, in generator time */
+  uint64_t onset_time_us( const size_t n ) const { return config_.saccade_onsets.at( n ).count(); }
+
+  std::chrono::steady_clock::time_point start_time() const { return start_time_; }
+  std::chrono::nanoseconds period() const { return period_; }
+  const SyntheticGazeConfig& config() const { return config_; }
+};
@@ -24,6 +24,9 @@
    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
@@ -32,11 +35,21 @@
 
 using namespace std;
 
-GLFWContext::GLFWContext()
+unsigned int GLFWContext::users_ = 0;
+
+mutex& GLFWContext::mutex()
 {
-  glfwSetErrorCallback( error_callback );
+  static std::mutex glfw_mutex;
+  return glfw_mutex;
+}
 
-  glfwInit();
+GLFWContext::GLFWContext()
+{
+  lock_guard<std::mutex> lock( mutex() );
+  if ( users_++ == 0 ) {
+    glfwSetErrorCallback( error_callback );
+    glfwInit();
+  }
 }
 
 void GLFWContext::error_callback( const int, const char* const description )
@@ -46,12 +59,57 @@ void GLFWContext::error_callback( const int, const char* const description )
 
 GLFWContext::~GLFWContext()
 {
-  glfwTerminate();
+  lock_guard<std::mutex> lock( mutex() );
+  if ( --users_ == 0 ) {
+    glfwTerminate();
+  }
+}
+
+string DisplayMode::name() const
+{
+  return to_string( width ) + "x" + to_string( height ) + ( refresh_hz ? "@" + to_string( refresh_hz ) : "" );
+}
+
+DisplayMode parse_display_mode( const string& text )
+{
+  DisplayMode mode;
+  const size_t x = text.find( 'x' ), at = text.find( '@' );
+  try {
+    if ( x == string::npos or x == 0 ) {
+      throw runtime_error( "" );
+    }
+    mode.width = stoul( text.substr( 0, x ) );
+    mode.height = stoul( text.substr( x + 1, at == string::npos ? string::npos : at - x - 1 ) );
+    mode.refresh_hz = at == string::npos ? 0 : stoul( text.substr( at + 1 ) );
+  } catch ( const exception& ) {
+    throw runtime_error( "bad display mode: " + text + " (expected WIDTHxHEIGHT or WIDTHxHEIGHT@HZ)" );
+  }
+  return mode;
 }
 
-Window::Window( const unsigned int width, const unsigned int height, const string& title, const bool fullscreen )
+static GLFWmonitor* monitor_at( const unsigned int index )
+{
+  int count = 0;
+  GLFWmonitor** const monitors = glfwGetMonitors( &count );
+  if ( index >= unsigned( count ) ) {
+    throw runtime_error( "no monitor " + to_string( index ) + " (" + to_string( count ) + " connected)" );
+  }
+  return monitors[index];
+}
+
+Window::Window( const unsigned int width,
+                const unsigned int height,
+                const string& title,
+                const bool fullscreen,
+                const bool visible,
+                const unsigned int monitor,
+                const unsigned int refresh_hz )
   : window_()
+  , monitor_( nullptr )
 {
+  lock_guard<std::mutex> lock( GLFWContext::mutex() );
+  monitor_ = fullscreen ? monitor_at( monitor ) : glfwGetPrimaryMonitor();
+
   glfwDefaultWindowHints();
 
   glfwWindowHint( GLFW_CONTEXT_VERSION_MAJOR, 3 );
@@ -59,9 +117,11 @@ Window::Window( const unsigned int width, const unsigned int height, const strin
   glfwWindowHint( GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE );
 
   glfwWindowHint( GLFW_RESIZABLE, GL_TRUE );
+  glfwWindowHint( GLFW_VISIBLE, visible ? GL_TRUE : GL_FALSE );
+  glfwWindowHint( GLFW_REFRESH_RATE, refresh_hz ? int( refresh_hz ) : GLFW_DONT_CARE );
 
   window_.reset(
-    glfwCreateWindow( width, height, title.c_str(), fullscreen ? glfwGetPrimaryMonitor() : nullptr, nullptr ) );
+    glfwCreateWindow( width, height, title.c_str(), fullscreen ? monitor_ : nullptr, nullptr ) );
   if ( not window_.get() ) {
     throw runtime_error( "could not create window" );
   }
@@ -75,6 +135,8 @@ void Window::make_context_current()
   glewExperimental = GL_TRUE;
   glewInit();
   glCheck( "after initializing GLEW", true );
+
+  Texture::forget_bindings();
 }
 
 void Window::hide_cursor( const bool hidden )
@@ -111,22 +173,235 @@ pair<unsigned int, unsigned int> Window::window_size() const
   return { width, height };
 }
 
+int Window::refresh_rate() const
+{
+  lock_guard<std::mutex> lock( GLFWContext::mutex() );
+  const GLFWvidmode* const mode = monitor_ ? glfwGetVideoMode( monitor_ ) : nullptr;
+  return mode ? mode->refreshRate : 0;
+}
+
+DisplayMode Window::video_mode() const
+{
+  lock_guard<std::mutex> lock( GLFWContext::mutex() );
+  const GLFWvidmode* const mode = monitor_ ? glfwGetVideoMode( monitor_ ) : nullptr;
+  if ( not mode ) {
+    throw runtime_error( "no video mode for the window's monitor" );
+  }
+  return { unsigned( mode->width ), unsigned( mode->height ), unsigned( mode->refreshRate ) };
+}
+
+vector<DisplayMode> Window::video_modes( const unsigned int monitor )
+{
+  lock_guard<std::mutex> lock( GLFWContext::mutex() );
+  int count = 0;
+  const GLFWvidmode* const modes = glfwGetVideoModes( monitor_at( monitor ), &count );
+
+  /* GLFW lists each size and rate once per color depth */
+  vector<DisplayMode> ret;
+  for ( int i = 0; i < count; i++ ) {
+    const GLFWvidmode& vidmode = modes[i];
+    const DisplayMode mode { unsigned( vidmode.width ), unsigned( vidmode.height ), unsigned( vidmode.refreshRate ) };
+    if ( find( ret.begin(), ret.end(), mode ) == ret.end() ) {
+      ret.push_back( mode );
+    }
+  }
+  return ret;
+}
+
+vector<string> Window::monitor_names()
+{
+  lock_guard<std::mutex> lock( GLFWContext::mutex() );
+  int count = 0;
+  GLFWmonitor** const monitors = glfwGetMonitors( &count );
+
+  vector<string> names;
+  for ( int i = 0; i < count; i++ ) {
+    const char* const name = glfwGetMonitorName( monitors[i] );
+    const GLFWvidmode* const mode = glfwGetVideoMode( monitors[i] );
+    string description = name ? name : "unnamed";
+    if ( mode ) {
+      description += " (" + to_string( mode->width ) + "x" + to_string( mode->height ) + " @ "
+                     + to_string( mode->refreshRate ) + " Hz)";
+    }
+    names.push_back( description );
+  }
+  return names;
+}
+
 void Window::Deleter::operator()( GLFWwindow* x ) const
 {
+  lock_guard<std::mutex> lock( GLFWContext::mutex() );
   glfwHideWindow( x );
   glfwDestroyWindow( x );
 }
 
-void Texture::bind( const GLenum texture_unit ) const
+Framebuffer::Framebuffer( const unsigned int width, const unsigned int height )
+  : framebuffer_()
+  , renderbuffer_()
 {
-  glActiveTexture( texture_unit );
-  glBindTexture( GL_TEXTURE_RECTANGLE, num_ );
+  glGenFramebuffers( 1, &framebuffer_ );
+  glGenRenderbuffers( 1, &renderbuffer_ );
+
+  glBindRenderbuffer( GL_RENDERBUFFER, renderbuffer_ );
+  glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, width, height );
+
+  bind();
+  glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer_ );
+
+  if ( glCheckFramebufferStatus( GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE ) {
+    glDeleteFramebuffers( 1, &framebuffer_ );
+    glDeleteRenderbuffers( 1, &renderbuffer_ );
+    throw runtime_error( "offscreen framebuffer is incomplete" );
+  }
+}
+
+Framebuffer::~Framebuffer()
+{
+  glDeleteFramebuffers( 1, &framebuffer_ );
+  glDeleteRenderbuffers( 1, &renderbuffer_ );
+}
+
+void Plane::fill( const uint8_t value )
+{
+  memset( pixels_.data(), value, pixels_.size() );
+}
+
+void Plane::fill_rect( const unsigned int x,
+                       const unsigned int y,
+                       const unsigned int width,
+                       const unsigned int height,
+                       const uint8_t value )
+{
+  if ( x >= width_ or y >= height_ ) {
+    return;
+  }
+
+  const unsigned int span = min( width, width_ - x );
+  const unsigned int last_row = y + min( height, height_ - y );
+
+  for ( unsigned int row_num = y; row_num < last_row; row_num++ ) {
+    memset( row( row_num ) + x, value, span );
+  }
+}
+
+/* Patterns are built by generating each distinct row once and copying it
+   down the plane, which keeps the inner loops to memset/memcpy (vectorized
+   by libc) instead of per-pixel branches. */
+void Plane::fill_checkerboard( const unsigned int cell, const uint8_t a, const uint8_t b )
+{
+  if ( cell == 0 ) {
+    throw runtime_error( "checkerboard cell size must be nonzero" );
+  }
+
+  for ( unsigned int phase = 0; phase < 2 and phase * cell < height_; phase++ ) {
+    uint8_t* const first = row( phase * cell );
+    for ( unsigned int x = 0; x < width_; x += cell ) {
+      memset( first + x, ( ( x / cell + phase ) % 2 ) ? b : a, min( cell, width_ - x ) );
+    }
+  }
+
+  for ( unsigned int y = 0; y < height_; y++ ) {
+    const unsigned int source = ( ( y / cell ) % 2 ) * cell;
+    if ( y != source ) {
+      memcpy( row( y ), row( source ), width_ );
+    }
+  }
+}
+
+void Plane::fill_stripes( const unsigned int period, const uint8_t a, const uint8_t b, const bool vertical )
+{
+  if ( period == 0 ) {
+    throw runtime_error( "stripe period must be nonzero" );
+  }
+
+  if ( vertical ) {
+    for ( unsigned int x = 0; x < width_; x += period ) {
+      memset( row( 0 ) + x, ( ( x / period ) % 2 ) ? b : a, min( period, width_ - x ) );
+    }
+    for ( unsigned int y = 1; y < height_; y++ ) {
+      memcpy( row( y ), row( 0 ), width_ );
+    }
+  } else {
+    for ( unsigned int y = 0; y < height_; y++ ) {
+      memset( row( y ), ( ( y / period ) % 2 ) ? b : a, width_ );
+    }
+  }
+}
+
+/* Texture bindings of the context current on this thread. GL state is
+   per-context and a context is current on one thread at a time, so this
+   needs no locking. Unit 0 means "unknown". */
+namespace {
+struct TextureBindings
+{
+  GLenum active_unit = 0;
+  array<GLuint, 8> bound {}; /* indexed by unit - GL_TEXTURE0 */
+};
+
+thread_local TextureBindings texture_bindings;
+
+void select_texture_unit( const GLenum texture_unit )
+{
+  if ( texture_bindings.active_unit != texture_unit ) {
+    glActiveTexture( texture_unit );
+    texture_bindings.active_unit = texture_unit;
+  }
+}
+}
+
+void Texture::forget_bindings()
+{
+  texture_bindings = {};
+}
+
+Texture::Texture( const unsigned int width, const unsigned int height )
+  : num_()
+  , width_( width )
+  , height_( height )
+{
+  glGenTextures( 1, &num_ );
+  bind( GL_TEXTURE0 );
+
+  if ( GLEW_ARB_texture_storage ) {
+    glTexStorage2D( GL_TEXTURE_RECTANGLE, 1, GL_R8, width_, height_ );
+  } else {
+    glTexImage2D( GL_TEXTURE_RECTANGLE, 0, GL_R8, width_, height_, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr );
+  }
+
   glTexParameteri( GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
   glTexParameteri( GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
   glTexParameteri( GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
   glTexParameteri( GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
 }
 
+Texture::~Texture()
+{
+  glDeleteTextures( 1, &num_ );
+
+  /* deleting a texture unbinds it, and its name may be reused */
+  for ( auto& bound : texture_bindings.bound ) {
+    if ( bound == num_ ) {
+      bound = 0;
+    }
+  }
+}
+
+void Texture::bind( const GLenum texture_unit ) const
+{
+  const size_t unit = texture_unit - GL_TEXTURE0;
+  const bool cached = unit < texture_bindings.bound.size();
+
+  if ( cached and texture_bindings.bound[unit] == num_ ) {
+    return;
+  }
+
+  select_texture_unit( texture_unit );
+  glBindTexture( GL_TEXTURE_RECTANGLE, num_ );
+  if ( cached ) {
+    texture_bindings.bound[unit] = num_;
+  }
+}
+
 void Texture::load( const Plane& plane, const GLenum texture_unit )
 {
   if ( plane.width() != width() or plane.height() != height() ) {
@@ -135,10 +410,47 @@ void Texture::load( const Plane& plane, const GLenum texture_unit )
 
   bind( texture_unit );
 
+  /* glTexSubImage2D acts on the active unit's texture, which bind() may have skipped selecting */
+  select_texture_unit( texture_unit );
+
   glPixelStorei( GL_UNPACK_ROW_LENGTH, width_ );
-  glTexImage2D( GL_TEXTURE_RECTANGLE, 0, GL_RGBA8, width_, height_, 0, GL_BGRA, GL_UNSIGNED_BYTE, nullptr );
+  glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
   glTexSubImage2D(
-    GL_TEXTURE_RECTANGLE_ARB, 0, 0, 0, width_, height_, GL_LUMINANCE, GL_UNSIGNED_BYTE, &( plane.pixels().at( 0 ) ) );
+    GL_TEXTURE_RECTANGLE, 0, 0, 0, width_, height_, GL_RED, GL_UNSIGNED_BYTE, &( plane.pixels().at( 0 ) ) );
+}
+
+void Texture::load_from_buffer( const size_t offset, const GLenum texture_unit )
+{
+  bind( texture_unit );
+  select_texture_unit( texture_unit );
+
+  glPixelStorei( GL_UNPACK_ROW_LENGTH, width_ );
+  glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+  glTexSubImage2D( GL_TEXTURE_RECTANGLE,
+                   0,
+                   0,
+                   0,
+                   width_,
+                   height_,
+                   GL_RED,
+                   GL_UNSIGNED_BYTE,
+                   reinterpret_cast<const GLvoid*>( offset ) );
+}
+
+Texture420::Texture420( const unsigned int width, const unsigned int height )
+  : Y( width, height )
+  , Cb( width / 2, height / 2 )
+  , Cr( width / 2, height / 2 )
+{}
+
+void Texture420::load_from_buffer( const size_t offset )
+{
+  const size_t luma_size = size_t( Y.width() ) * Y.height();
+  const size_t chroma_size = size_t( Cb.width() ) * Cb.height();
+
+  Y.load_from_buffer( offset, GL_TEXTURE0 );
+  Cb.load_from_buffer( offset + luma_size, GL_TEXTURE1 );
+  Cr.load_from_buffer( offset + luma_size + chroma_size, GL_TEXTURE2 );
 }
 
 Texture420::Texture420( const Raster420& sample )
@@ -176,7 +488,7 @@ void compile_shader( const GLuint num, const string& source )
   glGetShaderiv( num, GL_INFO_LOG_LENGTH, &log_length );
 
   if ( log_length > 1 ) {
-    unique_ptr<GLchar> buffer( new GLchar[log_length] );
+    unique_ptr<GLchar[]> buffer( new GLchar[log_length] );
     GLsizei written_length;
     glGetShaderInfoLog( num, log_length, &written_length, buffer.get() );
 
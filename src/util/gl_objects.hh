@@ -31,18 +31,30 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
+/* GLFW is initialized by the first GLFWContext and terminated with the
+   last, so each display thread can hold one */
 class GLFWContext
 {
   static void error_callback( const int, const char* const description );
 
+  static unsigned int users_;
+
 public:
   GLFWContext();
   ~GLFWContext();
 
+  /* held around GLFW calls that aren't thread-safe (window creation,
+     destruction and monitor queries), so several display threads can
+     set up at once */
+  static std::mutex& mutex();
+
   /* forbid copy */
   GLFWContext( const GLFWContext& other ) = delete;
   GLFWContext& operator=( const GLFWContext& other ) = delete;
@@ -50,6 +62,24 @@ public:
 
 void glCheck( const std::string& where, bool ignore = false );
 
+/* A monitor video mode */
+struct DisplayMode
+{
+  unsigned int width = 1920, height = 1080;
+  unsigned int refresh_hz = 0; /* 0 for any (GLFW picks the highest) */
+
+  /* "1920x1080@240", or "1920x1080" without a rate */
+  std::string name() const;
+
+  bool operator==( const DisplayMode& other ) const
+  {
+    return width == other.width and height == other.height and refresh_hz == other.refresh_hz;
+  }
+};
+
+/* parses WIDTHxHEIGHT, optionally followed by @HZ */
+DisplayMode parse_display_mode( const std::string& text );
+
 class Window
 {
   struct Deleter
@@ -57,12 +87,19 @@ class Window
     void operator()( GLFWwindow* x ) const;
   };
   std::unique_ptr<GLFWwindow, Deleter> window_;
+  GLFWmonitor* monitor_; /* the monitor it is fullscreen on, or the primary */
 
 public:
+  /* monitor is an index into monitor_names() (0 is the primary); a
+     fullscreen window switches it to the closest video mode to width x
+     height at refresh_hz (0 for any rate) */
   Window( const unsigned int width,
           const unsigned int height,
           const std::string& title,
-          const bool fullscreen = false );
+          const bool fullscreen = false,
+          const bool visible = true,
+          const unsigned int monitor = 0,
+          const unsigned int refresh_hz = 0 );
   void make_context_current();
   bool should_close() const { return glfwWindowShouldClose( window_.get() ); }
   void swap_buffers() { glfwSwapBuffers( window_.get() ); }
@@ -71,6 +108,22 @@ public:
   bool key_pressed( const int key ) const;
   std::pair<unsigned int, unsigned int> framebuffer_size() const;
   std::pair<unsigned int, unsigned int> window_size() const;
+
+  /* refresh rate of the window's monitor's current video mode in Hz (0 if unknown) */
+  int refresh_rate() const;
+
+  /* the window's monitor's current video mode */
+  DisplayMode video_mode() const;
+
+  /* connected monitors, primary first (needs a GLFWContext) */
+  static std::vector<std::string> monitor_names();
+
+  /* a monitor's distinct video modes, ascending (needs a GLFWContext) */
+  static std::vector<DisplayMode> video_modes( const unsigned int monitor );
+
+  /* forbid copying */
+  Window( const Window& other ) = delete;
+  Window& operator=( const Window& other ) = delete;
 };
 
 struct VertexObject
@@ -96,10 +149,16 @@ public:
     glBufferData( id, vertices.size() * sizeof( VertexObject ), &vertices.front(), usage );
   }
 
+  /* (re)allocate uninitialized storage for the bound buffer */
+  static void allocate( const size_t size, const GLenum usage ) { glBufferData( id, size, nullptr, usage ); }
+
+  static void unbind() { glBindBuffer( id_, 0 ); }
+
   constexpr static GLenum id = id_;
 };
 
 using ArrayBuffer = Buffer<GL_ARRAY_BUFFER>;
+using PixelUnpackBuffer = Buffer<GL_PIXEL_UNPACK_BUFFER>;
 
 class VertexBufferObject
 {
@@ -120,6 +179,42 @@ public:
   VertexBufferObject& operator=( const VertexBufferObject& other ) = delete;
 };
 
+class PixelBufferObject
+{
+  friend PixelUnpackBuffer;
+
+  GLuint num_;
+
+public:
+  PixelBufferObject()
+    : num_()
+  {
+    glGenBuffers( 1, &num_ );
+  }
+  ~PixelBufferObject() { glDeleteBuffers( 1, &num_ ); }
+
+  /* forbid copy */
+  PixelBufferObject( const PixelBufferObject& other ) = delete;
+  PixelBufferObject& operator=( const PixelBufferObject& other ) = delete;
+};
+
+/* Offscreen render target: a framebuffer object with one RGBA8 color renderbuffer */
+class Framebuffer
+{
+  GLuint framebuffer_, renderbuffer_;
+
+public:
+  Framebuffer( const unsigned int width, const unsigned int height );
+  ~Framebuffer();
+
+  /* direct drawing (and reads) here instead of the window */
+  void bind() { glBindFramebuffer( GL_FRAMEBUFFER, framebuffer_ ); }
+
+  /* forbid copy */
+  Framebuffer( const Framebuffer& other ) = delete;
+  Framebuffer& operator=( const Framebuffer& other ) = delete;
+};
+
 class VertexArrayObject
 {
   GLuint num_;
@@ -169,6 +264,24 @@ public:
 
     return pixels_.at( y * width_ + x );
   }
+
+  /* Fast builders: these write whole rows at a time with no per-pixel checks */
+  uint8_t* row( const unsigned int y ) { return pixels_.data() + size_t( y ) * width_; }
+
+  void fill( const uint8_t value );
+
+  /* rectangle is clipped to the plane */
+  void fill_rect( const unsigned int x,
+                  const unsigned int y,
+                  const unsigned int width,
+                  const unsigned int height,
+                  const uint8_t value );
+
+  /* alternating a/b squares of side `cell`, with `a` at the top left */
+  void fill_checkerboard( const unsigned int cell, const uint8_t a, const uint8_t b );
+
+  /* alternating a/b bands `period` pixels wide */
+  void fill_stripes( const unsigned int period, const uint8_t a, const uint8_t b, const bool vertical );
 };
 
 /* Raster of 4:2:0 8-bit Y'CbCr samples
@@ -183,6 +296,13 @@ public:
     , Cb( width / 2, height / 2 )
     , Cr( width / 2, height / 2 )
   {}
+
+  void fill( const uint8_t y, const uint8_t cb = 128, const uint8_t cr = 128 )
+  {
+    Y.fill( y );
+    Cb.fill( cb );
+    Cr.fill( cr );
+  }
 };
 
 class Texture
@@ -191,21 +311,23 @@ class Texture
   unsigned int width_, height_;
 
 public:
-  Texture( const unsigned int width, const unsigned int height )
-    : num_()
-    , width_( width )
-    , height_( height )
-  {
-    glGenTextures( 1, &num_ );
-  }
-
-  ~Texture() { glDeleteTextures( 1, &num_ ); }
+  /* allocates immutable single-channel (R8) storage and sets sampler state once */
+  Texture( const unsigned int width, const unsigned int height );
+  ~Texture();
 
+  /* skips the GL calls if this texture is already bound to the unit */
   void bind( const GLenum texture_unit ) const;
   void load( const Plane& raster, const GLenum texture_unit );
+
+  /* upload from `offset` bytes into the bound pixel unpack buffer (returns without waiting for the copy) */
+  void load_from_buffer( const size_t offset, const GLenum texture_unit );
+
   unsigned int width() const { return width_; }
   unsigned int height() const { return height_; }
 
+  /* the bind cache tracks the current context, so it must be reset when another one is made current */
+  static void forget_bindings();
+
   /* disallow copy */
   Texture( const Texture& other ) = delete;
   Texture& operator=( const Texture& other ) = delete;
@@ -216,7 +338,11 @@ struct Texture420
   Texture Y, Cb, Cr;
 
   explicit Texture420( const Raster420& sample );
+  Texture420( const unsigned int width, const unsigned int height );
   void load( const Raster420& raster );
+
+  /* upload a frame stored as consecutive Y', Cb and Cr planes in the bound pixel unpack buffer */
+  void load_from_buffer( const size_t offset );
   void bind() const;
 };
 
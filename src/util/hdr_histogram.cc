@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "hdr_histogram.hh"
+
+using namespace std;
+
+static unsigned int top_bit( const uint64_t value )
+{
+  return 63 - __builtin_clzll( value );
+}
+
+HdrHistogram::HdrHistogram( const uint64_t highest, const unsigned int bits )
+  : bits_( bits )
+  , highest_( highest )
+  , counts_()
+{
+  if ( bits < 2 or bits > 20 or highest < ( uint64_t( 1 ) << bits ) ) {
+    throw runtime_error( "HdrHistogram: bits must be 2-20 and the range at least 2^bits" );
+  }
+  counts_.resize( index( highest ) + 1 );
+}
+
+/* values below 2^bits map to themselves; above, the bucket is the shift
+   that brings the value into [2^(bits-1), 2^bits), times the buckets per
+   shift, plus the shifted value */
+size_t HdrHistogram::index( const uint64_t value ) const
+{
+  if ( value < ( uint64_t( 1 ) << bits_ ) ) {
+    return value;
+  }
+  const unsigned int shift = top_bit( value ) - ( bits_ - 1 );
+  return ( size_t( shift ) << ( bits_ - 1 ) ) + ( value >> shift );
+}
+
+uint64_t HdrHistogram::lowest_in( const size_t index ) const
+{
+  if ( index < ( size_t( 1 ) << bits_ ) ) {
+    return index;
+  }
+  const unsigned int shift = ( index >> ( bits_ - 1 ) ) - 1;
+  return uint64_t( index - ( size_t( shift ) << ( bits_ - 1 ) ) ) << shift;
+}
+
+uint64_t HdrHistogram::highest_in( const size_t index ) const
+{
+  return lowest_in( index + 1 ) - 1;
+}
+
+void HdrHistogram::add( const uint64_t value )
+{
+  counts_[index( std::min( value, highest_ ) )]++;
+
+  min_ = count_ ? std::min( min_, value ) : value;
+  max_ = count_ ? std::max( max_, value ) : value;
+  sum_ += value;
+  count_++;
+}
+
+void HdrHistogram::merge( const HdrHistogram& other )
+{
+  if ( other.bits_ != bits_ or other.highest_ != highest_ ) {
+    throw runtime_error( "HdrHistogram: can't merge histograms with different bits or range" );
+  }
+  if ( other.count_ == 0 ) {
+    return;
+  }
+
+  for ( size_t i = 0; i < counts_.size(); i++ ) {
+    counts_[i] += other.counts_[i];
+  }
+
+  min_ = count_ ? std::min( min_, other.min_ ) : other.min_;
+  max_ = count_ ? std::max( max_, other.max_ ) : other.max_;
+  sum_ += other.sum_;
+  count_ += other.count_;
+}
+
+void HdrHistogram::clear()
+{
+  fill( counts_.begin(), counts_.end(), 0 );
+  count_ = min_ = max_ = 0;
+  sum_ = 0;
+}
+
+double HdrHistogram::stddev() const
+{
+  if ( count_ == 0 ) {
+    return 0;
+  }
+
+  const double average = mean();
+  double sum_squares = 0;
+  for ( size_t i = 0; i < counts_.size(); i++ ) {
+    if ( counts_[i] ) {
+      const double deviation = ( lowest_in( i ) + highest_in( i ) ) / 2.0 - average;
+      sum_squares += counts_[i] * deviation * deviation;
+    }
+  }
+  return sqrt( sum_squares / count_ );
+}
+
+uint64_t HdrHistogram::percentile( const double fraction ) const
+{
+  if ( count_ == 0 ) {
+    return 0;
+  }
+  if ( fraction <= 0 ) {
+    return min_;
+  }
+
+  const uint64_t rank = std::max<uint64_t>( 1, ceil( fraction * count_ ) );
+  uint64_t seen = 0;
+  for ( size_t i = 0; i < counts_.size(); i++ ) {
+    seen += counts_[i];
+    if ( seen >= rank ) {
+      return clamp( highest_in( i ), min_, max_ );
+    }
+  }
+  return max_;
+}
+
+void HdrHistogram::save( ostream& out ) const
+{
+  out << "hdr " << bits_ << " " << highest_ << " " << count_ << " " << min_ << " " << max_ << " " << sum_ << "\n";
+  for ( size_t i = 0; i < counts_.size(); i++ ) {
+    if ( counts_[i] ) {
+      out << i << " " << counts_[i] << "\n";
+    }
+  }
+  out << "end\n";
+}
+
+HdrHistogram HdrHistogram::load( istream& in )
+{
+  string tag;
+  unsigned int bits;
+  uint64_t highest;
+  if ( not( in >> tag >> bits >> highest ) or tag != "hdr" ) {
+    throw runtime_error( "HdrHistogram: bad header" );
+  }
+
+  HdrHistogram ret( highest, bits );
+  if ( not( in >> ret.count_ >> ret.min_ >> ret.max_ >> ret.sum_ ) ) {
+    throw runtime_error( "HdrHistogram: bad header" );
+  }
+
+  while ( in >> tag and tag != "end" ) {
+    const size_t index = stoull( tag );
+    uint64_t count;
+    if ( index >= ret.counts_.size() or not( in >> count ) ) {
+      throw runtime_error( "HdrHistogram: bad bucket" );
+    }
+    ret.counts_[index] = count;
+  }
+  return ret;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+/* Histogram of non-negative integers with bounded relative error, in fixed
+   memory. Values below 2^bits are counted exactly; above that, each
+   power-of-two range is split into 2^(bits-1) equal buckets, so a bucket is
+   never wider than 1/2^(bits-1) of the values in it. add() is a few
+   shifts and an increment. Values above `highest` are counted in the top
+   bucket (and in max()). */
+class HdrHistogram
+{
+  unsigned int bits_;
+  uint64_t highest_;
+  std::vector<uint64_t> counts_;
+
+  uint64_t count_ = 0;
+  uint64_t min_ = 0, max_ = 0;
+  double sum_ = 0;
+
+  size_t index( const uint64_t value ) const;
+  uint64_t lowest_in( const size_t index ) const;
+  uint64_t highest_in( const size_t index ) const;
+
+public:
+  /* the default tracks up to about 17 minutes of microseconds to within 1% */
+  explicit HdrHistogram( const uint64_t highest = uint64_t( 1 ) << 30, const unsigned int bits = 8 );
+
+  void add( const uint64_t value );
+  void merge( const HdrHistogram& other ); /* must have the same bits and range */
+  void clear();
+
+  uint64_t count() const { return count_; }
+  uint64_t min() const { return min_; }
+  uint64_t max() const { return max_; }
+  double mean() const { return count_ ? sum_ / count_ : 0; }
+  double stddev() const; /* from the bucket midpoints, so to within a bucket */
+
+  /* the smallest value at or above `fraction` of the values (to within a bucket) */
+  uint64_t percentile( const double fraction ) const;
+
+  /* text form: a header line, then "index count" for the non-empty buckets */
+  void save( std::ostream& out ) const;
+  static HdrHistogram load( std::istream& in );
+};
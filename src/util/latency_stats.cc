@@ -0,0 +1,75 @@
+#include <iomanip>
+#include <stdexcept>
+
+#include "latency_stats.hh"
+
+using namespace std;
+
+size_t LatencyStats::add_metric( const string& name )
+{
+  for ( size_t i = 0; i < metrics_.size(); i++ ) {
+    if ( metrics_[i].name == name ) {
+      return i;
+    }
+  }
+
+  metrics_.push_back( { name, HdrHistogram(), HdrHistogram() } );
+  return metrics_.size() - 1;
+}
+
+void LatencyStats::record( const size_t metric, const HdrHistogram& values )
+{
+  metrics_[metric].recent.merge( values );
+  metrics_[metric].total.merge( values );
+}
+
+void LatencyStats::print( ostream& out, const HdrHistogram& histogram )
+{
+  out << "n " << setw( 7 ) << histogram.count() << "  p50 " << setw( 7 ) << histogram.percentile( 0.5 ) << "  p99 "
+      << setw( 7 ) << histogram.percentile( 0.99 ) << "  p99.9 " << setw( 7 ) << histogram.percentile( 0.999 )
+      << "  max " << setw( 7 ) << histogram.max();
+}
+
+void LatencyStats::report( ostream& out )
+{
+  for ( auto& metric : metrics_ ) {
+    out << "  " << left << setw( 20 ) << metric.name << right;
+    print( out, metric.recent );
+    out << "  | run: ";
+    print( out, metric.total );
+    out << "\n";
+    metric.recent.clear();
+  }
+}
+
+void LatencyStats::summary( ostream& out ) const
+{
+  for ( const auto& metric : metrics_ ) {
+    out << "  " << left << setw( 20 ) << metric.name << right;
+    print( out, metric.total );
+    out << "\n";
+  }
+}
+
+void LatencyStats::save( ostream& out ) const
+{
+  for ( const auto& metric : metrics_ ) {
+    out << "metric " << metric.name << "\n";
+    metric.total.save( out );
+  }
+}
+
+void LatencyStats::merge( istream& in )
+{
+  string tag;
+  while ( in >> tag ) {
+    if ( tag != "metric" ) {
+      throw runtime_error( "LatencyStats: expected a metric, got \"" + tag + "\"" );
+    }
+
+    string name;
+    getline( in >> ws, name );
+    const HdrHistogram saved = HdrHistogram::load( in );
+    metrics_[add_metric( name )].total.merge( saved );
+  }
+}
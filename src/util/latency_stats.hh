@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "hdr_histogram.hh"
+
+/* Named latency distributions for live reporting. Each metric keeps an
+   HdrHistogram since the last report and one over the whole run, so
+   recording is O(1) and memory is fixed however long the run. */
+class LatencyStats
+{
+  struct Metric
+  {
+    std::string name;
+    HdrHistogram recent, total;
+  };
+
+  std::vector<Metric> metrics_ {};
+
+  static void print( std::ostream& out, const HdrHistogram& histogram );
+
+public:
+  /* returns the id to record() with */
+  size_t add_metric( const std::string& name );
+
+  void record( const size_t metric, const uint64_t value )
+  {
+    metrics_[metric].recent.add( value );
+    metrics_[metric].total.add( value );
+  }
+
+  void record( const size_t metric, const HdrHistogram& values );
+
+  /* a metric's distribution over the run */
+  const HdrHistogram& total( const size_t metric ) const { return metrics_.at( metric ).total; }
+
+  /* a line per metric: p50, p99, p99.9 and max since the last report and
+     over the run; then starts a new reporting interval */
+  void report( std::ostream& out );
+
+  /* a line per metric, over the run */
+  void summary( std::ostream& out ) const;
+
+  /* the run's histograms, by name, for merging across runs */
+  void save( std::ostream& out ) const;
+
+  /* add a saved run's histograms (creating metrics as needed) */
+  void merge( std::istream& in );
+};
@@ -0,0 +1,56 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mirrored_ring.hh"
+
+using namespace std;
+
+static size_t round_to_pages( const size_t size )
+{
+  const size_t page = sysconf( _SC_PAGESIZE );
+  return ( size + page - 1 ) / page * page;
+}
+
+MirroredRing::MirroredRing( const size_t capacity )
+  : capacity_( round_to_pages( capacity ) )
+  , base_( nullptr )
+{
+  const int fd = memfd_create( "mirrored_ring", MFD_CLOEXEC );
+  if ( fd < 0 ) {
+    throw runtime_error( string( "memfd_create: " ) + strerror( errno ) );
+  }
+
+  if ( ftruncate( fd, capacity_ ) < 0 ) {
+    close( fd );
+    throw runtime_error( string( "ftruncate: " ) + strerror( errno ) );
+  }
+
+  /* reserve both halves, then map the same pages into each */
+  void* const reserved = mmap( nullptr, 2 * capacity_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if ( reserved == MAP_FAILED ) {
+    close( fd );
+    throw runtime_error( string( "mmap: " ) + strerror( errno ) );
+  }
+  base_ = static_cast<uint8_t*>( reserved );
+
+  for ( const size_t half : { size_t( 0 ), capacity_ } ) {
+    if ( mmap( base_ + half, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0 ) == MAP_FAILED ) {
+      const int error = errno;
+      munmap( base_, 2 * capacity_ );
+      close( fd );
+      throw runtime_error( string( "mmap: " ) + strerror( error ) );
+    }
+  }
+
+  close( fd ); /* the mappings keep the memory alive */
+}
+
+MirroredRing::~MirroredRing()
+{
+  munmap( base_, 2 * capacity_ );
+}
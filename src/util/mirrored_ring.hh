@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* Byte ring whose storage is mapped twice, back to back, so every readable
+   or writable span is contiguous in memory however it straddles the end.
+   read() can fill it in place and parsers can look at frames where they
+   landed, with no copying or wraparound logic. Not thread-safe: one
+   thread writes and reads. */
+class MirroredRing
+{
+  size_t capacity_;
+  uint8_t* base_;
+  uint64_t read_ = 0, write_ = 0;
+
+public:
+  /* capacity is rounded up to a whole number of pages */
+  explicit MirroredRing( const size_t capacity );
+  ~MirroredRing();
+
+  size_t capacity() const { return capacity_; }
+  size_t readable() const { return write_ - read_; }
+  size_t writable() const { return capacity_ - readable(); }
+
+  /* readable() bytes start here */
+  const uint8_t* read_ptr() const { return base_ + read_ % capacity_; }
+  void consume( const size_t length ) { read_ += length; }
+
+  /* writable() bytes of space start here */
+  uint8_t* write_ptr() { return base_ + write_ % capacity_; }
+  void commit( const size_t length ) { write_ += length; }
+
+  /* forbid copying */
+  MirroredRing( const MirroredRing& other ) = delete;
+  MirroredRing& operator=( const MirroredRing& other ) = delete;
+};
@@ -0,0 +1,89 @@
+#include <stdexcept>
+#include <thread>
+
+#include <sched.h>
+
+#include "poller.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+PollMode parse_poll_mode( const string& name )
+{
+  if ( name == "spin" ) {
+    return PollMode::Spin;
+  } else if ( name == "pause" ) {
+    return PollMode::SpinPause;
+  } else if ( name == "yield" ) {
+    return PollMode::SpinYield;
+  } else if ( name == "block" ) {
+    return PollMode::Block;
+  }
+
+  throw runtime_error( "unknown poll mode: " + name + " (expected spin, pause, yield or block)" );
+}
+
+string poll_mode_name( const PollMode mode )
+{
+  switch ( mode ) {
+    case PollMode::Spin:
+      return "spin";
+    case PollMode::SpinPause:
+      return "pause";
+    case PollMode::SpinYield:
+      return "yield";
+    case PollMode::Block:
+      return "block";
+  }
+
+  throw runtime_error( "invalid poll mode" );
+}
+
+Poller::Poller( const PollMode mode,
+                WakeSignal* signal,
+                const unsigned int spin_limit,
+                const nanoseconds block_timeout )
+  : mode_( mode )
+  , signal_( signal )
+  , spin_limit_( spin_limit )
+  , block_timeout_( block_timeout )
+{}
+
+void Poller::idle( const uint32_t seen, const nanoseconds timeout )
+{
+  if ( mode_ == PollMode::Spin ) {
+    return;
+  }
+
+  if ( idle_count_ < spin_limit_ ) {
+    idle_count_++;
+    return;
+  }
+
+  switch ( mode_ ) {
+    case PollMode::SpinPause: {
+      /* exponential backoff, capped so a wakeup is never more than ~1k pauses away */
+      const unsigned int pauses = 1u << min( idle_count_ - spin_limit_, 10u );
+      for ( unsigned int i = 0; i < pauses; i++ ) {
+        cpu_relax();
+      }
+      idle_count_++;
+      break;
+    }
+
+    case PollMode::SpinYield:
+      sched_yield();
+      break;
+
+    case PollMode::Block:
+      if ( signal_ ) {
+        signal_->wait( seen, timeout );
+      } else {
+        this_thread::sleep_for( timeout );
+      }
+      break;
+
+    case PollMode::Spin:
+      break;
+  }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "wake_signal.hh"
+
+/* How a thread waits when it polls and finds nothing to do */
+enum class PollMode
+{
+  Spin,      /* re-check immediately, forever */
+  SpinPause, /* spin, then back off with CPU pause hints */
+  SpinYield, /* spin, then give up the core with sched_yield() */
+  Block,     /* spin, then sleep until woken (or a timeout) */
+};
+
+PollMode parse_poll_mode( const std::string& name );
+std::string poll_mode_name( const PollMode mode );
+
+/* pause hint for spin loops */
+inline void cpu_relax()
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+  __builtin_ia32_pause();
+#elif defined( __aarch64__ )
+  asm volatile( "yield" );
+#endif
+}
+
+/* Backoff for a polling loop:
+
+     while ( running ) {
+       const uint32_t seen = signal.sequence();
+       if ( found_work() ) { poller.reset(); ... } else { poller.idle( seen ); }
+     }
+
+   In Block mode the poller sleeps on the WakeSignal (or, without one, for
+   the block timeout) once the spin budget is used up. */
+class Poller
+{
+  PollMode mode_;
+  WakeSignal* signal_;
+  unsigned int spin_limit_;
+  std::chrono::nanoseconds block_timeout_;
+
+  unsigned int idle_count_ = 0;
+
+public:
+  Poller( const PollMode mode,
+          WakeSignal* signal = nullptr,
+          const unsigned int spin_limit = 1000,
+          const std::chrono::nanoseconds block_timeout = std::chrono::microseconds( 100 ) );
+
+  /* called when work was found */
+  void reset() { idle_count_ = 0; }
+
+  /* called when no work was found; `seen` is the signal sequence taken before looking */
+  void idle( const uint32_t seen = 0 ) { idle( seen, block_timeout_ ); }
+  void idle( const uint32_t seen, const std::chrono::nanoseconds timeout );
+
+  PollMode mode() const { return mode_; }
+
+  /* forbid copying */
+  Poller( const Poller& other ) = delete;
+  Poller& operator=( const Poller& other ) = delete;
+};
@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "record_log.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+static const char MAGIC[] = "GLDLOG1\n";
+constexpr size_t MAGIC_SIZE = sizeof( MAGIC ) - 1;
+
+static void put_varint( vector<uint8_t>& out, uint64_t value )
+{
+  while ( value >= 0x80 ) {
+    out.push_back( uint8_t( value ) | 0x80 );
+    value >>= 7;
+  }
+  out.push_back( uint8_t( value ) );
+}
+
+static void put_string( vector<uint8_t>& out, const string& str )
+{
+  put_varint( out, str.size() );
+  out.insert( out.end(), str.begin(), str.end() );
+}
+
+/* small positive and negative deltas both become small unsigned values */
+static uint64_t zigzag( const int64_t value )
+{
+  return ( uint64_t( value ) << 1 ) ^ uint64_t( value >> 63 );
+}
+
+static int64_t unzigzag( const uint64_t value )
+{
+  return int64_t( value >> 1 ) ^ -int64_t( value & 1 );
+}
+
+RecordLog::RecordLog( const string& path, const milliseconds interval )
+  : file_( path, ios::binary | ios::trunc )
+  , interval_( interval )
+{
+  if ( not file_ ) {
+    throw runtime_error( "could not create " + path );
+  }
+  file_.write( MAGIC, MAGIC_SIZE );
+  stats_.bytes = MAGIC_SIZE;
+
+  thread_ = thread( &RecordLog::loop, this );
+}
+
+RecordLog::~RecordLog()
+{
+  {
+    lock_guard<mutex> lock( mutex_ );
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  thread_.join();
+}
+
+uint32_t RecordLog::add_table( const string& name, const vector<string>& columns )
+{
+  if ( columns.empty() or columns.size() > MAX_COLUMNS ) {
+    throw runtime_error( "table " + name + " must have between 1 and " + to_string( MAX_COLUMNS ) + " columns" );
+  }
+
+  lock_guard<mutex> lock( mutex_ );
+  tables_.push_back( { name, columns, vector<vector<int64_t>>( columns.size() ), false } );
+  for ( auto& column : tables_.back().pending ) {
+    column.reserve( BLOCK_ROWS );
+  }
+  return tables_.size() - 1;
+}
+
+RecordLog::Writer::Writer( RecordLog& log, const size_t capacity )
+  : log_( log )
+  , ring_( capacity )
+{
+  lock_guard<mutex> lock( log_.mutex_ );
+  log_.writers_.push_back( this );
+}
+
+RecordLog::Writer::~Writer()
+{
+  lock_guard<mutex> lock( log_.mutex_ );
+  log_.drain( *this );
+  log_.stats_.dropped += dropped_.load( memory_order_relaxed );
+  log_.writers_.erase( find( log_.writers_.begin(), log_.writers_.end(), this ) );
+}
+
+void RecordLog::flush()
+{
+  unique_lock<mutex> lock( mutex_ );
+  const uint64_t ticket = ++flush_requested_;
+  wake_.notify_all();
+  flushed_.wait( lock, [&] { return flush_done_ >= ticket; } );
+}
+
+RecordLogStats RecordLog::stats() const
+{
+  lock_guard<mutex> lock( mutex_ );
+  RecordLogStats ret = stats_;
+  for ( const auto& writer : writers_ ) {
+    ret.dropped += writer->dropped_.load( memory_order_relaxed );
+  }
+  return ret;
+}
+
+void RecordLog::loop()
+{
+  unique_lock<mutex> lock( mutex_ );
+  while ( true ) {
+    wake_.wait_for( lock, interval_, [&] { return stopping_ or flush_requested_ > flush_done_; } );
+
+    const bool stopping = stopping_;
+    const uint64_t requested = flush_requested_;
+    drain();
+
+    if ( stopping or requested > flush_done_ ) {
+      for ( uint32_t id = 0; id < tables_.size(); id++ ) {
+        write_block( id, tables_[id] );
+      }
+      file_.flush();
+      flush_done_ = requested;
+      flushed_.notify_all();
+    }
+
+    if ( stopping ) {
+      return;
+    }
+  }
+}
+
+/* move queued rows into their tables, writing any block that fills up */
+void RecordLog::drain()
+{
+  for ( Writer* const writer : writers_ ) {
+    drain( *writer );
+  }
+}
+
+void RecordLog::drain( Writer& writer )
+{
+  Record record;
+  while ( writer.ring_.pop( record ) ) {
+    if ( record.table >= tables_.size() or record.count > tables_[record.table].columns.size() ) {
+      stats_.malformed++;
+      continue;
+    }
+
+    Table& table = tables_[record.table];
+    for ( size_t i = 0; i < table.pending.size(); i++ ) {
+      table.pending[i].push_back( i < record.count ? record.values[i] : NO_VALUE );
+    }
+    if ( table.pending.front().size() == BLOCK_ROWS ) {
+      write_block( record.table, table );
+    }
+  }
+}
+
+void RecordLog::write_block( const uint32_t id, Table& table )
+{
+  const size_t rows = table.pending.front().size();
+  if ( rows == 0 ) {
+    return;
+  }
+
+  if ( not table.defined ) {
+    chunk_.clear();
+    chunk_.push_back( 'T' );
+    put_varint( chunk_, id );
+    put_string( chunk_, table.name );
+    put_varint( chunk_, table.columns.size() );
+    for ( const auto& column : table.columns ) {
+      put_string( chunk_, column );
+    }
+    write_chunk();
+    table.defined = true;
+  }
+
+  /* payload first, so its length can go in the chunk header */
+  vector<uint8_t> payload;
+  payload.reserve( rows * table.columns.size() * 2 );
+  for ( auto& column : table.pending ) {
+    int64_t previous = 0;
+    for ( const int64_t value : column ) {
+      put_varint( payload, zigzag( int64_t( uint64_t( value ) - uint64_t( previous ) ) ) );
+      previous = value;
+    }
+    column.clear();
+  }
+
+  chunk_.clear();
+  chunk_.push_back( 'B' );
+  put_varint( chunk_, id );
+  put_varint( chunk_, rows );
+  put_varint( chunk_, payload.size() );
+  chunk_.insert( chunk_.end(), payload.begin(), payload.end() );
+  write_chunk();
+
+  stats_.records += rows;
+  stats_.blocks++;
+}
+
+void RecordLog::write_chunk()
+{
+  file_.write( reinterpret_cast<const char*>( chunk_.data() ), chunk_.size() );
+  stats_.bytes += chunk_.size();
+}
+
+/* reading */
+
+static uint64_t get_varint( istream& in )
+{
+  uint64_t value = 0;
+  for ( unsigned int shift = 0; shift < 64; shift += 7 ) {
+    const int byte = in.get();
+    if ( byte == EOF ) {
+      throw runtime_error( "record log: truncated varint" );
+    }
+    value |= uint64_t( byte & 0x7f ) << shift;
+    if ( not( byte & 0x80 ) ) {
+      return value;
+    }
+  }
+  throw runtime_error( "record log: varint too long" );
+}
+
+static uint64_t get_varint( const uint8_t*& in, const uint8_t* const end )
+{
+  uint64_t value = 0;
+  for ( unsigned int shift = 0; shift < 64 and in < end; shift += 7 ) {
+    const uint8_t byte = *in++;
+    value |= uint64_t( byte & 0x7f ) << shift;
+    if ( not( byte & 0x80 ) ) {
+      return value;
+    }
+  }
+  throw runtime_error( "record log: bad block" );
+}
+
+static string get_string( istream& in )
+{
+  string str( get_varint( in ), '\0' );
+  if ( not in.read( str.data(), str.size() ) ) {
+    throw runtime_error( "record log: truncated string" );
+  }
+  return str;
+}
+
+RecordLogReader::RecordLogReader( const string& path )
+  : file_( path, ios::binary )
+{
+  char magic[MAGIC_SIZE];
+  if ( not file_.read( magic, MAGIC_SIZE ) or memcmp( magic, MAGIC, MAGIC_SIZE ) != 0 ) {
+    throw runtime_error( path + ": not a record log" );
+  }
+}
+
+bool RecordLogReader::next( uint32_t& table, vector<vector<int64_t>>& columns )
+{
+  while ( true ) {
+    const int kind = file_.get();
+    if ( kind == EOF ) {
+      return false;
+    }
+
+    const uint64_t id = get_varint( file_ );
+
+    if ( kind == 'T' ) {
+      Table defined;
+      defined.name = get_string( file_ );
+      const uint64_t count = get_varint( file_ );
+      for ( uint64_t i = 0; i < count; i++ ) {
+        defined.columns.push_back( get_string( file_ ) );
+      }
+      if ( id >= tables_.size() ) {
+        tables_.resize( id + 1 );
+      }
+      tables_[id] = defined;
+      continue;
+    }
+
+    if ( kind != 'B' or id >= tables_.size() or tables_[id].columns.empty() ) {
+      throw runtime_error( "record log: unexpected chunk" );
+    }
+
+    const uint64_t rows = get_varint( file_ );
+    vector<uint8_t> payload( get_varint( file_ ) );
+    if ( not file_.read( reinterpret_cast<char*>( payload.data() ), payload.size() ) ) {
+      throw runtime_error( "record log: truncated block" );
+    }
+
+    const uint8_t* in = payload.data();
+    const uint8_t* const end = in + payload.size();
+    columns.resize( tables_[id].columns.size() );
+    for ( auto& column : columns ) {
+      column.resize( rows );
+      int64_t previous = 0;
+      for ( auto& value : column ) {
+        value = int64_t( uint64_t( previous ) + uint64_t( unzigzag( get_varint( in, end ) ) ) );
+        previous = value;
+      }
+    }
+
+    table = id;
+    return true;
+  }
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <initializer_list>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spsc_ring.hh"
+
+/* A log file of tables of 64-bit integers, written by a background thread.
+
+   Producing threads each own a Writer, which copies a fixed-size record
+   into its own preallocated SPSC ring: no locks, allocation or system
+   calls. Every few milliseconds the log thread drains the rings of the
+   writers that exist, gathers each table's rows into blocks and writes
+   them column by column.
+
+   On disk: the magic "GLDLOG1\n", then chunks. A 'T' chunk defines a
+   table (id, name, column names); a 'B' chunk holds a block of rows for
+   one table (id, rows, payload bytes), each column stored as the
+   zigzag-varint deltas between successive values. Timestamps and counters
+   change slowly from row to row, so most values take a byte or two. */
+
+struct RecordLogStats
+{
+  uint64_t records = 0;   /* rows written to the file */
+  uint64_t dropped = 0;   /* rows lost because a writer's ring was full */
+  uint64_t malformed = 0; /* rows for an unknown table, or with too many values */
+  uint64_t blocks = 0;    /* 'B' chunks written */
+  uint64_t bytes = 0;     /* file size so far */
+};
+
+class RecordLog
+{
+public:
+  constexpr static size_t MAX_COLUMNS = 15;
+  constexpr static int64_t NO_VALUE = std::numeric_limits<int64_t>::min(); /* exported as an empty field */
+
+  struct Record
+  {
+    uint32_t table = 0;
+    uint32_t count = 0;
+    int64_t values[MAX_COLUMNS] {};
+  };
+
+  /* The producer side, for exactly one thread. The log drains it from
+     construction until destruction, which hands over any rows still
+     queued; it must not outlive the log. */
+  class Writer
+  {
+    RecordLog& log_;
+    SPSCRing<Record> ring_;
+    std::atomic<uint64_t> dropped_ { 0 };
+
+    friend class RecordLog;
+
+  public:
+    explicit Writer( RecordLog& log, const size_t capacity = 4096 );
+    ~Writer();
+
+    /* queue one row (missing trailing values are NO_VALUE); false if the ring was full */
+    bool write( const uint32_t table, const std::initializer_list<int64_t> values )
+    {
+      Record record;
+      record.table = table;
+      record.count = values.size();
+      size_t i = 0;
+      for ( const int64_t value : values ) {
+        if ( i == MAX_COLUMNS ) {
+          break;
+        }
+        record.values[i++] = value;
+      }
+
+      if ( not ring_.push( record ) ) {
+        dropped_.fetch_add( 1, std::memory_order_relaxed );
+        return false;
+      }
+      return true;
+    }
+
+    /* forbid copying */
+    Writer( const Writer& other ) = delete;
+    Writer& operator=( const Writer& other ) = delete;
+  };
+
+private:
+  constexpr static size_t BLOCK_ROWS = 1024;
+
+  struct Table
+  {
+    std::string name {};
+    std::vector<std::string> columns {};
+    std::vector<std::vector<int64_t>> pending {}; /* rows not yet written, by column */
+    bool defined = false;                          /* 'T' chunk written */
+  };
+
+  std::ofstream file_;
+  std::chrono::milliseconds interval_;
+
+  /* guards everything below; producers never take it */
+  mutable std::mutex mutex_ {};
+  std::condition_variable wake_ {}, flushed_ {};
+  std::vector<Table> tables_ {};
+  std::vector<Writer*> writers_ {};
+  uint64_t flush_requested_ = 0, flush_done_ = 0;
+  bool stopping_ = false;
+
+  RecordLogStats stats_ {};
+  std::vector<uint8_t> chunk_ {};
+  std::thread thread_ {};
+
+  void loop();
+  void drain();
+  void drain( Writer& writer );
+  void write_block( const uint32_t id, Table& table );
+  void write_chunk();
+
+public:
+  /* the file is created (or truncated) now; rows are written at least every `interval` */
+  explicit RecordLog( const std::string& path,
+                      const std::chrono::milliseconds interval = std::chrono::milliseconds( 20 ) );
+
+  /* writes out everything queued */
+  ~RecordLog();
+
+  /* returns the table's id, for Writer::write() */
+  uint32_t add_table( const std::string& name, const std::vector<std::string>& columns );
+
+  /* block until every row queued before the call is in the file */
+  void flush();
+
+  RecordLogStats stats() const;
+
+  /* forbid copying */
+  RecordLog( const RecordLog& other ) = delete;
+  RecordLog& operator=( const RecordLog& other ) = delete;
+};
+
+/* Reads a RecordLog file back, one block at a time */
+class RecordLogReader
+{
+public:
+  struct Table
+  {
+    std::string name {};
+    std::vector<std::string> columns {};
+  };
+
+private:
+  std::ifstream file_;
+  std::vector<Table> tables_ {};
+
+public:
+  explicit RecordLogReader( const std::string& path );
+
+  /* the next block of rows, by column; false at the end of the file */
+  bool next( uint32_t& table, std::vector<std::vector<int64_t>>& columns );
+
+  /* tables defined so far */
+  const std::vector<Table>& tables() const { return tables_; }
+};
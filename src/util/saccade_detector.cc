@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "saccade_detector.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+/* a span in whole samples at the given rate, at least one */
+static unsigned int samples_in( const microseconds span, const unsigned int rate_hz )
+{
+  return max<uint64_t>( 1, uint64_t( span.count() ) * rate_hz / 1000000 );
+}
+
+SaccadeDetector::SaccadeDetector( const SaccadeDetectorConfig& config )
+  : config_( config )
+  , span_( samples_in( config.velocity_span, config.rate_hz ) )
+  , smooth_( samples_in( config.smoothing, config.rate_hz ) )
+{
+  if ( span_ + smooth_ > WINDOW ) {
+    throw runtime_error( "velocity span plus smoothing must be at most " + to_string( WINDOW ) + " samples" );
+  }
+
+  if ( config_.confirm_samples == 0 ) {
+    config_.confirm_samples = 1;
+  }
+}
+
+void SaccadeDetector::reset()
+{
+  count_ = 0;
+  velocity_ = acceleration_ = 0;
+  fast_run_ = 0;
+  fired_ = false;
+}
+
+bool SaccadeDetector::add( const GazeSample& sample )
+{
+  /* a missing pupil (blink, dropout) breaks the velocity estimate */
+  if ( not sample.valid() ) {
+    count_ = 0;
+    fast_run_ = 0;
+    return false;
+  }
+
+  window_[count_ % WINDOW] = { sample.tracker_time_us, sample.x, sample.y };
+  count_++;
+
+  if ( count_ < span_ + smooth_ ) {
+    return false;
+  }
+
+  const Point& newest = window_[( count_ - 1 ) % WINDOW];
+  const Point& oldest = window_[( count_ - 1 - span_ ) % WINDOW];
+
+  /* coarse tracker timestamps can repeat at high sample rates */
+  if ( newest.t_us <= oldest.t_us ) {
+    return false;
+  }
+
+  /* the displacement between the means of the newest and of the oldest samples */
+  float dx = 0, dy = 0;
+  for ( unsigned int i = 0; i < smooth_; i++ ) {
+    const Point& late = window_[( count_ - 1 - i ) % WINDOW];
+    const Point& early = window_[( count_ - 1 - span_ - i ) % WINDOW];
+    dx += late.x - early.x;
+    dy += late.y - early.y;
+  }
+
+  const float dt = ( newest.t_us - oldest.t_us ) * 1e-6f;
+  const float speed = hypotf( dx, dy ) / ( smooth_ * dt );
+
+  /* acceleration across the same span, once there is a speed that far back */
+  speeds_[( count_ - 1 ) % WINDOW] = speed;
+  acceleration_ = count_ >= 2 * span_ + smooth_ ? ( speed - speeds_[( count_ - 1 - span_ ) % WINDOW] ) / dt : 0;
+  velocity_ = speed;
+
+  bool fast = speed >= config_.velocity_threshold;
+
+  if ( not fast and config_.extrapolate and speed >= config_.velocity_threshold * config_.rearm_fraction
+       and acceleration_ >= config_.acceleration_threshold ) {
+    /* the estimate is the mean speed over the span, so it trails the
+       current speed by about half a span's worth of acceleration */
+    fast = speed + acceleration_ * dt / 2 >= config_.velocity_threshold;
+  }
+
+  if ( not fast ) {
+    fast_run_ = 0;
+    /* hysteresis, so that noise around the threshold mid-saccade doesn't re-fire */
+    if ( speed < config_.velocity_threshold * config_.rearm_fraction ) {
+      fired_ = false;
+    }
+    return false;
+  }
+
+  if ( fast_run_++ == 0 ) {
+    onset_time_us_ = oldest.t_us;
+  }
+
+  if ( fired_ or fast_run_ < config_.confirm_samples ) {
+    return false;
+  }
+
+  fired_ = true;
+  return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include "gaze_source.hh"
+
+struct SaccadeDetectorConfig
+{
+  float velocity_threshold = 5000;        /* gaze speed (px/s) that signals a saccade */
+  float acceleration_threshold = 1000000; /* px/s^2 needed before extrapolating */
+
+  /* The spans are times, so that one setting suits every sample rate. Over
+     4 ms even 2 px of fixation noise stays well below the threshold, and a
+     saccade is still caught in its first few milliseconds. */
+  unsigned int rate_hz = 1000;                       /* the tracker's sample rate */
+  std::chrono::microseconds velocity_span { 4000 }; /* between the endpoints of each velocity estimate */
+  std::chrono::microseconds smoothing { 1000 };     /* samples averaged into each endpoint */
+  unsigned int confirm_samples = 1;                  /* consecutive fast samples needed to fire */
+
+  /* after firing, speed must drop below this fraction of the threshold to re-arm */
+  float rearm_fraction = 0.5;
+
+  /* fire early when the speed plus the acceleration over half a span (the
+     estimate's lag behind the current speed) would cross the threshold */
+  bool extrapolate = false;
+};
+
+/* Online saccade detector over a fixed-size window of recent samples.
+   Velocity is the Euclidean displacement across velocity_span, so purely
+   horizontal or vertical saccades fire as readily as diagonal ones; each
+   endpoint is the mean of the samples in `smoothing` (at least one).
+   add() is O(1) and never allocates. */
+class SaccadeDetector
+{
+public:
+  constexpr static unsigned int WINDOW = 32; /* power of two >= span + smoothing, in samples */
+
+private:
+  struct Point
+  {
+    uint64_t t_us;
+    float x, y;
+  };
+
+  SaccadeDetectorConfig config_;
+  unsigned int span_, smooth_; /* velocity_span and smoothing in samples */
+
+  std::array<Point, WINDOW> window_ {};
+  std::array<float, WINDOW> speeds_ {}; /* the velocity estimate at each sample in the window */
+  uint64_t count_ = 0; /* samples in the window since the last reset */
+
+  float velocity_ = 0, acceleration_ = 0;
+
+  unsigned int fast_run_ = 0;  /* consecutive samples above threshold */
+  bool fired_ = false;         /* latched until gaze slows down again */
+  uint64_t onset_time_us_ = 0; /* start of the current fast run */
+
+public:
+  explicit SaccadeDetector( const SaccadeDetectorConfig& config );
+
+  /* forget all history (e.g., at the start of a trial) */
+  void reset();
+
+  /* feed the next sample; returns true exactly once per detected saccade */
+  bool add( const GazeSample& sample );
+
+  float velocity() const { return velocity_; }
+  float acceleration() const { return acceleration_; }
+
+  /* estimated tracker time at which the last detected saccade began */
+  uint64_t onset_time_us() const { return onset_time_us_; }
+
+  const SaccadeDetectorConfig& config() const { return config_; }
+};
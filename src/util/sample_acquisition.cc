@@ -0,0 +1,168 @@
+#include <algorithm>
+
+#include "sample_acquisition.hh"
+#include "threads.hh"
+
+#define BLOCK_POLL_US 20 /* sleep between link polls in Block mode */
+
+using namespace std;
+using namespace std::chrono;
+
+SampleAcquisition::SampleAcquisition( GazeSource& source,
+                                      const size_t capacity,
+                                      const PollMode mode,
+                                      const ThreadProfile& profile )
+  : source_( source )
+  , ring_( capacity )
+  , mode_( mode )
+  , profile_( profile )
+{}
+
+SampleAcquisition::~SampleAcquisition()
+{
+  stop();
+}
+
+void SampleAcquisition::start()
+{
+  stop();
+
+  /* discard anything left over from a previous run */
+  TimedSample stale;
+  while ( ring_.pop( stale ) ) {
+  }
+
+  received_ = dropped_ = overflowed_ = 0;
+  cpu_time_ns_ = 0;
+  tracker_sync_ = ClockSync( source_.time_resolution_us() );
+  arrival_latency_.clear();
+  time_requests_ = time_timeouts_ = 0;
+  {
+    lock_guard<mutex> lock( clock_mutex_ );
+    tracker_clock_ = ClockEstimate();
+  }
+  running_ = true;
+  thread_ = thread( &SampleAcquisition::loop, this );
+}
+
+void SampleAcquisition::stop()
+{
+  running_ = false;
+  if ( thread_.joinable() ) {
+    thread_.join();
+  }
+}
+
+/* one step of the tracker clock exchange: collect an answer, give up on a
+   lost request, or send the next one when it is due */
+void SampleAcquisition::poll_tracker_clock( const steady_clock::time_point now,
+                                            bool& requested,
+                                            steady_clock::time_point& requested_at )
+{
+  if ( requested ) {
+    uint64_t tracker_time_us;
+    if ( source_.read_time( tracker_time_us ) ) {
+      requested = false;
+
+      /* the tracker reports one time for both directions */
+      ClockExchange exchange;
+      exchange.host_sent = requested_at;
+      exchange.host_received = now;
+      exchange.remote_received_us = exchange.remote_sent_us = uint32_t( tracker_time_us );
+      tracker_sync_.add( exchange );
+
+      lock_guard<mutex> lock( clock_mutex_ );
+      tracker_clock_ = tracker_sync_.estimate();
+    } else if ( now - requested_at > TIME_REQUEST_TIMEOUT ) {
+      requested = false;
+      time_timeouts_++;
+    }
+    return;
+  }
+
+  const auto interval = time_requests_ < FAST_REQUESTS ? TIME_REQUEST_FAST : TIME_REQUEST_INTERVAL;
+  if ( time_requests_ == 0 or now - requested_at >= interval ) {
+    requested_at = now;
+    if ( source_.request_time() ) {
+      requested = true;
+      time_requests_++;
+    }
+  }
+}
+
+void SampleAcquisition::loop()
+{
+  TimedSample entry;
+  uint64_t first_time_us = 0;
+  uint64_t received = 0;
+  const uint64_t rate = source_.sample_rate();
+  bool time_requested = false;
+  steady_clock::time_point requested_at {};
+
+  apply_thread_profile( profile_ );
+  /* nothing signals a new sample on the link, so in Block mode this thread
+     sleeps in short steps rather than until woken */
+  Poller poller( mode_, nullptr, 1000, microseconds( BLOCK_POLL_US ) );
+
+  while ( running_.load( memory_order_relaxed ) ) {
+    if ( not source_.next_sample( entry.sample ) ) {
+      poll_tracker_clock( steady_clock::now(), time_requested, requested_at );
+      poller.idle();
+      continue;
+    }
+    entry.arrival = steady_clock::now();
+    poller.reset();
+
+    /* the sample's age on arrival, on the host clock */
+    const ClockEstimate& clock = tracker_sync_.estimate();
+    if ( clock.valid ) {
+      const auto taken = clock.host_at( uint32_t( entry.sample.tracker_time_us ), entry.arrival );
+      arrival_latency_.add( max<int64_t>( 0, duration_cast<microseconds>( entry.arrival - taken ).count() ) );
+    }
+
+    if ( received == 0 ) {
+      first_time_us = entry.sample.tracker_time_us;
+    }
+    received++;
+
+    /* Estimate drops from the span of tracker time covered so far rather
+       than sample-to-sample gaps, which are unreliable when the timestamp
+       resolution (1 ms on the EyeLink) is coarser than the sample period. */
+    const uint64_t span_us = entry.sample.tracker_time_us - first_time_us;
+    const uint64_t expected = ( span_us * rate + 500000 ) / 1000000 + 1;
+    dropped_.store( expected > received ? expected - received : 0, memory_order_relaxed );
+    received_.store( received, memory_order_relaxed );
+
+    if ( ring_.push( entry ) ) {
+      data_ready_.notify();
+    } else {
+      overflowed_.fetch_add( 1, memory_order_relaxed );
+    }
+  }
+
+  cpu_time_ns_ = thread_cpu_time().count();
+}
+
+AcquisitionStats SampleAcquisition::stats() const
+{
+  AcquisitionStats ret;
+  ret.received = received_.load( memory_order_relaxed );
+  ret.dropped = dropped_.load( memory_order_relaxed );
+  ret.overflowed = overflowed_.load( memory_order_relaxed );
+  ret.cpu_time = nanoseconds( cpu_time_ns_.load() );
+
+  /* the thread's own records are only read once it has finished */
+  if ( not thread_.joinable() ) {
+    ret.arrival_latency = arrival_latency_;
+    ret.time_requests = time_requests_;
+    ret.time_timeouts = time_timeouts_;
+  }
+  ret.tracker_clock = tracker_clock();
+  return ret;
+}
+
+ClockEstimate SampleAcquisition::tracker_clock() const
+{
+  lock_guard<mutex> lock( clock_mutex_ );
+  return tracker_clock_;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "clock_sync.hh"
+#include "gaze_source.hh"
+#include "hdr_histogram.hh"
+#include "poller.hh"
+#include "spsc_ring.hh"
+#include "threads.hh"
+#include "wake_signal.hh"
+
+/* A gaze sample stamped with the host time at which it was pulled off the link */
+struct TimedSample
+{
+  GazeSample sample {};
+  std::chrono::steady_clock::time_point arrival {};
+};
+
+struct AcquisitionStats
+{
+  uint64_t received = 0;   /* samples pulled from the source */
+  uint64_t dropped = 0;    /* samples the tracker timestamps say we never saw */
+  uint64_t overflowed = 0; /* samples lost because the ring was full */
+
+  std::chrono::nanoseconds cpu_time { 0 }; /* consumed by the acquisition thread */
+
+  /* How long (us) after the tracker timestamped each sample it was pulled
+     off the link, on the host clock, from the moment the tracker clock
+     estimate became valid (an apparent negative age counts as zero). Filled
+     in when the thread stops. */
+  HdrHistogram arrival_latency {};
+  ClockEstimate tracker_clock {};
+  uint64_t time_requests = 0, time_timeouts = 0;
+
+
+  double dropped_fraction() const
+  {
+    const uint64_t expected = received + dropped;
+    return expected ? double( dropped ) / expected : 0;
+  }
+};
+
+/* Dedicated thread that drains every sample from a GazeSource into a
+   preallocated SPSC ring. The source must be started before start() and
+   must not be used by any other thread until stop() returns.
+
+   Between samples the thread also asks the source for its clock (every
+   10 ms at first, then every 50 ms) and fits the tracker clock to the
+   host's with ClockSync, so each sample's tracker timestamp can be placed
+   on the host timeline. The source's clock may restart with each
+   recording, so the estimate starts over with each start(). */
+class SampleAcquisition
+{
+  constexpr static auto TIME_REQUEST_FAST = std::chrono::milliseconds( 10 );
+  constexpr static auto TIME_REQUEST_INTERVAL = std::chrono::milliseconds( 50 );
+  constexpr static auto TIME_REQUEST_TIMEOUT = std::chrono::milliseconds( 50 );
+  constexpr static unsigned int FAST_REQUESTS = 8;
+
+  GazeSource& source_;
+  SPSCRing<TimedSample> ring_;
+  WakeSignal data_ready_ {};
+
+  PollMode mode_;
+  ThreadProfile profile_;
+
+  std::atomic<bool> running_ { false };
+  std::atomic<uint64_t> received_ { 0 }, dropped_ { 0 }, overflowed_ { 0 };
+  std::atomic<int64_t> cpu_time_ns_ { 0 };
+  std::thread thread_ {};
+
+  /* owned by the thread while it runs */
+  ClockSync tracker_sync_ {};
+  HdrHistogram arrival_latency_ {};
+  uint64_t time_requests_ = 0, time_timeouts_ = 0;
+
+  mutable std::mutex clock_mutex_ {};
+  ClockEstimate tracker_clock_ {}; /* copy of the latest estimate, for other threads */
+
+  void loop();
+  void poll_tracker_clock( const std::chrono::steady_clock::time_point now,
+                           bool& requested,
+                           std::chrono::steady_clock::time_point& requested_at );
+
+public:
+  /* capacity must be a power of two; the thread applies `profile` when it starts */
+  SampleAcquisition( GazeSource& source,
+                     const size_t capacity = 4096,
+                     const PollMode mode = PollMode::Spin,
+                     const ThreadProfile& profile = {} );
+  ~SampleAcquisition();
+
+  void start();
+  void stop();
+
+  /* consumer side: moves up to max_count samples into out, oldest first */
+  size_t read( TimedSample* out, const size_t max_count ) { return ring_.pop( out, max_count ); }
+
+  /* notified after every sample pushed, for consumers that block */
+  WakeSignal& data_ready() { return data_ready_; }
+
+  /* safe to call while running; complete once stop() has returned */
+  AcquisitionStats stats() const;
+
+  /* the tracker clock as of the latest time exchange */
+  ClockEstimate tracker_clock() const;
+
+  /* forbid copying */
+  SampleAcquisition( const SampleAcquisition& other ) = delete;
+  SampleAcquisition& operator=( const SampleAcquisition& other ) = delete;
+};
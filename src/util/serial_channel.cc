@@ -0,0 +1,410 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "serial_channel.hh"
+#include "threads.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t QUEUE_CAPACITY = 64;
+static constexpr auto FAST_PING_INTERVAL = milliseconds( 10 ); /* until the first estimates are in */
+static constexpr unsigned int FAST_PINGS = 32;
+static constexpr auto PING_TIMEOUT = milliseconds( 100 );
+
+static runtime_error errno_error( const string& what )
+{
+  return runtime_error( what + ": " + strerror( errno ) );
+}
+
+speed_t baud_constant( const unsigned int rate )
+{
+  switch ( rate ) {
+    case 9600:
+      return B9600;
+    case 57600:
+      return B57600;
+    case 115200:
+      return B115200;
+    case 230400:
+      return B230400;
+    case 500000:
+      return B500000;
+    case 1000000:
+      return B1000000;
+    case 2000000:
+      return B2000000;
+    default:
+      throw runtime_error( "unsupported baud rate " + to_string( rate ) );
+  }
+}
+
+/* 8N1, raw (no line discipline, echo or flow control), non-blocking reads */
+static void make_raw( const int fd, const speed_t baud )
+{
+  termios tty;
+  if ( tcgetattr( fd, &tty ) < 0 ) {
+    throw errno_error( "tcgetattr" );
+  }
+
+  cfmakeraw( &tty );
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cflag &= ~( CSTOPB | CRTSCTS );
+  tty.c_cc[VMIN] = 0;
+  tty.c_cc[VTIME] = 0;
+
+  if ( cfsetospeed( &tty, baud ) < 0 or cfsetispeed( &tty, baud ) < 0 ) {
+    throw errno_error( "cfsetspeed" );
+  }
+
+  if ( tcsetattr( fd, TCSANOW, &tty ) < 0 ) {
+    throw errno_error( "tcsetattr" );
+  }
+
+  tcflush( fd, TCIOFLUSH );
+}
+
+SerialChannel::SerialChannel( const string& path,
+                              const speed_t baud,
+                              const ThreadProfile& profile,
+                              const nanoseconds ping_interval )
+  : fd_( open( path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC ) )
+  , wake_fd_( -1 )
+  , requests_( QUEUE_CAPACITY )
+  , replies_( QUEUE_CAPACITY )
+  , ping_interval_( ping_interval )
+{
+  if ( fd_ < 0 ) {
+    throw errno_error( "open " + path );
+  }
+
+  try {
+    if ( not isatty( fd_ ) ) {
+      throw runtime_error( path + " is not a tty" );
+    }
+    make_raw( fd_, baud );
+
+    wake_fd_ = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if ( wake_fd_ < 0 ) {
+      throw errno_error( "eventfd" );
+    }
+  } catch ( ... ) {
+    close( fd_ );
+    throw;
+  }
+
+  thread_ = thread( &SerialChannel::loop, this, profile );
+}
+
+SerialChannel::~SerialChannel()
+{
+  running_ = false;
+  const uint64_t one = 1;
+  if ( write( wake_fd_, &one, sizeof( one ) ) < 0 ) {
+    /* the thread still notices within its epoll timeout */
+  }
+  thread_.join();
+
+  close( wake_fd_ );
+  close( fd_ );
+}
+
+uint32_t SerialChannel::send( AsgFrame request, const nanoseconds timeout )
+{
+  {
+    lock_guard<mutex> lock( stats_mutex_ );
+    if ( error_ ) {
+      rethrow_exception( error_ );
+    }
+  }
+
+  request.trial = next_sequence_++;
+  if ( not requests_.push( { request, timeout } ) ) {
+    throw runtime_error( "serial request queue is full" );
+  }
+
+  const uint64_t one = 1;
+  if ( write( wake_fd_, &one, sizeof( one ) ) < 0 and errno != EAGAIN ) {
+    throw errno_error( "eventfd write" );
+  }
+
+  return request.trial;
+}
+
+bool SerialChannel::receive( SerialReply& reply )
+{
+  if ( replies_.pop( reply ) ) {
+    return true;
+  }
+
+  lock_guard<mutex> lock( stats_mutex_ );
+  if ( error_ ) {
+    rethrow_exception( error_ );
+  }
+  return false;
+}
+
+SerialStats SerialChannel::stats() const
+{
+  lock_guard<mutex> lock( stats_mutex_ );
+  return stats_;
+}
+
+ClockEstimate SerialChannel::clock() const
+{
+  lock_guard<mutex> lock( stats_mutex_ );
+  return clock_;
+}
+
+void SerialChannel::loop( const ThreadProfile profile )
+{
+  try {
+    apply_thread_profile( profile );
+
+    const int epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    if ( epoll_fd < 0 ) {
+      throw errno_error( "epoll_create1" );
+    }
+
+    epoll_event tty_event {}, wake_event {};
+    tty_event.events = EPOLLIN;
+    tty_event.data.fd = fd_;
+    wake_event.events = EPOLLIN;
+    wake_event.data.fd = wake_fd_;
+
+    if ( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, fd_, &tty_event ) < 0
+         or epoll_ctl( epoll_fd, EPOLL_CTL_ADD, wake_fd_, &wake_event ) < 0 ) {
+      close( epoll_fd );
+      throw errno_error( "epoll_ctl" );
+    }
+
+    bool want_output = false;
+
+    while ( running_.load( memory_order_relaxed ) ) {
+      /* sleep until I/O, a new request, the nearest deadline or the next ping */
+      int timeout_ms = 100;
+      const auto now = steady_clock::now();
+      for ( const auto& request : outstanding_ ) {
+        const auto remaining = duration_cast<milliseconds>( request.deadline - now ).count() + 1;
+        timeout_ms = max( 0, min<int>( timeout_ms, remaining ) );
+      }
+      if ( ping_interval_.count() > 0 ) {
+        const auto remaining = duration_cast<milliseconds>( next_ping_ - now ).count() + 1;
+        timeout_ms = max( 0, min<int>( timeout_ms, remaining ) );
+      }
+
+      epoll_event events[2];
+      const int count = epoll_wait( epoll_fd, events, 2, timeout_ms );
+      if ( count < 0 and errno != EINTR ) {
+        close( epoll_fd );
+        throw errno_error( "epoll_wait" );
+      }
+
+      for ( int i = 0; i < count; i++ ) {
+        if ( events[i].data.fd == wake_fd_ ) {
+          uint64_t value;
+          if ( read( wake_fd_, &value, sizeof( value ) ) < 0 and errno != EAGAIN ) {
+            close( epoll_fd );
+            throw errno_error( "eventfd read" );
+          }
+        } else if ( events[i].events & ( EPOLLIN | EPOLLHUP | EPOLLERR ) ) {
+          read_available();
+        }
+      }
+
+      /* encode newly queued requests */
+      Request request;
+      while ( requests_.pop( request ) ) {
+        uint8_t encoded[ASG_FRAME_SIZE];
+        asg_encode( request.frame, encoded );
+        output_.append( reinterpret_cast<const char*>( encoded ), ASG_FRAME_SIZE );
+        const auto sent = steady_clock::now();
+        outstanding_.push_back( { request.frame.trial, sent, sent + request.timeout, false } );
+      }
+
+      maybe_ping( steady_clock::now() );
+
+      write_pending();
+
+      /* only ask for EPOLLOUT while output is backed up */
+      if ( want_output != not output_.empty() ) {
+        want_output = not output_.empty();
+        tty_event.events = want_output ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        epoll_ctl( epoll_fd, EPOLL_CTL_MOD, fd_, &tty_event );
+      }
+
+      expire( steady_clock::now() );
+
+      io_stats_.corrupt = decoder_.corrupt();
+      io_stats_.skipped = decoder_.skipped();
+      lock_guard<mutex> lock( stats_mutex_ );
+      stats_ = io_stats_;
+      clock_ = clock_sync_.estimate();
+    }
+
+    close( epoll_fd );
+  } catch ( ... ) {
+    lock_guard<mutex> lock( stats_mutex_ );
+    error_ = current_exception();
+  }
+
+  reply_ready_.notify();
+}
+
+void SerialChannel::read_available()
+{
+  AsgFrame frame;
+  const uint8_t* samples = nullptr;
+
+  while ( true ) {
+    /* straight into the decoder's ring, where frames are parsed in place */
+    const ssize_t length = read( fd_, decoder_.write_ptr(), decoder_.writable() );
+    const auto now = steady_clock::now();
+
+    if ( length < 0 ) {
+      if ( errno == EAGAIN or errno == EINTR ) {
+        return;
+      }
+      if ( errno == EIO ) {
+        return; /* pty with no slave/master attached yet */
+      }
+      throw errno_error( "serial read" );
+    }
+
+    if ( length == 0 ) {
+      return;
+    }
+
+    if ( decoder_.idle() ) {
+      frame_start_ = now;
+    }
+    decoder_.commit( length );
+    io_stats_.bytes_in += length;
+
+    while ( decoder_.next( frame, &samples ) ) {
+      handle_frame( frame, samples, now );
+    }
+  }
+}
+
+void SerialChannel::write_pending()
+{
+  while ( not output_.empty() ) {
+    const ssize_t written = write( fd_, output_.data(), output_.size() );
+    if ( written < 0 ) {
+      if ( errno == EAGAIN or errno == EINTR ) {
+        return;
+      }
+      throw errno_error( "serial write" );
+    }
+
+    io_stats_.bytes_out += written;
+    output_.erase( 0, written );
+  }
+}
+
+void SerialChannel::handle_frame( const AsgFrame& frame, const uint8_t* samples, const steady_clock::time_point now )
+{
+  /* a waveform precedes its result; hold on to it until then */
+  if ( frame.type == AsgFrameType::Waveform ) {
+    waveform_.trial = frame.trial;
+    waveform_.first_us = frame.toggle_us;
+    waveform_.last_us = frame.edge_us;
+    waveform_.count = frame.threshold;
+    copy( samples, samples + frame.threshold, waveform_.samples.begin() );
+    have_waveform_ = true;
+    return;
+  }
+
+  const auto match = find_if(
+    outstanding_.begin(), outstanding_.end(), [&]( const Outstanding& o ) { return o.sequence == frame.trial; } );
+
+  const bool is_pong = frame.type == AsgFrameType::Pong;
+  if ( match == outstanding_.end() or match->ping != is_pong or not( is_pong or frame.type == AsgFrameType::Result ) ) {
+    io_stats_.unmatched++;
+    return;
+  }
+
+  if ( is_pong ) {
+    clock_sync_.add( { match->sent, now, frame.toggle_us, frame.edge_us } );
+    outstanding_.erase( match );
+    io_stats_.pongs++;
+    return;
+  }
+
+  SerialReply reply;
+  reply.sequence = match->sequence;
+  reply.frame = frame;
+  reply.sent = match->sent;
+  reply.first_byte = frame_start_;
+  reply.last_byte = now;
+  outstanding_.erase( match );
+
+  if ( have_waveform_ and waveform_.trial == frame.trial ) {
+    reply.has_waveform = true;
+    reply.waveform = waveform_;
+    have_waveform_ = false;
+  }
+
+  io_stats_.replies++;
+  deliver( reply );
+}
+
+void SerialChannel::expire( const steady_clock::time_point now )
+{
+  for ( auto it = outstanding_.begin(); it != outstanding_.end(); ) {
+    if ( it->deadline > now ) {
+      ++it;
+      continue;
+    }
+
+    if ( it->ping ) {
+      io_stats_.ping_timeouts++;
+      it = outstanding_.erase( it );
+      continue;
+    }
+
+    SerialReply reply;
+    reply.sequence = it->sequence;
+    reply.timed_out = true;
+    reply.sent = it->sent;
+
+    io_stats_.timeouts++;
+    deliver( reply );
+    it = outstanding_.erase( it );
+  }
+}
+
+void SerialChannel::maybe_ping( const steady_clock::time_point now )
+{
+  /* ping only an idle device: the firmware can't answer while it's timing an edge */
+  if ( ping_interval_.count() == 0 or now < next_ping_ or not outstanding_.empty() ) {
+    return;
+  }
+
+  AsgFrame ping;
+  ping.type = AsgFrameType::Ping;
+  ping.trial = PING_ID_BIT | next_ping_id_++;
+
+  uint8_t encoded[ASG_FRAME_SIZE];
+  asg_encode( ping, encoded );
+  output_.append( reinterpret_cast<const char*>( encoded ), ASG_FRAME_SIZE );
+  outstanding_.push_back( { ping.trial, now, now + PING_TIMEOUT, true } );
+
+  next_ping_ = now + ( next_ping_id_ < FAST_PINGS ? FAST_PING_INTERVAL : ping_interval_ );
+}
+
+void SerialChannel::deliver( const SerialReply& reply )
+{
+  if ( not replies_.push( reply ) ) {
+    throw runtime_error( "serial reply queue is full (replies are not being received)" );
+  }
+  reply_ready_.notify();
+}
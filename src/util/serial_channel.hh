@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <termios.h>
+
+#include "asg_protocol.hh"
+#include "clock_sync.hh"
+#include "spsc_ring.hh"
+#include "threads.hh"
+#include "wake_signal.hh"
+
+/* A reply frame from the device, matched to the request that asked for it */
+struct SerialReply
+{
+  uint32_t sequence = 0;
+  bool timed_out = false;
+  AsgFrame frame {};
+
+  bool has_waveform = false; /* the photodiode waveform, if the request asked for it */
+  AsgWaveform waveform {};
+
+  std::chrono::steady_clock::time_point sent {};       /* request written to the tty */
+  std::chrono::steady_clock::time_point first_byte {}; /* read() that returned the frame's sync byte */
+  std::chrono::steady_clock::time_point last_byte {};  /* read() that completed it */
+};
+
+struct SerialStats
+{
+  uint64_t bytes_in = 0, bytes_out = 0;
+  uint64_t replies = 0, timeouts = 0;
+  uint64_t unmatched = 0; /* frames that matched no outstanding request */
+  uint64_t corrupt = 0;   /* damaged frames (one per resynchronization) */
+  uint64_t skipped = 0;   /* bytes discarded while resynchronizing */
+  uint64_t pongs = 0, ping_timeouts = 0;
+};
+
+/* termios speed constant for a rate in baud (115200, 1000000, 2000000, ...) */
+speed_t baud_constant( const unsigned int rate );
+
+/* Frame protocol (asg_protocol.hh) to the artificial saccade generator on
+   an I/O thread. The tty is put in raw mode and driven by epoll; every
+   read is timestamped as it returns. Each request carries its sequence
+   number as the trial id, and replies are matched back to it. send() and
+   receive() never block: a request that gets no reply within its timeout
+   comes back from receive() marked timed_out. Works on any tty, including
+   the slave side of a pty.
+
+   While no request is outstanding the I/O thread also pings the device
+   every `ping_interval` (faster at first) and keeps a ClockSync estimate of
+   its clock, so device timestamps can be placed on the host timeline.
+   Pings never show up in receive(). */
+class SerialChannel
+{
+  struct Request
+  {
+    AsgFrame frame {};
+    std::chrono::nanoseconds timeout {};
+  };
+
+  struct Outstanding
+  {
+    uint32_t sequence;
+    std::chrono::steady_clock::time_point sent, deadline;
+    bool ping;
+  };
+
+  constexpr static uint32_t PING_ID_BIT = 0x80000000; /* pings are numbered apart from requests */
+
+  int fd_;
+  int wake_fd_; /* eventfd that tells the I/O thread a request is queued */
+
+  SPSCRing<Request> requests_;
+  SPSCRing<SerialReply> replies_;
+  WakeSignal reply_ready_ {};
+
+  uint32_t next_sequence_ = 1; /* touched only by the sending thread */
+
+  /* I/O thread state */
+  std::vector<Outstanding> outstanding_ {};
+  std::string output_ {};
+  AsgDecoder decoder_ {}; /* read() fills its ring directly */
+  std::chrono::steady_clock::time_point frame_start_ {};
+  bool have_waveform_ = false; /* waveform_ arrived and awaits its result */
+  AsgWaveform waveform_ {};
+  SerialStats io_stats_ {};
+  std::chrono::nanoseconds ping_interval_;
+  std::chrono::steady_clock::time_point next_ping_ {};
+  uint32_t next_ping_id_ = 0;
+  ClockSync clock_sync_ { 4 }; /* the Uno's micros() counts in 4 us steps */
+
+  mutable std::mutex stats_mutex_ {};
+  SerialStats stats_ {};
+  ClockEstimate clock_ {};
+  std::exception_ptr error_ {};
+
+  std::atomic<bool> running_ { true };
+  std::thread thread_ {};
+
+  void loop( const ThreadProfile profile );
+  void read_available();
+  void write_pending();
+  void handle_frame( const AsgFrame& frame,
+                     const uint8_t* samples,
+                     const std::chrono::steady_clock::time_point now );
+  void expire( const std::chrono::steady_clock::time_point now );
+  void maybe_ping( const std::chrono::steady_clock::time_point now );
+  void deliver( const SerialReply& reply );
+
+public:
+  /* baud is a termios speed constant such as B115200; a zero ping_interval disables clock sync */
+  SerialChannel( const std::string& path,
+                 const speed_t baud,
+                 const ThreadProfile& profile = {},
+                 const std::chrono::nanoseconds ping_interval = std::chrono::milliseconds( 100 ) );
+  ~SerialChannel();
+
+  /* queue a request, numbered with the next sequence number (which is returned) */
+  uint32_t send( AsgFrame request, const std::chrono::nanoseconds timeout = std::chrono::milliseconds( 1000 ) );
+
+  /* the next reply or timeout, oldest first, if there is one */
+  bool receive( SerialReply& reply );
+
+  /* notified after every reply or timeout, for callers that block */
+  WakeSignal& reply_ready() { return reply_ready_; }
+
+  SerialStats stats() const;
+
+  /* the latest estimate of the device clock */
+  ClockEstimate clock() const;
+
+  /* forbid copying */
+  SerialChannel( const SerialChannel& other ) = delete;
+  SerialChannel& operator=( const SerialChannel& other ) = delete;
+};
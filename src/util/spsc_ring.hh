@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+/* Bounded lock-free queue for exactly one producer thread and one consumer
+   thread. All storage is allocated up front; push() and pop() never
+   allocate, lock or make system calls. */
+template<class T>
+class SPSCRing
+{
+  /* keep the two indices on separate cache lines */
+  struct alignas( 64 ) Index
+  {
+    std::atomic<size_t> value { 0 };
+  };
+
+  std::vector<T> slots_;
+  size_t mask_;
+
+  Index head_ {}; /* next slot to write (owned by the producer) */
+  Index tail_ {}; /* next slot to read (owned by the consumer) */
+
+public:
+  /* capacity must be a power of two */
+  explicit SPSCRing( const size_t capacity )
+    : slots_( capacity )
+    , mask_( capacity - 1 )
+  {
+    if ( capacity == 0 or ( capacity & mask_ ) != 0 ) {
+      throw std::invalid_argument( "SPSCRing capacity must be a power of two" );
+    }
+  }
+
+  size_t capacity() const { return slots_.size(); }
+
+  /* producer side: returns false (and drops the item) if the ring is full */
+  bool push( const T& item )
+  {
+    const size_t head = head_.value.load( std::memory_order_relaxed );
+    if ( head - tail_.value.load( std::memory_order_acquire ) == slots_.size() ) {
+      return false;
+    }
+
+    slots_[head & mask_] = item;
+    head_.value.store( head + 1, std::memory_order_release );
+    return true;
+  }
+
+  /* consumer side: moves up to max_count items into out, oldest first */
+  size_t pop( T* out, const size_t max_count )
+  {
+    const size_t tail = tail_.value.load( std::memory_order_relaxed );
+    const size_t available = head_.value.load( std::memory_order_acquire ) - tail;
+    const size_t count = available < max_count ? available : max_count;
+
+    for ( size_t i = 0; i < count; i++ ) {
+      out[i] = slots_[( tail + i ) & mask_];
+    }
+
+    tail_.value.store( tail + count, std::memory_order_release );
+    return count;
+  }
+
+  bool pop( T& item ) { return pop( &item, 1 ) == 1; }
+
+  /* approximate when called from a thread other than the consumer */
+  size_t size() const
+  {
+    return head_.value.load( std::memory_order_acquire ) - tail_.value.load( std::memory_order_acquire );
+  }
+
+  /* forbid copying */
+  SPSCRing( const SPSCRing& other ) = delete;
+  SPSCRing& operator=( const SPSCRing& other ) = delete;
+};
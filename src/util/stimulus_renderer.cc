@@ -0,0 +1,334 @@
+#include <algorithm>
+#include <array>
+#include <memory>
+
+#include "display.hh"
+#include "frame_cache.hh"
+#include "frame_pacer.hh"
+#include "frame_stream.hh"
+#include "stimulus_renderer.hh"
+#include "threads.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+StimulusRenderer::StimulusRenderer( const RendererConfig& config )
+  : config_( config )
+{
+  thread_ = thread( &StimulusRenderer::loop, this );
+
+  unique_lock<mutex> lock( mutex_ );
+  state_changed_.wait( lock, [&] { return state_ != State::Starting or error_; } );
+
+  if ( error_ ) {
+    lock.unlock();
+    thread_.join();
+    rethrow_exception( error_ );
+  }
+}
+
+StimulusRenderer::~StimulusRenderer()
+{
+  set_state( State::Stopping );
+  trigger();
+  thread_.join();
+}
+
+void StimulusRenderer::set_state( const State state )
+{
+  {
+    lock_guard<mutex> lock( mutex_ );
+    state_ = state;
+  }
+  state_changed_.notify_all();
+}
+
+void StimulusRenderer::rethrow_error()
+{
+  lock_guard<mutex> lock( mutex_ );
+  if ( error_ ) {
+    rethrow_exception( error_ );
+  }
+}
+
+void StimulusRenderer::arm()
+{
+  rethrow_error();
+
+  unique_lock<mutex> lock( mutex_ );
+  if ( state_ != State::Idle ) {
+    throw runtime_error( "StimulusRenderer armed while a trial is still being drawn" );
+  }
+
+  triggered_ = false;
+  state_ = State::Armed;
+  lock.unlock();
+  state_changed_.notify_all();
+}
+
+TrialDrawResult StimulusRenderer::wait()
+{
+  unique_lock<mutex> lock( mutex_ );
+  state_changed_.wait( lock, [&] { return state_ != State::Armed or error_; } );
+
+  if ( error_ ) {
+    rethrow_exception( error_ );
+  }
+  return result_;
+}
+
+/**
+ * Runs on the render thread. Toggles between 2 of 4 textures: clock_white
+ * and clock_black before triggered, and trigger_white and trigger_black after
+ * triggering, where the post-trigger versions contain a white square at the
+ * bottom left in addition to alternating black and white in the top left.
+ */
+void StimulusRenderer::loop()
+{
+  try {
+    apply_thread_profile( config_.thread );
+
+    if ( config_.paced and config_.sync_mode != SyncMode::Finish ) {
+      throw runtime_error( "paced rendering needs the finish sync mode to observe vblanks" );
+    }
+
+    const unsigned int width = config_.mode.width, height = config_.mode.height, box = config_.box_dim;
+
+    // First, set up all the textures
+    VideoDisplay display { width, height, config_.fullscreen, false, config_.monitor, config_.mode.refresh_hz };
+    display.window().hide_cursor( true );
+
+    // whether to wait for vertical retrace before swapping buffer
+    // *  0 for immediate updates
+    // *  1 for updates synchronized with the vertical retrace
+    // * -1 for adaptive vsync
+    display.window().set_swap_interval( config_.paced ? 1 : 0 );
+    display.set_sync_mode( config_.sync_mode, config_.frames_in_flight );
+
+    const int refresh_rate = display.window().refresh_rate();
+    const nanoseconds refresh_period = refresh_rate > 0 ? nanoseconds( 1000000000 / refresh_rate ) : milliseconds( 4 );
+    const nanoseconds clock_period = config_.clock_period.count() > 0 ? config_.clock_period : refresh_period;
+    FramePacer pacer( refresh_period );
+    {
+      lock_guard<mutex> lock( mutex_ );
+      mode_ = config_.fullscreen ? display.window().video_mode()
+                                 : DisplayMode { width, height, unsigned( max( refresh_rate, 0 ) ) };
+    }
+
+    /* 235 = max luma and 16 = min luma in typical Y'CbCr colorspace. The dark
+       boxes are listed explicitly so the patch renderer repaints them too. */
+    const LumaRect clock_on { 0, 0, box, box, 235 }, clock_off { 0, 0, box, box, 16 };
+    const LumaRect trigger_on { 0, height - box, box, box, 235 }, trigger_off { 0, height - box, box, box, 16 };
+
+    enum Frame
+    {
+      CLOCK_WHITE,
+      CLOCK_BLACK,
+      TRIGGERED_WHITE,
+      TRIGGERED_BLACK,
+    };
+
+    const array<FramePattern, 4> patterns = { { { width, height, 16, { clock_on, trigger_off } },
+                                                { width, height, 16, { clock_off, trigger_off } },
+                                                { width, height, 16, { clock_on, trigger_on } },
+                                                { width, height, 16, { clock_off, trigger_on } } } };
+
+    FrameCache frames;
+    array<Texture420*, 4> textures;
+    for ( unsigned int i = 0; i < patterns.size(); i++ ) {
+      textures[i] = &frames.texture( patterns[i] );
+    }
+
+    /* optional full-motion background, streamed from disk */
+    unique_ptr<Y4MReader> stimulus;
+    unique_ptr<FrameStream> stream;
+    Texture420* stimulus_frame = nullptr;
+    if ( not config_.stimulus.empty() ) {
+      stimulus = make_unique<Y4MReader>( config_.stimulus );
+      stream = make_unique<FrameStream>( *stimulus );
+      stimulus_frame = stream->next();
+    }
+
+    /* clock frames stop waiting for the GPU when the trigger arrives; in
+       Block mode the flag is checked every 20 us, otherwise continuously */
+    const nanoseconds interrupt_poll = config_.poll_mode == PollMode::Block ? microseconds( 20 ) : nanoseconds( 0 );
+
+    const auto show = [&]( const Frame frame ) {
+      if ( stream ) {
+        /* if the next frame isn't ready, repeat the last one rather than wait */
+        if ( Texture420* const next_frame = stream->next() ) {
+          stimulus_frame = next_frame;
+        }
+        display.draw( *stimulus_frame, patterns[frame] );
+      } else if ( config_.patches ) {
+        display.draw( patterns[frame] );
+      } else {
+        display.draw( *textures[frame] );
+      }
+    };
+
+    // Draw frames once to warm up. This brings subsequent draw times to <1ms.
+    show( TRIGGERED_WHITE );
+    show( TRIGGERED_BLACK );
+    show( CLOCK_WHITE );
+    show( CLOCK_BLACK );
+
+    bool toggle = true;
+
+    const unique_ptr<RecordLog::Writer> frame_log
+      = config_.log ? make_unique<RecordLog::Writer>( *config_.log ) : nullptr;
+    const uint32_t frames_table = config_.log ? config_.log->add_table( config_.log_table,
+                                                                        { "frame",
+                                                                          "start (ns)",
+                                                                          "submitted (ns)",
+                                                                          "swapped (ns)",
+                                                                          "finished (ns)",
+                                                                          "completed (ns)",
+                                                                          "gpu draw (ns)",
+                                                                          "gpu to swap (ns)" } )
+                                              : 0;
+    const auto ns = []( const FrameTiming::time_point t ) -> int64_t {
+      return t == FrameTiming::time_point {} ? RecordLog::NO_VALUE
+                                             : duration_cast<nanoseconds>( t.time_since_epoch() ).count();
+    };
+
+    /* swap-to-swap intervals of the current trial's frames */
+    HdrHistogram intervals;
+    uint64_t first_trial_frame = 0;
+    FrameTiming previous;
+
+    /* keep the timing ring drained (feeding the pacer, the log and the
+       intervals), remembering the frame numbered `wanted` */
+    FrameTiming timing;
+    const auto drain_timings = [&]( const uint64_t wanted, FrameTiming* const found ) {
+      while ( display.timer().timings().pop( timing ) ) {
+        if ( timing.frame > first_trial_frame and timing.frame == previous.frame + 1 ) {
+          intervals.add( duration_cast<microseconds>( timing.cpu_swapped - previous.cpu_swapped ).count() );
+        }
+        previous = timing;
+
+        if ( frame_log ) {
+          frame_log->write( frames_table,
+                            { int64_t( timing.frame ),
+                              ns( timing.cpu_start ),
+                              ns( timing.cpu_submitted ),
+                              ns( timing.cpu_swapped ),
+                              ns( timing.cpu_finished ),
+                              ns( timing.cpu_completed ),
+                              timing.gpu_valid() ? timing.gpu_draw().count() : RecordLog::NO_VALUE,
+                              timing.gpu_valid() ? timing.gpu_to_swap().count() : RecordLog::NO_VALUE } );
+        }
+        if ( config_.paced ) {
+          pacer.observe( timing );
+        }
+        if ( found and timing.frame == wanted ) {
+          *found = timing;
+        }
+      }
+    };
+
+    // Lock on to the vblank phase before the first trial
+    drain_timings( 0, nullptr );
+    for ( unsigned int i = 0; config_.paced and not pacer.locked() and i < 256; i++ ) {
+      show( toggle ? CLOCK_WHITE : CLOCK_BLACK );
+      drain_timings( 0, nullptr );
+      toggle = !toggle;
+    }
+
+    set_state( State::Idle );
+
+    while ( true ) {
+      // Sleep until the next trial is armed
+      {
+        unique_lock<mutex> lock( mutex_ );
+        state_changed_.wait( lock, [&] { return state_ != State::Idle; } );
+        if ( state_ == State::Stopping ) {
+          return;
+        }
+      }
+
+      // Start every trial from a fully repainted background, whatever the
+      // last trial left in the swap chain
+      display.repaint_background();
+
+      // Alternate clock frames until triggered
+      TrialDrawResult result;
+      Poller poller( config_.poll_mode, &trigger_signal_ );
+      const auto trial_cpu = thread_cpu_time();
+      const uint64_t repeats_before = stream ? stream->stats().repeated : 0;
+      const auto start_time = steady_clock::now();
+      auto due = steady_clock::now(); /* when the next clock frame should start */
+      intervals.clear();
+      first_trial_frame = display.timer().next_frame();
+      const uint64_t interrupted_before = display.interrupted();
+      const uint64_t vblanks_before = pacer.vblanks();
+      if ( config_.interrupt_clock ) {
+        display.set_interrupt( &triggered_, interrupt_poll );
+      }
+
+      while ( true ) {
+        const uint32_t seen = trigger_signal_.sequence();
+
+        if ( triggered_.load( memory_order_acquire ) ) {
+          // Draw a couple of the triggered frames (waiting for each) and then go idle
+          const auto observed = steady_clock::now();
+          const steady_clock::time_point trigger_time { nanoseconds( trigger_time_ns_.load() ) };
+          display.set_interrupt( nullptr );
+          result.trigger_observe = observed - trigger_time;
+          result.clock_duration = observed - start_time;
+          result.clock_interrupted = display.interrupted() != interrupted_before;
+          result.pacer_locked = config_.paced and pacer.locked();
+          result.pacer_vblanks = pacer.vblanks() - vblanks_before;
+          const uint64_t trigger_frame = display.timer().next_frame();
+          const auto t1 = steady_clock::now();
+          show( toggle ? TRIGGERED_WHITE : TRIGGERED_BLACK );
+          const auto t2 = steady_clock::now();
+          result.drawing_delay_us = duration_cast<microseconds>( t2 - t1 ).count();
+          show( toggle ? TRIGGERED_BLACK : TRIGGERED_WHITE );
+          show( toggle ? TRIGGERED_WHITE : TRIGGERED_BLACK );
+          drain_timings( trigger_frame, &result.trigger_timing );
+          if ( result.trigger_timing.frame == trigger_frame ) {
+            const FrameTiming& drawn = result.trigger_timing;
+            result.trigger_to_present
+              = ( drawn.completion_valid() ? drawn.cpu_completed : drawn.cpu_finished ) - trigger_time;
+          }
+          break;
+        }
+
+        const auto ts = steady_clock::now();
+        if ( ts < due ) {
+          // back off until the next clock frame is due or the trigger arrives
+          poller.idle( seen, due - ts );
+        } else {
+          poller.reset();
+          show( toggle ? CLOCK_WHITE : CLOCK_BLACK );
+          drain_timings( 0, nullptr );
+          toggle = !toggle;
+          result.clock_frames++;
+          due = config_.paced ? pacer.submit_deadline( steady_clock::now() ) : ts + clock_period;
+        }
+      }
+
+      result.cpu_time = thread_cpu_time() - trial_cpu;
+      result.frame_intervals = intervals;
+      if ( stream ) {
+        result.stimulus_repeats = stream->stats().repeated - repeats_before;
+      }
+
+      {
+        lock_guard<mutex> lock( mutex_ );
+        result_ = result;
+        if ( state_ == State::Armed ) {
+          state_ = State::Idle;
+        }
+      }
+      state_changed_.notify_all();
+    }
+  } catch ( ... ) {
+    {
+      lock_guard<mutex> lock( mutex_ );
+      error_ = current_exception();
+    }
+    state_changed_.notify_all();
+  }
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "display.hh"
+#include "frame_timer.hh"
+#include "hdr_histogram.hh"
+#include "poller.hh"
+#include "record_log.hh"
+#include "threads.hh"
+#include "wake_signal.hh"
+
+struct RendererConfig
+{
+  DisplayMode mode {}; /* luma resolution, and the refresh rate to switch a fullscreen monitor to */
+  bool fullscreen = true;
+  unsigned int monitor = 0; /* which monitor to fill (0 is the primary) */
+  unsigned int box_dim = 100; /* dimensions of the white squares */
+  bool patches = false;       /* draw the squares with scissored clears instead of textures */
+  std::string stimulus {};    /* y4m file streamed behind the squares, a new frame per clock frame */
+
+  /* Vsync and submit each clock frame just before the predicted vblank
+     (one per refresh, ignoring clock_period) instead of on a free-running
+     timer with tearing; a trigger is drawn immediately into the next scanout. */
+  bool paced = false;
+
+  /* how each frame waits for the GPU; paced requires Finish */
+  SyncMode sync_mode = SyncMode::Finish;
+  unsigned int frames_in_flight = 2; /* limit for SyncMode::Fence */
+
+  /* time between clock frames; 0 for one refresh period (4 ms if the rate is unknown) */
+  std::chrono::nanoseconds clock_period { 0 };
+
+  PollMode poll_mode = PollMode::Spin;
+  ThreadProfile thread {}; /* scheduling of the render thread */
+
+  /* a trigger cuts short the wait for the GPU to finish a clock frame, so
+     the triggered frame is submitted at once (SyncMode::Finish only) */
+  bool interrupt_clock = true;
+
+  RecordLog* log = nullptr;         /* if set, every frame's timing goes into a table */
+  std::string log_table = "frames"; /* ... of this name */
+};
+
+/* What the render thread measured for one trial */
+struct TrialDrawResult
+{
+  unsigned int drawing_delay_us = 0; /* time to draw the first triggered frame */
+  unsigned int clock_frames = 0;     /* clock frames drawn before the trigger */
+  unsigned int stimulus_repeats = 0; /* frames that reused the previous stimulus frame */
+  bool clock_interrupted = false;    /* the trigger cut short the wait for the last clock frame */
+  bool pacer_locked = false;         /* paced: the vblank prediction was locked when the trigger was seen */
+  unsigned int pacer_vblanks = 0;    /* paced: clock frame vblanks that corrected the prediction */
+  std::chrono::nanoseconds clock_duration { 0 };  /* from arm() until the trigger was seen */
+  std::chrono::nanoseconds trigger_observe { 0 }; /* from trigger() until the render thread saw it */
+  std::chrono::nanoseconds cpu_time { 0 };
+  FrameTiming trigger_timing {}; /* stage breakdown of the first triggered frame */
+  std::chrono::nanoseconds trigger_to_present { 0 }; /* trigger() until that frame's swap completed */
+  HdrHistogram frame_intervals {}; /* us between successive swaps during the trial */
+};
+
+/* Long-lived display thread. The window, shaders and the four clock/trigger
+   textures are built once; each trial then arms the thread, which toggles
+   the clock square until trigger() is called, draws the triggered frames and
+   goes idle again. */
+class StimulusRenderer
+{
+  enum class State
+  {
+    Starting,
+    Idle,
+    Armed,
+    Stopping,
+  };
+
+  RendererConfig config_;
+
+  std::mutex mutex_ {};
+  std::condition_variable state_changed_ {};
+  State state_ = State::Starting;
+  DisplayMode mode_ {};
+  TrialDrawResult result_ {};
+  std::exception_ptr error_ {};
+
+  /* the only state touched on the hot path */
+  std::atomic<bool> triggered_ { false };
+  std::atomic<int64_t> trigger_time_ns_ { 0 }; /* steady_clock time of the last trigger() */
+  WakeSignal trigger_signal_ {};
+
+  std::thread thread_ {};
+
+  void loop();
+  void set_state( const State state );
+  void rethrow_error();
+
+public:
+  /* returns once the display and textures are ready */
+  explicit StimulusRenderer( const RendererConfig& config );
+  ~StimulusRenderer();
+
+  /* start drawing clock frames for a new trial */
+  void arm();
+
+  /* switch to the triggered frames (safe to call from any thread) */
+  void trigger()
+  {
+    trigger_time_ns_.store( std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed );
+    triggered_.store( true, std::memory_order_release );
+    trigger_signal_.notify();
+  }
+
+  /* wait for the triggered frames of the current trial to be drawn */
+  TrialDrawResult wait();
+
+  const RendererConfig& config() const { return config_; }
+
+  /* the video mode the display actually got */
+  DisplayMode mode()
+  {
+    std::lock_guard<std::mutex> lock( mutex_ );
+    return mode_;
+  }
+
+  /* forbid copying */
+  StimulusRenderer( const StimulusRenderer& other ) = delete;
+  StimulusRenderer& operator=( const StimulusRenderer& other ) = delete;
+};
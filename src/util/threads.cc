@@ -0,0 +1,131 @@
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "threads.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+void pin_this_thread( const int cpu )
+{
+  if ( cpu < 0 ) {
+    return;
+  }
+
+  cpu_set_t cpus;
+  CPU_ZERO( &cpus );
+  CPU_SET( cpu, &cpus );
+
+  const int error = pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+  if ( error != 0 ) {
+    throw runtime_error( "unable to pin thread to CPU " + to_string( cpu ) + ": " + strerror( error ) );
+  }
+}
+
+nanoseconds thread_cpu_time()
+{
+  timespec ts;
+  if ( clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts ) != 0 ) {
+    throw runtime_error( string( "clock_gettime: " ) + strerror( errno ) );
+  }
+  return seconds( ts.tv_sec ) + nanoseconds( ts.tv_nsec );
+}
+
+/* touch the pages below the current stack frame, so later growth into them
+   doesn't fault (the frame itself is discarded on return) */
+static void __attribute__( ( noinline ) ) prefault_stack( const size_t bytes )
+{
+  volatile char* const touched = static_cast<volatile char*>( alloca( bytes ) );
+  const size_t page = sysconf( _SC_PAGESIZE );
+  for ( size_t i = 0; i < bytes; i += page ) {
+    touched[i] = 0;
+  }
+}
+
+void apply_thread_profile( const ThreadProfile& profile )
+{
+  pin_this_thread( profile.cpu );
+
+  if ( profile.realtime() ) {
+    sched_param param {};
+    param.sched_priority = profile.priority;
+    const int error = pthread_setschedparam( pthread_self(), SCHED_FIFO, &param );
+    if ( error != 0 ) {
+      throw runtime_error( "unable to set SCHED_FIFO priority " + to_string( profile.priority ) + ": "
+                           + strerror( error ) );
+    }
+  }
+
+  if ( profile.stack > 0 ) {
+    prefault_stack( profile.stack );
+  }
+}
+
+void lock_memory()
+{
+  if ( mlockall( MCL_CURRENT | MCL_FUTURE ) != 0 ) {
+    throw runtime_error( string( "mlockall: " ) + strerror( errno ) );
+  }
+
+  /* keep freed memory (and large allocations) on the heap, already faulted in */
+  mallopt( M_TRIM_THRESHOLD, -1 );
+  mallopt( M_MMAP_MAX, 0 );
+}
+
+void unlock_memory()
+{
+  munlockall();
+  mallopt( M_TRIM_THRESHOLD, 128 * 1024 );
+  mallopt( M_MMAP_MAX, 65536 );
+}
+
+void prefault( void* const data, const size_t bytes )
+{
+  volatile char* const pages = static_cast<volatile char*>( data );
+  const size_t page = sysconf( _SC_PAGESIZE );
+  for ( size_t i = 0; i < bytes; i += page ) {
+    pages[i] = pages[i];
+  }
+}
+
+vector<int> parse_cpu_list( const string& list )
+{
+  vector<int> cpus;
+  size_t pos = 0;
+  while ( pos < list.size() ) {
+    size_t end = list.find( ',', pos );
+    if ( end == string::npos ) {
+      end = list.size();
+    }
+
+    const string range = list.substr( pos, end - pos );
+    const size_t dash = range.find( '-' );
+    if ( not range.empty() and range.find_first_not_of( " \n" ) != string::npos ) {
+      const int first = stoi( range.substr( 0, dash ) );
+      const int last = dash == string::npos ? first : stoi( range.substr( dash + 1 ) );
+      for ( int cpu = first; cpu <= last; cpu++ ) {
+        cpus.push_back( cpu );
+      }
+    }
+    pos = end + 1;
+  }
+  return cpus;
+}
+
+vector<int> isolated_cpus()
+{
+  ifstream in( "/sys/devices/system/cpu/isolated" );
+  string list;
+  getline( in, list );
+  return parse_cpu_list( list );
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* pin the calling thread to one CPU (no-op if cpu < 0) */
+void pin_this_thread( const int cpu );
+
+/* CPU time consumed so far by the calling thread */
+std::chrono::nanoseconds thread_cpu_time();
+
+/* How a pipeline thread is scheduled. The default is an ordinary,
+   unpinned CFS thread. */
+struct ThreadProfile
+{
+  int cpu = -1;         /* pin to this CPU, if not negative */
+  int priority = 0;     /* SCHED_FIFO priority (1-99), or 0 to stay SCHED_OTHER */
+  size_t stack = 0;     /* bytes of stack to fault in before the thread's loop starts */
+
+  bool realtime() const { return priority > 0; }
+};
+
+/* apply a profile to the calling thread; throws if it can't be applied
+   (SCHED_FIFO needs CAP_SYS_NICE or an RLIMIT_RTPRIO allowance) */
+void apply_thread_profile( const ThreadProfile& profile );
+
+/* Lock the process's current and future pages into RAM and stop malloc
+   from returning memory to the kernel, so no page faults are taken once
+   buffers have been touched. Throws if mlockall() is refused. */
+void lock_memory();
+
+/* undo lock_memory() */
+void unlock_memory();
+
+/* touch every page of a buffer */
+void prefault( void* data, const size_t bytes );
+
+/* the CPUs kept off the scheduler's hands with isolcpus= (empty if none) */
+std::vector<int> isolated_cpus();
+
+/* parse a Linux CPU list such as "2-3,6" */
+std::vector<int> parse_cpu_list( const std::string& list );
@@ -0,0 +1,56 @@
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "wake_signal.hh"
+
+using namespace std;
+using namespace std::chrono;
+
+static_assert( sizeof( atomic<uint32_t> ) == sizeof( uint32_t ), "futex word must be 32 bits" );
+
+static uint32_t* futex_word( atomic<uint32_t>& word )
+{
+  return reinterpret_cast<uint32_t*>( &word );
+}
+
+void WakeSignal::notify()
+{
+  sequence_.fetch_add( 1, memory_order_seq_cst );
+
+  if ( waiters_.load( memory_order_seq_cst ) > 0 ) {
+    syscall( SYS_futex, futex_word( sequence_ ), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0 );
+  }
+}
+
+bool WakeSignal::wait( const uint32_t seen, const nanoseconds timeout )
+{
+  const auto deadline = steady_clock::now() + timeout;
+
+  waiters_.fetch_add( 1, memory_order_seq_cst );
+
+  while ( sequence_.load( memory_order_seq_cst ) == seen ) {
+    const auto remaining = deadline - steady_clock::now();
+    if ( remaining <= nanoseconds::zero() ) {
+      break;
+    }
+
+    const auto secs = duration_cast<seconds>( remaining );
+    const timespec relative = { time_t( secs.count() ), long( ( remaining - secs ).count() ) };
+
+    /* returns immediately (EAGAIN) if the sequence already moved on */
+    if ( syscall( SYS_futex, futex_word( sequence_ ), FUTEX_WAIT_PRIVATE, seen, &relative, nullptr, 0 ) < 0
+         and errno != EAGAIN and errno != EINTR and errno != ETIMEDOUT ) {
+      waiters_.fetch_sub( 1, memory_order_seq_cst );
+      throw runtime_error( string( "futex wait: " ) + strerror( errno ) );
+    }
+  }
+
+  waiters_.fetch_sub( 1, memory_order_seq_cst );
+  return sequence_.load( memory_order_acquire ) != seen;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/* Futex-backed event counter for waking a blocked thread. notify() is a
+   single atomic increment (plus a syscall only when someone is asleep), so
+   producers can call it from a hot loop. */
+class WakeSignal
+{
+  std::atomic<uint32_t> sequence_ { 0 };
+  std::atomic<uint32_t> waiters_ { 0 };
+
+public:
+  WakeSignal() {}
+
+  /* snapshot to pass to wait(); take it *before* checking for work */
+  uint32_t sequence() const { return sequence_.load( std::memory_order_acquire ); }
+
+  void notify();
+
+  /* sleep until notify() is called after `seen` was taken, or until timeout;
+     returns true if notified */
+  bool wait( const uint32_t seen, const std::chrono::nanoseconds timeout );
+
+  /* forbid copying */
+  WakeSignal( const WakeSignal& other ) = delete;
+  WakeSignal& operator=( const WakeSignal& other ) = delete;
+};
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "y4m_reader.hh"
+
+using namespace std;
+
+Y4MReader::Y4MReader( const string& path )
+  : fd_( open( path.c_str(), O_RDONLY ) )
+{
+  if ( fd_ < 0 ) {
+    throw runtime_error( "open " + path + ": " + strerror( errno ) );
+  }
+
+  try {
+    struct stat info;
+    if ( fstat( fd_, &info ) < 0 ) {
+      throw runtime_error( "fstat " + path + ": " + strerror( errno ) );
+    }
+    length_ = info.st_size;
+
+    if ( length_ == 0 ) {
+      throw runtime_error( path + " is empty" );
+    }
+
+    void* const data = mmap( nullptr, length_, PROT_READ, MAP_PRIVATE, fd_, 0 );
+    if ( data == MAP_FAILED ) {
+      throw runtime_error( "mmap " + path + ": " + strerror( errno ) );
+    }
+    data_ = static_cast<uint8_t*>( data );
+
+    /* playback reads front to back, so let the kernel read ahead aggressively */
+    madvise( data_, length_, MADV_SEQUENTIAL );
+
+    parse();
+  } catch ( const exception& e ) {
+    if ( data_ ) {
+      munmap( data_, length_ );
+    }
+    close( fd_ );
+    throw runtime_error( path + ": " + e.what() );
+  }
+}
+
+Y4MReader::~Y4MReader()
+{
+  munmap( data_, length_ );
+  close( fd_ );
+}
+
+/* The stream header is "YUV4MPEG2" followed by space-separated parameters
+   (W<width> H<height> F<num>:<den> C<colorspace> ...) and a newline. Each
+   frame is "FRAME", optional parameters, a newline, and the planes. */
+void Y4MReader::parse()
+{
+  const char* const begin = reinterpret_cast<const char*>( data_ );
+  const char* const end = begin + length_;
+
+  const auto line_end = [&]( const char* from ) {
+    const char* newline = static_cast<const char*>( memchr( from, '\n', end - from ) );
+    if ( not newline ) {
+      throw runtime_error( "truncated y4m header" );
+    }
+    return newline;
+  };
+
+  static const string MAGIC = "YUV4MPEG2";
+  if ( length_ < MAGIC.size() or memcmp( begin, MAGIC.data(), MAGIC.size() ) != 0 ) {
+    throw runtime_error( "not a YUV4MPEG2 file" );
+  }
+
+  const char* const header_end = line_end( begin );
+  const string header( begin + MAGIC.size(), header_end );
+
+  size_t position = 0;
+  while ( position < header.size() ) {
+    const size_t next = min( header.find( ' ', position ), header.size() );
+    const string token = header.substr( position, next - position );
+    position = next + 1;
+
+    if ( token.empty() ) {
+      continue;
+    }
+
+    const string value = token.substr( 1 );
+    switch ( token[0] ) {
+      case 'W':
+        width_ = stoul( value );
+        break;
+      case 'H':
+        height_ = stoul( value );
+        break;
+      case 'F': {
+        const size_t colon = value.find( ':' );
+        rate_numerator_ = stoul( value.substr( 0, colon ) );
+        rate_denominator_ = colon == string::npos ? 1 : max( 1ul, stoul( value.substr( colon + 1 ) ) );
+        break;
+      }
+      case 'C':
+        if ( value.compare( 0, 3, "420" ) != 0 ) {
+          throw runtime_error( "unsupported y4m colorspace C" + value + " (only 4:2:0 is supported)" );
+        }
+        break;
+      default: /* interlacing, aspect ratio and extensions don't affect the layout */
+        break;
+    }
+  }
+
+  if ( width_ == 0 or height_ == 0 or width_ % 2 or height_ % 2 ) {
+    throw runtime_error( "y4m frame dimensions must be nonzero and even" );
+  }
+
+  frame_size_ = size_t( width_ ) * height_ * 3 / 2;
+
+  static const string FRAME = "FRAME";
+  const char* cursor = header_end + 1;
+  while ( cursor < end ) {
+    if ( size_t( end - cursor ) < FRAME.size() or memcmp( cursor, FRAME.data(), FRAME.size() ) != 0 ) {
+      throw runtime_error( "bad y4m frame marker after frame " + to_string( frame_offsets_.size() ) );
+    }
+
+    const char* const planes = line_end( cursor ) + 1;
+    if ( size_t( end - planes ) < frame_size_ ) {
+      break; /* ignore a truncated final frame */
+    }
+
+    frame_offsets_.push_back( planes - begin );
+    cursor = planes + frame_size_;
+  }
+
+  if ( frame_offsets_.empty() ) {
+    throw runtime_error( "y4m file has no complete frames" );
+  }
+}
+
+void Y4MReader::will_need( const size_t first, const size_t count ) const
+{
+  static const size_t page = sysconf( _SC_PAGESIZE );
+
+  for ( size_t i = 0; i < count; i++ ) {
+    const size_t offset = frame_offsets_[( first + i ) % frame_offsets_.size()];
+    const size_t start = offset / page * page;
+    madvise( data_ + start, offset + frame_size_ - start, MADV_WILLNEED );
+  }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Read-only memory map of a YUV4MPEG2 (.y4m) file of 4:2:0 8-bit frames.
+   Frames are returned in place as consecutive Y', Cb and Cr planes, so the
+   only copy is the one made by whoever consumes them. */
+class Y4MReader
+{
+  int fd_;
+  uint8_t* data_ = nullptr;
+  size_t length_ = 0;
+
+  unsigned int width_ = 0, height_ = 0;
+  unsigned int rate_numerator_ = 0, rate_denominator_ = 1;
+  size_t frame_size_ = 0;
+  std::vector<size_t> frame_offsets_ {};
+
+  void parse();
+
+public:
+  explicit Y4MReader( const std::string& path );
+  ~Y4MReader();
+
+  unsigned int width() const { return width_; }
+  unsigned int height() const { return height_; }
+  size_t frame_count() const { return frame_offsets_.size(); }
+
+  /* bytes in one frame: width * height luma plus two quarter-size chroma planes */
+  size_t frame_size() const { return frame_size_; }
+
+  /* nominal frame rate from the header (0 if absent) */
+  double frame_rate() const { return double( rate_numerator_ ) / rate_denominator_; }
+
+  const uint8_t* frame( const size_t index ) const { return data_ + frame_offsets_.at( index ); }
+
+  /* ask the kernel to start reading frames [first, first + count) (wrapping around) */
+  void will_need( const size_t first, const size_t count ) const;
+
+  /* forbid copying */
+  Y4MReader( const Y4MReader& other ) = delete;
+  Y4MReader& operator=( const Y4MReader& other ) = delete;
+};